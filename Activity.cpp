@@ -31,6 +31,7 @@ Activity::Activity() :
 	this->ActivityLengthMode = LengthMode::FREE;
 
 	this->Owner = nullptr;
+	this->Block = nullptr;
 }
 
 
@@ -41,7 +42,12 @@ Activity::Activity(Activity const &Other)
 	if (Other.Beginning != nullptr)
 		this->Beginning = new Offset(*Other.Beginning);
 
+	// Copies have no owner, so they keep their actual times whole
+	this->ActualStartTime += Other.GetBase();
+	this->ActualEndTime += Other.GetBase();
+
 	this->Owner = nullptr;
+	this->Block = nullptr;
 }
 
 
@@ -52,8 +58,14 @@ Activity::~Activity()
 }
 
 
-std::string	Activity::GetName() const					{ return this->Name; }
-void		Activity::SetName(std::string const &Name)	{ this->Name = Name; }
+std::string const &Activity::GetName() const { return this->Name; }
+
+
+void Activity::SetName(std::string const &Name)
+{
+	this->Name = Name;
+	this->UpdateSchedule();
+}
 
 
 Activity::StartMode Activity::GetStartMode() const { return this->ActivityStartMode; }
@@ -91,7 +103,9 @@ void Activity::SetDesiredLength(Duration const &Length)
 void Activity::SetDesiredStartTime(Offset const &StartTime)
 {
 	this->DesiredStartTime = StartTime;
-	this->UpdateSchedule();
+
+	if (this->Owner != nullptr)
+		this->Owner->UpdateStart(*this);
 }
 
 
@@ -102,9 +116,9 @@ void Activity::SetDesiredEndTime(Offset const &EndTime)
 }
 
 
-Duration	Activity::GetActualLength() const		{ return this->ActualLength; }
-Offset		Activity::GetActualStartTime() const	{ return this->ActualStartTime; }
-Offset		Activity::GetActualEndTime() const		{ return this->ActualEndTime; }
+Duration	Activity::GetActualLength() const		{ this->UpdateLayout(); return this->ActualLength; }
+Offset		Activity::GetActualStartTime() const	{ this->UpdateLayout(); return this->ActualStartTime + this->GetBase(); }
+Offset		Activity::GetActualEndTime() const		{ this->UpdateLayout(); return this->ActualEndTime + this->GetBase(); }
 
 
 Duration	Activity::GetOptimalLength() const		{ return this->OptimalLength; }
@@ -146,5 +160,18 @@ void Activity::ClearBeginning()
 void Activity::UpdateSchedule()
 {
 	if (this->Owner != nullptr)
-		this->Owner->Update();
+		this->Owner->Update(*this);
+}
+
+
+void Activity::UpdateLayout() const
+{
+	if (this->Owner != nullptr)
+		this->Owner->UpdateLayout();
+}
+
+
+Offset Activity::GetBase() const
+{
+	return (this->Owner != nullptr ? this->Owner->GetBase() : Offset());
 }
@@ -28,6 +28,7 @@
 namespace Schedule
 {
 	class Schedule;
+	struct ScheduleBlock;
 
 	class Activity
 	{
@@ -36,8 +37,8 @@ namespace Schedule
 		Activity(Activity const &Other);
 		~Activity();
 
-		std::string	GetName() const;
-		void		SetName(std::string const &Name);
+		std::string const	&GetName() const;
+		void				SetName(std::string const &Name);
 
 		enum class StartMode { FREE,
 							   FIXED_ABSOLUTE,
@@ -85,9 +86,13 @@ namespace Schedule
 		void ClearBeginning();
 
 		Schedule *Owner;
+		// The run of the owner's activities this one is kept in, for snapshots
+		ScheduleBlock *Block;
 
 	private:
 		void UpdateSchedule();
+		void UpdateLayout() const;
+		Offset GetBase() const;
 
 		std::string	Name;
 
@@ -98,6 +103,7 @@ namespace Schedule
 		Offset		DesiredStartTime;
 		Offset		DesiredEndTime;
 
+		// Actual times are kept relative to the owner's base, so that its whole layout can be moved at once
 		Duration	ActualLength;
 		Offset		ActualStartTime;
 		Offset		ActualEndTime;
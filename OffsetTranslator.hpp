@@ -0,0 +1,92 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_OFFSETTRANSLATOR
+#define SCHEDULE_OFFSETTRANSLATOR
+
+#include <cstdlib>
+#include <list>
+#include <sstream>
+#include <string>
+
+#include <boost/optional.hpp>
+
+#include "Offset.hpp"
+
+namespace Schedule
+{
+	// Converts offsets to and from the HH:MM:SS text of schedule files, for boost::property_tree
+	class OffsetTranslator
+	{
+	public:
+		typedef std::string	internal_type;
+		typedef Offset		external_type;
+
+		boost::optional<external_type> get_value(internal_type const &v)
+		{
+			std::istringstream Stream(v);
+			std::list<long> Values;
+			std::string Item;
+
+			int Size;
+			for (Size = 0; Size < 3 && std::getline(Stream, Item, ':'); Size++)
+			{
+				long Value;
+				std::istringstream(Item) >> Value;
+				Values.push_back(Value);
+			}
+
+			// Pad the beginning so that there is a value for each denomination
+			for (int a = Size; a < 3; a++)
+				Values.push_front(0);
+
+			std::list<long>::const_iterator Position = Values.begin();
+
+			long const Hours	= *Position++;
+			long const Minutes	= *Position++;
+			long const Seconds	= *Position;
+
+			return Offset(Hours, Minutes, Seconds);
+		}
+
+		boost::optional<internal_type> put_value(external_type const &v)
+		{
+			std::ostringstream Stream;
+
+			if (long const Value = v.GetHours())
+			{
+				Stream << (std::abs(Value) < 10 ? "0" : "") << Value << ":";
+			}
+
+			if (long const Value = v.GetMinutes())
+				Stream << (std::abs(Value) < 10 ? "0" : "") << Value << ":";
+			else
+				Stream << "00:";
+
+			if (long const Value = v.GetSeconds())
+				Stream << (std::abs(Value) < 10 ? "0" : "") << Value;
+			else
+				Stream << "00";
+
+			return Stream.str();
+		}
+	};
+}
+
+#endif
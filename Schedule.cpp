@@ -18,16 +18,145 @@
 */
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <set>
+#include <thread>
+#include <vector>
 
 #include "Schedule.hpp"
+#include "ScheduleSnapshot.hpp"
+#include "ScheduleTrace.hpp"
+#include "ThreadPool.hpp"
 
 using namespace Schedule;
 
+namespace
+{
+	// Maps between clock time and working time, which is clock time with the pauses taken out
+	class PauseTimeline
+	{
+	public:
+		PauseTimeline(PauseList const &Pauses)
+		{
+			Duration Paused;
+
+			for (auto &Pause : Pauses)
+			{
+				Gap const NewGap = { Pause.first, Pause.first - Paused, Pause.second, Paused + Pause.second };
+				this->Gaps.push_back(NewGap);
+
+				Paused += Pause.second;
+			}
+		}
+
+		// Times inside a pause map to the moment it started
+		Offset ToWork(Offset const &Time) const
+		{
+			std::vector<Gap>::const_iterator const Next = std::upper_bound(this->Gaps.begin(), this->Gaps.end(), Time,
+				[](Offset const &Time, Gap const &Gap) { return Time < Gap.Start; });
+
+			if (Next == this->Gaps.begin())
+				return Time;
+
+			Gap const &Previous = *(Next - 1);
+
+			if (Time < Previous.Start + Previous.Length)
+				return Previous.WorkStart;
+
+			return Time - Previous.PausedThrough;
+		}
+
+		// Something starting where a pause was taken starts after the pause.  Something ending there ends before it.
+		Offset ToClock(Offset const &Time, bool End) const
+		{
+			std::vector<Gap>::const_iterator const Next = (End ?
+				std::lower_bound(this->Gaps.begin(), this->Gaps.end(), Time,
+					[](Gap const &Gap, Offset const &Time) { return Gap.WorkStart < Time; }) :
+				std::upper_bound(this->Gaps.begin(), this->Gaps.end(), Time,
+					[](Offset const &Time, Gap const &Gap) { return Time < Gap.WorkStart; }));
+
+			if (Next == this->Gaps.begin())
+				return Time;
+
+			return Time + (Next - 1)->PausedThrough;
+		}
+
+	private:
+		struct Gap
+		{
+			Offset		Start;
+			Offset		WorkStart;
+			Duration	Length;
+			Duration	PausedThrough;	// The total length of this pause and those before it
+		};
+
+		std::vector<Gap> Gaps;
+	};
+
+
+	// Calls Function(Begin, End) over consecutive chunks of [0, Count) on Threads threads: this one, and the rest from
+	// the shared pool.  Idle threads take the next unclaimed chunk, so uneven chunks don't leave cores waiting.
+	template <typename FunctionType>
+	void ParallelFor(std::size_t Count, unsigned int Threads, FunctionType const &Function)
+	{
+		if (Threads <= 1 || Count <= 1)
+		{
+			Function(0, Count);
+			return;
+		}
+
+		// Several chunks per thread to even out the load
+		std::size_t const ChunkSize = std::max<std::size_t>(Count / (Threads * 8), 1);
+		std::atomic<std::size_t> NextChunk(0);
+
+		ThreadPool::GetShared().Run(Threads - 1, [&]()
+		{
+			std::size_t Begin;
+			while ((Begin = NextChunk.fetch_add(ChunkSize)) < Count)
+				Function(Begin, std::min(Begin + ChunkSize, Count));
+		});
+	}
+}
+
+// A run of a schedule's activities, in order, and copies of them as they were when last snapshotted.  Snapshots share
+// the copies, and changing an activity drops them, so only runs that changed are copied again.  Runs are kept between
+// one and ScheduleSnapshot::MaximumChunkSize activities long.
+struct Schedule::ScheduleBlock
+{
+	ScheduleBlock() :
+		Previous(nullptr),
+		Next(nullptr)
+	{
+
+	}
+
+	std::vector<Activity *>										Activities;
+	std::shared_ptr<std::vector<std::shared_ptr<Activity const>> const>	Copies;		// Null if any have changed
+
+	ScheduleBlock	*Previous;
+	ScheduleBlock	*Next;
+};
+
+
 struct Schedule::Schedule::Implementation
 {
-	Implementation(Duration const &Length)
+	Implementation(Duration const &Length) :
+		LayoutPending(false),
+		LayoutThreads(0),
+		ParallelLayoutThreshold(DefaultParallelLayoutThreshold),
+		Paused(false),
+		Shiftable(false),
+		FirstBlock(nullptr),
+		LastBlock(nullptr),
+		Version(0),
+		ReadInstance(0),
+		VersionIndex(0),
+		NextObserver(1)
 	{
+		this->Readers[0] = 0;
+		this->Readers[1] = 0;
+
 		Activity *EndActivity = new Activity;
 		EndActivity->SetName("End");
 		EndActivity->SetDesiredStartTime(Length);
@@ -43,12 +172,79 @@ struct Schedule::Schedule::Implementation
 	{
 		for (ActivityList::const_iterator Activity = this->Activities.begin(); Activity != this->Activities.end(); ++Activity)
 			delete *Activity;
+
+		while (this->FirstBlock != nullptr)
+		{
+			ScheduleBlock * const Next = this->FirstBlock->Next;
+			delete this->FirstBlock;
+			this->FirstBlock = Next;
+		}
 	}
 
 	ActivityList			Activities;
 	ActivityList::iterator	EndActivity;
 
+	bool					LayoutPending;
+	unsigned int			LayoutThreads;
+	size_type				ParallelLayoutThreshold;
+
+	PauseList				Pauses;
+	bool					Paused;
+	Offset					ActivePause;
+
+	// Actual times are kept relative to Base.  Shiftable is set when the last layout would only move as a whole were
+	// the first activity to start somewhere else, and LaidStart is where it started.
+	Offset					Base;
+	bool					Shiftable;
+	Offset					LaidStart;
+
+	// Every activity but the End activity, in runs.  The runs' copies hold whole actual times, as they were with
+	// CopiedBase as the base.
+	ScheduleBlock	   *FirstBlock;
+	ScheduleBlock	   *LastBlock;
+	Offset				CopiedBase;
+
+	// The snapshot of the current state, if one has been taken since the last change
+	std::unique_ptr<ScheduleSnapshot>	Snapshot;
+
+	// Counts changes to the schedule
+	unsigned long							Version;
+
+	// The work done on this schedule.  It is also added to the process's counts as it is done.
+	ScheduleStats							Stats;
+
+	// The published layout is kept Left-Right: readers copy the instance ReadInstance names, announcing themselves on
+	// the read indicator VersionIndex names.  The writer only replaces the instance readers aren't sent to, then
+	// sends them to it, and waits for readers that might still be on the other one before replacing it too.  Reading
+	// is a fixed number of atomic steps, so readers never wait, however often layouts are published.
+	std::shared_ptr<PublishedLayout const>	Published[2];
+	std::atomic<unsigned int>				ReadInstance;
+	std::atomic<unsigned int>				VersionIndex;
+	std::atomic<unsigned long>				Readers[2];
+
+	// While the schedule is observed, where each activity, by index, was last laid out
+	struct LaidOutActivity
+	{
+		Activity const	*Laid;
+		Offset			StartTime;
+		Duration		Length;
+		Offset			EndTime;
+	};
+
+	std::vector<std::pair<ObserverHandle, Observer>>	Observers;
+	ObserverHandle										NextObserver;
+	std::vector<LaidOutActivity>						LaidOut;
+
 	void SetLength(Duration const &Length);
+	void Notify(Schedule const &Changed, std::vector<ActivityRange> const &Ranges) const;
+
+	// Keep the runs in step with the list.  Added goes before Before, or last if Before isn't in a run.
+	void Link(Activity *Added, Activity const *Before);
+	void Unlink(Activity *Removed);
+	ScheduleBlock *AddBlock(ScheduleBlock *After);
+	void RemoveBlock(ScheduleBlock *Removed);
+	// Drops the copies of Changed's run
+	static void Touch(Activity const &Changed);
 
 	void AddActivity(Activity *Add);
 	void InsertActivity(Activity *Insert, Activity &Before);
@@ -63,6 +259,40 @@ Schedule::Schedule::Schedule(Duration const &Length) :
 }
 
 
+Schedule::Schedule::Schedule(ScheduleSnapshot const &Snapshot) :
+	Data(new Implementation(Snapshot.GetLength()))
+{
+	// Appended directly; the activities are known to be distinct.  Each chunk becomes a run sharing the chunk as its
+	// copies, until the layout finds an activity somewhere other than the copy has it.
+	for (auto &Chunk : Snapshot.Data->Chunks)
+	{
+		ScheduleBlock * const Block = this->Data->AddBlock(this->Data->LastBlock);
+		Block->Activities.reserve(Chunk->size());
+		Block->Copies = Chunk;
+
+		for (auto &SnapshotActivity : *Chunk)
+		{
+			Activity * const NewActivity = new Activity(*SnapshotActivity);
+			NewActivity->Owner = this;
+			NewActivity->Block = Block;
+
+			Block->Activities.push_back(NewActivity);
+			this->Data->Activities.insert(this->Data->EndActivity, NewActivity);
+		}
+	}
+
+	this->Data->Pauses = Snapshot.GetPauses();
+
+	if (Offset const *ActivePause = Snapshot.GetActivePause())
+	{
+		this->Data->Paused = true;
+		this->Data->ActivePause = *ActivePause;
+	}
+
+	this->Update();
+}
+
+
 Schedule::Schedule::Schedule(Schedule &&Other) :
 	Data(Other.Data)
 {
@@ -80,6 +310,29 @@ Schedule::Schedule::~Schedule()
 }
 
 
+Schedule::Schedule &Schedule::Schedule::operator=(Schedule &&Other)
+{
+	if (this != &Other)
+	{
+		std::swap(this->Data, Other.Data);
+
+		if (this->Data != nullptr)
+		{
+			for (auto Activity : this->Data->Activities)
+				Activity->Owner = this;
+		}
+
+		if (Other.Data != nullptr)
+		{
+			for (auto Activity : Other.Data->Activities)
+				Activity->Owner = &Other;
+		}
+	}
+
+	return *this;
+}
+
+
 Duration Schedule::Schedule::GetLength() const { return (*this->Data->EndActivity)->GetDesiredStartTime(); }
 
 
@@ -188,29 +441,37 @@ bool Schedule::Schedule::empty() const
 
 void Schedule::Schedule::push_back(value_type const &val)
 {
-	if (val->Owner != nullptr && val->Owner != this)
+	// Only an activity this schedule already owns can already be in it, so others needn't be searched for
+	bool const Owned = (val->Owner == this);
+
+	if (val->Owner != nullptr && !Owned)
 		val->Owner->remove(val);
 
 	val->Owner = this;
 
-	if (std::find(this->Data->Activities.begin(), this->Data->Activities.end(), val) != this->Data->Activities.end())
+	if (Owned && std::find(this->Data->Activities.begin(), this->Data->Activities.end(), val) != this->Data->Activities.end())
 		std::cerr << "push_back: Activity already exists in schedule." << std::endl;
 
 	this->Data->Activities.insert(this->end(), val);
+	this->Data->Link(val, nullptr);
 	this->Update();
 }
 
 
 Schedule::Schedule::iterator Schedule::Schedule::insert(iterator position, value_type const &val)
 {
-	if (val->Owner != nullptr && val->Owner != this)
+	// Only an activity this schedule already owns can already be in it, so others needn't be searched for
+	bool const Owned = (val->Owner == this);
+
+	if (val->Owner != nullptr && !Owned)
 		val->Owner->remove(val);
 
 	val->Owner = this;
 
-	if (std::find(this->Data->Activities.begin(), this->Data->Activities.end(), val) != this->Data->Activities.end())
+	if (Owned && std::find(this->Data->Activities.begin(), this->Data->Activities.end(), val) != this->Data->Activities.end())
 		std::cerr << "insert: Activity already exists in schedule." << std::endl;
 
+	this->Data->Link(val, *position);
 	iterator Result = this->Data->Activities.insert(position, val);
 
 	this->Update();
@@ -224,7 +485,12 @@ Schedule::Schedule::iterator Schedule::Schedule::erase(iterator position)
 	if (position == this->end())
 		return this->end();
 
+	// The activity keeps its actual times whole once it leaves
+	(*position)->ActualStartTime += this->Data->Base;
+	(*position)->ActualEndTime += this->Data->Base;
 	(*position)->Owner = nullptr;
+	this->Data->Unlink(*position);
+
 	iterator Result = this->Data->Activities.erase(position);
 
 	this->Update();
@@ -248,6 +514,9 @@ void Schedule::Schedule::remove(value_type const &val)
 {
 	this->Data->Activities.remove(val);
 
+	if (val->Owner == this)
+		this->Data->Unlink(val);
+
 	this->Update();
 }
 
@@ -258,7 +527,7 @@ void Schedule::Schedule::BeginActivity(Activity &Activity, Offset const &Beginni
 		std::cerr << "Attempting to begin an activity that doesn't belong to this schedule." << std::endl;
 
 	Activity.SetBeginning(Beginning);
-	this->Update();
+	this->UpdateStart(Activity);
 }
 
 
@@ -268,33 +537,513 @@ void Schedule::Schedule::ClearBeginning(Activity &Activity)
 		std::cerr << "Attempting to begin an activity that doesn't belong to this schedule." << std::endl;
 
 	Activity.ClearBeginning();
+	this->UpdateStart(Activity);
+}
+
+
+PauseList const &Schedule::Schedule::GetPauses() const { return this->Data->Pauses; }
+
+
+Offset const *Schedule::Schedule::GetActivePause() const
+{
+	return (this->Data->Paused ? &this->Data->ActivePause : nullptr);
+}
+
+
+bool Schedule::Schedule::Pause(Offset const &Start)
+{
+	if (this->Data->Paused)
+		return false;
+
+	// Can't start inside another pause
+	PauseList::const_iterator const Next = this->Data->Pauses.upper_bound(Start);
+
+	if (Next != this->Data->Pauses.begin())
+	{
+		PauseList::const_iterator const Previous = std::prev(Next);
+
+		if (Start < Previous->first + Previous->second)
+			return false;
+	}
+
+	this->Data->Paused = true;
+	this->Data->ActivePause = Start;
+
+	this->Update();
+
+	return true;
+}
+
+
+bool Schedule::Schedule::Resume(Offset const &End)
+{
+	if (!this->Data->Paused || End < this->Data->ActivePause)
+		return false;
+
+	if (!this->AddPause(this->Data->ActivePause, End - this->Data->ActivePause))
+		return false;
+
+	this->Data->Paused = false;
+
+	return true;
+}
+
+
+bool Schedule::Schedule::AddPause(Offset const &Start, Duration const &Length)
+{
+	if (Length.IsNegative())
+		return false;
+
+	PauseList &Pauses = this->Data->Pauses;
+
+	// Pauses can't overlap
+	PauseList::iterator const Next = Pauses.lower_bound(Start);
+
+	if (Next != Pauses.end() && Next->first < Start + Length)
+		return false;
+
+	if (Next != Pauses.begin())
+	{
+		PauseList::iterator const Previous = std::prev(Next);
+
+		if (Start < Previous->first + Previous->second)
+			return false;
+	}
+
+	if (Next != Pauses.end() && Next->first == Start)
+		return false;
+
+	Pauses.insert(Next, std::make_pair(Start, Length));
+
+	this->Update();
+
+	return true;
+}
+
+
+bool Schedule::Schedule::CancelPause()
+{
+	if (!this->Data->Paused)
+		return false;
+
+	this->Data->Paused = false;
+
 	this->Update();
+
+	return true;
+}
+
+
+bool Schedule::Schedule::RemovePause(Offset const &Start)
+{
+	if (this->Data->Pauses.erase(Start) == 0)
+		return false;
+
+	this->Update();
+
+	return true;
+}
+
+
+void Schedule::Schedule::ClearPauses()
+{
+	this->Data->Pauses.clear();
+	this->Data->Paused = false;
+
+	this->Update();
+}
+
+
+unsigned int	Schedule::Schedule::GetLayoutThreads() const				{ return this->Data->LayoutThreads; }
+void			Schedule::Schedule::SetLayoutThreads(unsigned int Threads)	{ this->Data->LayoutThreads = Threads; }
+
+Schedule::Schedule::size_type	Schedule::Schedule::GetParallelLayoutThreshold() const				{ return this->Data->ParallelLayoutThreshold; }
+void							Schedule::Schedule::SetParallelLayoutThreshold(size_type Threshold)	{ this->Data->ParallelLayoutThreshold = Threshold; }
+
+
+Schedule::ScheduleSnapshot Schedule::Schedule::GetSnapshot()
+{
+	Implementation &Data = *this->Data;
+
+	if (!Data.Snapshot)
+	{
+		// Snapshots carry actual times, so they must be current
+		this->UpdateLayout();
+
+		// The copies' times are whole, so moving the base moves every one of them
+		if (Data.CopiedBase != Data.Base)
+		{
+			for (ScheduleBlock *Block = Data.FirstBlock; Block != nullptr; Block = Block->Next)
+				Block->Copies.reset();
+
+			Data.CopiedBase = Data.Base;
+		}
+
+		std::shared_ptr<ScheduleSnapshot::State> State = std::make_shared<ScheduleSnapshot::State>();
+
+		State->Length = this->GetLength();
+		State->Pauses = Data.Pauses;
+		State->Paused = Data.Paused;
+		State->ActivePause = Data.ActivePause;
+		State->Size = this->size();
+
+		for (ScheduleBlock *Block = Data.FirstBlock; Block != nullptr; Block = Block->Next)
+		{
+			if (!Block->Copies)
+			{
+				std::shared_ptr<ScheduleSnapshot::Chunk> Copies = std::make_shared<ScheduleSnapshot::Chunk>();
+				Copies->reserve(Block->Activities.size());
+
+				for (auto Copied : Block->Activities)
+					Copies->push_back(std::make_shared<Activity const>(*Copied));
+
+				Block->Copies = Copies;
+			}
+
+			State->Chunks.push_back(Block->Copies);
+		}
+
+		Data.Snapshot.reset(new ScheduleSnapshot(State));
+	}
+
+	return *Data.Snapshot;
+}
+
+
+void Schedule::Schedule::PublishLayout()
+{
+	Implementation &Data = *this->Data;
+	unsigned int const Reading = Data.ReadInstance;
+
+	// Only this thread replaces instances, so it can look at them without announcing itself
+	if (Data.Published[Reading] && Data.Published[Reading]->Version == Data.Version)
+		return;
+
+	// The snapshot shares its chunks with the schedule, so publishing copies only what changed since the last
+	PublishedLayout const Layout = { Data.Version, this->GetSnapshot() };
+	std::shared_ptr<PublishedLayout const> const Latest = std::make_shared<PublishedLayout const>(Layout);
+
+	// No reader is on the other instance since the last publish waited for them to leave
+	Data.Published[1 - Reading] = Latest;
+	Data.ReadInstance = 1 - Reading;
+
+	// Readers that saw the old instance might still be copying it.  The indicator is switched only once readers that
+	// announced themselves on the other one, during the last publish, have left, and then readers on the old
+	// indicator are waited for.
+	unsigned int const Announced = Data.VersionIndex;
+
+	while (Data.Readers[1 - Announced] != 0)
+		std::this_thread::yield();
+
+	Data.VersionIndex = 1 - Announced;
+
+	while (Data.Readers[Announced] != 0)
+		std::this_thread::yield();
+
+	Data.Published[Reading] = Latest;
+}
+
+
+std::shared_ptr<Schedule::PublishedLayout const> Schedule::Schedule::GetPublishedLayout() const
+{
+	Implementation &Data = *this->Data;
+	unsigned int const Announced = Data.VersionIndex;
+
+	Data.Readers[Announced]++;
+	std::shared_ptr<PublishedLayout const> const Latest = Data.Published[Data.ReadInstance];
+	Data.Readers[Announced]--;
+
+	return Latest;
 }
 
 
+Schedule::Schedule::ObserverHandle Schedule::Schedule::AddObserver(Observer const &Notify)
+{
+	// Start keeping track of the layout, so that the next one can be compared with it
+	if (this->Data->Observers.empty())
+	{
+		this->UpdateLayout();
+
+		this->Data->LaidOut.clear();
+		this->Data->LaidOut.reserve(this->Data->Activities.size());
+
+		for (auto Current : this->Data->Activities)
+		{
+			Implementation::LaidOutActivity const Laid = { Current, Current->ActualStartTime, Current->ActualLength,
+														   Current->ActualEndTime };
+			this->Data->LaidOut.push_back(Laid);
+		}
+	}
+
+	ObserverHandle const Handle = this->Data->NextObserver++;
+	this->Data->Observers.emplace_back(Handle, Notify);
+
+	return Handle;
+}
+
+
+void Schedule::Schedule::RemoveObserver(ObserverHandle Handle)
+{
+	auto &Observers = this->Data->Observers;
+
+	Observers.erase(std::remove_if(Observers.begin(), Observers.end(),
+		[Handle](std::pair<ObserverHandle, Observer> const &Current) { return Current.first == Handle; }), Observers.end());
+
+	if (Observers.empty())
+		std::vector<Implementation::LaidOutActivity>().swap(this->Data->LaidOut);
+}
+
+
+Schedule::ScheduleMemory Schedule::Schedule::GetMemoryUsage() const
+{
+	ScheduleMemory Usage;
+
+	Usage.State = sizeof(Implementation);
+	Usage.Allocations = 1;
+
+	for (auto Current : this->Data->Activities)
+	{
+		Usage.Activities += sizeof(Activity);
+		Usage.Nodes += ScheduleMemory::GetListNodeSize<Activity *>();
+		Usage.Allocations += 2;
+
+		Usage.AddString(Usage.Names, Current->GetName());
+
+		if (Current->GetBeginning() != nullptr)
+		{
+			Usage.Beginnings += sizeof(Offset);
+			Usage.Allocations++;
+		}
+	}
+
+	Usage.Nodes += this->Data->Pauses.size() * ScheduleMemory::GetMapNodeSize<PauseList::value_type>();
+	Usage.Allocations += this->Data->Pauses.size();
+
+	// The cached snapshot and the published layout are often the same one, and otherwise share chunks with each other
+	// and with the runs' copies.  Snapshots taken of a schedule only share activities by sharing the chunks holding
+	// them.
+	std::set<void const *> Seen;
+
+	auto const AddChunk = [&](ScheduleSnapshot::Chunk const &Chunk)
+	{
+		if (!Seen.insert(&Chunk).second)
+			return;
+
+		Usage.Caches += sizeof(Chunk) + ScheduleMemory::SharedOverhead + Chunk.capacity() * sizeof(Chunk[0]);
+		Usage.Allocations += 2;
+
+		for (auto &Current : Chunk)
+		{
+			Usage.Caches += sizeof(Activity) + ScheduleMemory::SharedOverhead;
+			Usage.Allocations++;
+
+			Usage.AddString(Usage.Caches, Current->GetName());
+
+			if (Current->GetBeginning() != nullptr)
+			{
+				Usage.Caches += sizeof(Offset);
+				Usage.Allocations++;
+			}
+		}
+	};
+
+	auto const AddSnapshot = [&](ScheduleSnapshot const &Snapshot)
+	{
+		ScheduleSnapshot::State const &State = *Snapshot.Data;
+
+		if (!Seen.insert(&State).second)
+			return;
+
+		Usage.Caches += sizeof(State) + ScheduleMemory::SharedOverhead +
+						State.Pauses.size() * ScheduleMemory::GetMapNodeSize<PauseList::value_type>() +
+						State.Chunks.capacity() * sizeof(State.Chunks[0]);
+		Usage.Allocations += 1 + State.Pauses.size() + (State.Chunks.capacity() != 0 ? 1 : 0);
+
+		for (auto &Chunk : State.Chunks)
+			AddChunk(*Chunk);
+	};
+
+	for (ScheduleBlock *Block = this->Data->FirstBlock; Block != nullptr; Block = Block->Next)
+	{
+		Usage.Caches += sizeof(ScheduleBlock) + Block->Activities.capacity() * sizeof(Activity *);
+		Usage.Allocations += 2;
+
+		if (Block->Copies)
+			AddChunk(*Block->Copies);
+	}
+
+	if (this->Data->Snapshot)
+	{
+		Usage.Caches += sizeof(ScheduleSnapshot);
+		Usage.Allocations++;
+
+		AddSnapshot(*this->Data->Snapshot);
+	}
+
+	Usage.Caches += this->Data->LaidOut.capacity() * sizeof(Implementation::LaidOutActivity);
+	Usage.Allocations += (this->Data->LaidOut.capacity() != 0 ? 1 : 0);
+
+	if (std::shared_ptr<PublishedLayout const> const Published = this->GetPublishedLayout())
+	{
+		Usage.Caches += sizeof(PublishedLayout) + ScheduleMemory::SharedOverhead;
+		Usage.Allocations++;
+
+		AddSnapshot(Published->Snapshot);
+	}
+
+	return Usage;
+}
+
+
+ScheduleStats const &Schedule::Schedule::GetScheduleStats() const
+{
+	return this->Data->Stats;
+}
+
+
+ScheduleStats Schedule::Schedule::GetStats()
+{
+	return Stats::Process.Load();
+}
+
+
+void Schedule::Schedule::ResetStats()
+{
+	Stats::Process.Reset();
+}
+
+
+
 void Schedule::Schedule::Update()
 {
+	SCHEDULE_COUNT_IN(this->Data->Stats, UPDATES, 1);
+	SCHEDULE_COUNT(UPDATES, 1);
+
+	this->Data->Snapshot.reset();
+	this->Data->Version++;
+
 	// There must be at least one other activity besides the End activity
 	if (this->Data->Activities.size() == 1)
-		return;
+	{
+		if (this->Data->LaidOut.size() > 1)
+		{
+			this->Data->LaidOut.clear();
+			this->Data->Notify(*this, std::vector<ActivityRange>());
+		}
 
-	// Convenience
-	ActivityList const &Activities = this->Data->Activities;
+		return;
+	}
 
 	// The first activity must be fixed-absolute
-	Activities.front()->ActivityStartMode = Activity::StartMode::FIXED_ABSOLUTE;
+	Activity &First = *this->Data->Activities.front();
+
+	if (First.ActivityStartMode != Activity::StartMode::FIXED_ABSOLUTE)
+	{
+		First.ActivityStartMode = Activity::StartMode::FIXED_ABSOLUTE;
+		Implementation::Touch(First);
+	}
+
+	this->Data->LayoutPending = true;
+}
+
+
+void Schedule::Schedule::Update(Activity const &Changed)
+{
+	Implementation::Touch(Changed);
+	this->Update();
+}
+
+
+void Schedule::Schedule::UpdateStart(Activity const &Moved)
+{
+	Implementation &Data = *this->Data;
+
+	Implementation::Touch(Moved);
+
+	if (Data.LayoutPending || !Data.Shiftable || this->empty() || &Moved != Data.Activities.front())
+	{
+		this->Update();
+		return;
+	}
+
+	SCHEDULE_COUNT_IN(Data.Stats, UPDATES, 1);
+	SCHEDULE_COUNT_IN(Data.Stats, SHIFTS, 1);
+	SCHEDULE_COUNT(UPDATES, 1);
+	SCHEDULE_COUNT(SHIFTS, 1);
+
+	Data.Snapshot.reset();
+	Data.Version++;
+
+	Offset const Start = (Moved.GetBeginning() != nullptr ? *Moved.GetBeginning() : Moved.GetDesiredStartTime());
+	Duration const Shift = Start - Data.LaidStart;
+
+	if (Shift.IsZero())
+		return;
+
+	Data.Base += Shift;
+	Data.LaidStart = Start;
+
+	// Everything moved, though the times kept for comparing the next layout with, being relative, still hold
+	if (!Data.Observers.empty())
+	{
+		ActivityRange const Everything = { 0, this->size() };
+		Data.Notify(*this, std::vector<ActivityRange>(1, Everything));
+	}
+}
+
 
+Offset Schedule::Schedule::GetBase() const
+{
+	return this->Data->Base;
+}
+
+
+void Schedule::Schedule::UpdateLayout()
+{
+	if (!this->Data->LayoutPending)
+		return;
+
+	this->Data->LayoutPending = false;
+
+	// Layouts are counted as they go, and added to the shared counts once, so the threads laying out different
+	// schedules don't contend on them
+	ScheduleStats Counted;
+	this->Layout(Counted);
+
+	if (ScheduleStats::Enabled)
+	{
+		this->Data->Stats += Counted;
+		Stats::Process.Add(Counted);
+	}
+}
+
+
+void Schedule::Schedule::Layout(ScheduleStats &Counted)
+{
+	SCHEDULE_COUNT_IN(Counted, LAYOUTS, 1);
+	ScheduleTrace::Span const Traced("Layout", "layout", SCHEDULE_TALLY_IN(Counted, LAYOUT_NANOSECONDS), "activities",
+									 this->Data->Activities.size());
+
+	// Convenience
+	ActivityList const &Activities = this->Data->Activities;
 
 	// Constants
 	Duration const ScheduleLength = (*this->Data->EndActivity)->GetDesiredStartTime();
 
-	Offset const StartTime = (Activities.front()->GetBeginning() != nullptr ? *Activities.front()->GetBeginning() :
-																			   Activities.front()->GetDesiredStartTime());
-	Offset const EndTime = StartTime + ScheduleLength;
+	Offset const ClockStartTime = (Activities.front()->GetBeginning() != nullptr ? *Activities.front()->GetBeginning() :
+																					Activities.front()->GetDesiredStartTime());
+
+	// Lay out in working time, then map back onto the clock around the pauses
+	PauseTimeline const Timeline(this->Data->Pauses);
+
+	Offset const StartTime = Timeline.ToWork(ClockStartTime);
+	Offset const EndTime = Timeline.ToWork(ClockStartTime + ScheduleLength);
 
 
 	// Set fixed attributes to actual (start times, beginnings, lengths)
 	{
+		ScheduleTrace::Span const FixedPass("Fixed pass", "layout");
+
 		// Activities that contain some fixed attribute
 		std::vector<Activity *> FixedActivities;
 
@@ -316,16 +1065,20 @@ void Schedule::Schedule::Update()
 		for (auto CurrentActivity : Activities)
 		{
 			// This activity has a beginning
-			if (Offset const * const Beginning = CurrentActivity->GetBeginning())
+			if (CurrentActivity->GetBeginning() != nullptr)
 			{
+				Offset const Beginning = Timeline.ToWork(*CurrentActivity->GetBeginning());
+
 				// If this activity begins before a previous one allows,
-				if (*Beginning < CurrentTime && PreviousBeginning != FixedActivities.end())
+				if (Beginning < CurrentTime && PreviousBeginning != FixedActivities.end())
 				{
-					Offset AdjustTime = (*PreviousBeginning)->GetActualStartTime();
+					SCHEDULE_COUNT_IN(Counted, BEGINNING_CONFLICTS, 1);
+
+					Offset AdjustTime = (*PreviousBeginning)->ActualStartTime;
 
 					// If the previous beginning is not the issue, chop off the offending time from the activities between
 					// this beginning and the previous
-					if (*Beginning >= AdjustTime)
+					if (Beginning >= AdjustTime)
 					{
 						for (std::vector<Activity *>::const_iterator AdjustActivityIterator = PreviousBeginning;
 																	 AdjustActivityIterator != FixedActivityIterator;
@@ -335,11 +1088,11 @@ void Schedule::Schedule::Update()
 
 							if (AdjustActivity->GetStartMode() != Activity::StartMode::FREE)
 							{
-								AdjustTime = AdjustActivity->GetActualStartTime();
+								AdjustTime = AdjustActivity->ActualStartTime;
 
-								if (*Beginning < AdjustTime)
+								if (Beginning < AdjustTime)
 								{
-									AdjustTime = *Beginning;
+									AdjustTime = Beginning;
 									AdjustActivity->SetActualStartTime(AdjustTime);
 								}
 							}
@@ -349,20 +1102,23 @@ void Schedule::Schedule::Update()
 								Offset const OldAdjustTime = AdjustTime;
 								AdjustTime += AdjustActivity->GetActualLength();
 
-								if (*Beginning < AdjustTime)
+								if (Beginning < AdjustTime)
 								{
-									AdjustTime = *Beginning;
+									AdjustTime = Beginning;
 									AdjustActivity->SetActualLength(AdjustTime - OldAdjustTime);
 								}
 							}
 						}
 
-						if (*Beginning > EndTime)
+						if (Beginning > EndTime)
+						{
+							SCHEDULE_COUNT_IN(Counted, END_TIME_CLAMPS, 1);
 							CurrentActivity->SetActualStartTime(EndTime);
+						}
 						else
-							CurrentActivity->SetActualStartTime(*Beginning);
+							CurrentActivity->SetActualStartTime(Beginning);
 
-						CurrentTime = CurrentActivity->GetActualStartTime();
+						CurrentTime = CurrentActivity->ActualStartTime;
 					}
 					// Otherwise, this beginning wants to be before the previous beginning.  The previous beginning wins.
 					else
@@ -374,12 +1130,15 @@ void Schedule::Schedule::Update()
 				// No conflict.  Set the beginning where desired.
 				else
 				{
-					if (*Beginning > EndTime)
+					if (Beginning > EndTime)
+					{
+						SCHEDULE_COUNT_IN(Counted, END_TIME_CLAMPS, 1);
 						CurrentActivity->SetActualStartTime(EndTime);
+					}
 					else
-						CurrentActivity->SetActualStartTime(*Beginning);
+						CurrentActivity->SetActualStartTime(Beginning);
 
-					CurrentTime = CurrentActivity->GetActualStartTime();
+					CurrentTime = CurrentActivity->ActualStartTime;
 				}
 
 				PreviousBeginning = FixedActivityIterator;
@@ -388,9 +1147,9 @@ void Schedule::Schedule::Update()
 			// This activity has a fixed start, but is not yet begun
 			else if (CurrentActivity->GetStartMode() != Activity::StartMode::FREE)
 			{
-				Offset const DesiredStartTime = (CurrentActivity->GetStartMode() == Activity::StartMode::FIXED_ABSOLUTE ?
-																					CurrentActivity->GetDesiredStartTime() :
-																					CurrentActivity->GetDesiredStartTime() + StartTime);
+				Offset const DesiredStartTime = Timeline.ToWork(CurrentActivity->GetStartMode() == Activity::StartMode::FIXED_ABSOLUTE ?
+																								 CurrentActivity->GetDesiredStartTime() :
+																								 CurrentActivity->GetDesiredStartTime() + ClockStartTime);
 
 				// Yield to previous fixed starts/lengths
 				if (DesiredStartTime < CurrentTime || !FlexibleLength)
@@ -400,11 +1159,14 @@ void Schedule::Schedule::Update()
 				else
 				{
 					if (DesiredStartTime > EndTime)
+					{
+						SCHEDULE_COUNT_IN(Counted, END_TIME_CLAMPS, 1);
 						CurrentActivity->SetActualStartTime(EndTime);
+					}
 					else
 						CurrentActivity->SetActualStartTime(DesiredStartTime);
 
-					CurrentTime = CurrentActivity->GetActualStartTime();
+					CurrentTime = CurrentActivity->ActualStartTime;
 				}
 
 				FlexibleLength = false;
@@ -419,6 +1181,8 @@ void Schedule::Schedule::Update()
 
 				if (DesiredLength > RemainingTime)
 				{
+					SCHEDULE_COUNT_IN(Counted, END_TIME_CLAMPS, 1);
+
 					CurrentActivity->SetActualLength(RemainingTime);
 					CurrentTime = EndTime;
 				}
@@ -440,69 +1204,249 @@ void Schedule::Schedule::Update()
 		}
 	}
 
+	SCHEDULE_COUNT_IN(Counted, ACTIVITIES_VISITED, Activities.size());
+
+
+	// Once the fixed attributes are set, each space between boundaries (fixed starts and beginnings) is stretched
+	// independently of the others.  Large schedules stretch their segments in parallel.
+	std::vector<Activity *> const Ordered(Activities.begin(), Activities.end());
+
+	// The layout moves as a whole with the first activity's start if every later boundary is relative to it
+	bool Shiftable = this->Data->Pauses.empty();
+
+	std::vector<std::size_t> Boundaries;
+	for (std::size_t Index = 0; Index < Ordered.size(); Index++)
+	{
+		if (Ordered[Index]->GetStartMode() != Activity::StartMode::FREE || Ordered[Index]->GetBeginning() != nullptr)
+		{
+			if (Index != 0 && (Ordered[Index]->GetStartMode() != Activity::StartMode::FIXED_RELATIVE ||
+							   Ordered[Index]->GetBeginning() != nullptr))
+			{
+				Shiftable = false;
+			}
+
+			Boundaries.push_back(Index);
+		}
+	}
+
+	SCHEDULE_COUNT_IN(Counted, ACTIVITIES_VISITED, Ordered.size());
+
+	this->Data->Shiftable = Shiftable;
+	this->Data->LaidStart = ClockStartTime;
+
+	unsigned int Threads = 1;
+	if (Ordered.size() >= this->Data->ParallelLayoutThreshold)
+	{
+		Threads = (this->Data->LayoutThreads != 0 ? this->Data->LayoutThreads : std::thread::hardware_concurrency());
+
+		if (Threads == 0)
+			Threads = 1;
+	}
+
+	std::size_t const Segments = (Boundaries.empty() ? 0 : Boundaries.size() - 1);
+
+	SCHEDULE_COUNT_IN(Counted, SEGMENTS, Segments);
+
+	// The passes run in parallel count their visits here, once per chunk
+	Stats::SharedCounts Visited;
+
+	// The total actual length of each segment once stretched
+	std::vector<Duration> SegmentLengths(Segments);
+
 
 	// Stretch the non-fixed activities to fill the spaces between the fixed activities
+	ParallelFor(Segments, Threads, [&](std::size_t FirstSegment, std::size_t LastSegment)
 	{
-		Duration ExpandedLength;	// The length of the flexible activities before scaling
-		Duration FixedLength;		// The amount of the space between fixed activities that cannot stretch
+		ScheduleTrace::Span const StretchPass("Stretch pass", "layout", "segments", LastSegment - FirstSegment);
+		std::size_t Visits = 0;
+
+		for (std::size_t Segment = FirstSegment; Segment < LastSegment; Segment++)
+		{
+			ScheduleTrace::Span const Stretched("Segment", "layout", "segment", Segment);
+
+			std::size_t const LowerBound = Boundaries[Segment];
+			std::size_t const UpperBound = Boundaries[Segment + 1];
+
+			Duration ExpandedLength;	// The length of the flexible activities before scaling
+			Duration FixedLength;		// The amount of the space between fixed activities that cannot stretch
+
+			for (std::size_t Index = LowerBound; Index < UpperBound; Index++)
+			{
+				if (Ordered[Index]->GetLengthMode() == Activity::LengthMode::FREE)
+					ExpandedLength += Ordered[Index]->GetDesiredLength();
+				else
+					FixedLength += Ordered[Index]->ActualLength;
+			}
+
+			// Calculate the scale to be applied to the activities inside the boundaries
+			Duration const FlexibleLength = Ordered[UpperBound]->ActualStartTime - Ordered[LowerBound]->ActualStartTime - FixedLength;
 
+			float const FlexibleScale = (!ExpandedLength.IsZero() ? (float)FlexibleLength.GetTotalSeconds() / (float)ExpandedLength.GetTotalSeconds() :
+																	0.0f);
+
+			// Apply the scale to the free-length activities
+			Duration SegmentLength;
+
+			for (std::size_t Index = LowerBound; Index < UpperBound; Index++)
+			{
+				Activity * const CurrentActivity = Ordered[Index];
+
+				if (CurrentActivity->GetLengthMode() == Activity::LengthMode::FREE)
+				{
+					Duration ActualLength = CurrentActivity->GetDesiredLength() * FlexibleScale;
+
+					if (ActualLength.IsNegative())
+						ActualLength = Duration();
+
+					CurrentActivity->SetActualLength(ActualLength);
+				}
+
+				SegmentLength += CurrentActivity->ActualLength;
+			}
+
+			SegmentLengths[Segment] = SegmentLength;
+
+			// Once to measure the segment, and again to stretch it
+			Visits += 2 * (UpperBound - LowerBound);
+		}
+
+		SCHEDULE_COUNT_IN(Visited, ACTIVITIES_VISITED, Visits);
+	});
+
+
+	// Free activities start where the previous one ends.  Rounding can leave a segment slightly longer or shorter than
+	// its space; the difference carries into the next segment, as it always has.
+	std::vector<Offset> SegmentStarts(Segments);
+	{
 		Offset CurrentTime = StartTime;
 
-		ActivityList::const_iterator LowerBound = Activities.end();
+		for (std::size_t Segment = 0; Segment < Segments; Segment++)
+		{
+			SegmentStarts[Segment] = CurrentTime;
+			CurrentTime += SegmentLengths[Segment];
+		}
+	}
+
+	ParallelFor(Segments, Threads, [&](std::size_t FirstSegment, std::size_t LastSegment)
+	{
+		ScheduleTrace::Span const PlacePass("Place pass", "layout", "segments", LastSegment - FirstSegment);
+		std::size_t Visits = 0;
 
-		for (ActivityList::const_iterator CurrentActivityIterator = Activities.begin();
-										  CurrentActivityIterator != Activities.end();
-										  ++CurrentActivityIterator)
+		for (std::size_t Segment = FirstSegment; Segment < LastSegment; Segment++)
 		{
-			Activity * const CurrentActivity = *CurrentActivityIterator;
+			Offset CurrentTime = SegmentStarts[Segment];
 
-			// If there's a fixed start or a beginning, we've found a boundary of some fixed space
-			if (CurrentActivity->GetStartMode() != Activity::StartMode::FREE || CurrentActivity->GetBeginning() != nullptr)
+			for (std::size_t Index = Boundaries[Segment]; Index < Boundaries[Segment + 1]; Index++)
 			{
-				// If this isn't the very first boundary,
-				if (LowerBound != Activities.end())
-				{
-					ActivityList::const_iterator const UpperBound = CurrentActivityIterator;
+				Activity * const CurrentActivity = Ordered[Index];
 
-					// Calculate the scale to be applied to the activities inside the boundaries
-					Duration const FlexibleLength = (*UpperBound)->GetActualStartTime() - (*LowerBound)->GetActualStartTime() - FixedLength;
+				if (CurrentActivity->GetStartMode() == Activity::StartMode::FREE && CurrentActivity->GetBeginning() == nullptr)
+					CurrentActivity->SetActualStartTime(CurrentTime);
 
-					float const FlexibleScale = (!ExpandedLength.IsZero() ? (float)FlexibleLength.GetTotalSeconds() / (float)ExpandedLength.GetTotalSeconds() :
-																			0.0f);
+				CurrentTime += CurrentActivity->ActualLength;
+			}
 
-					// Apply the scale to the free-length activities
-					for (auto CurrentActivity : std::vector<Activity *>(LowerBound, UpperBound))
-					{
-						if (CurrentActivity->GetStartMode() == Activity::StartMode::FREE && CurrentActivity->GetBeginning() == nullptr)
-							CurrentActivity->SetActualStartTime(CurrentTime);
+			Visits += Boundaries[Segment + 1] - Boundaries[Segment];
+		}
 
-						if (CurrentActivity->GetLengthMode() == Activity::LengthMode::FREE)
-						{
-							Duration ActualLength = CurrentActivity->GetDesiredLength() * FlexibleScale;
+		SCHEDULE_COUNT_IN(Visited, ACTIVITIES_VISITED, Visits);
+	});
 
-							if (ActualLength.IsNegative())
-								ActualLength = Duration();
 
-							CurrentActivity->SetActualLength(ActualLength);
-						}
+	// Observed schedules compare each activity with where the last layout left it
+	bool const Observed = !this->Data->Observers.empty();
+	std::vector<Implementation::LaidOutActivity> &LaidOut = this->Data->LaidOut;
+	std::size_t const LaidOutSize = LaidOut.size();
+	std::vector<char> Changed;
 
-						CurrentTime += CurrentActivity->GetActualLength();
-					}
+	if (Observed)
+	{
+		LaidOut.resize(Ordered.size());
+		Changed.resize(Ordered.size());
+	}
 
-					// Reset for the next pair of boundaries
-					ExpandedLength = Duration();
-					FixedLength = Duration();
-					LowerBound = UpperBound;
-				}
-				else
-					LowerBound = CurrentActivityIterator;
+
+	// Map the working times back onto the clock, relative to the base
+	Offset const Base = this->Data->Base;
+
+	ParallelFor(Ordered.size(), Threads, [&](std::size_t First, std::size_t Last)
+	{
+		ScheduleTrace::Span const ClockPass("Clock pass", "layout", "activities", Last - First);
+
+		for (std::size_t Index = First; Index < Last; Index++)
+		{
+			Activity * const CurrentActivity = Ordered[Index];
+			Offset const WorkStartTime = CurrentActivity->ActualStartTime;
+
+			CurrentActivity->SetActualStartTime(Timeline.ToClock(WorkStartTime, false) - Base);
+			CurrentActivity->SetActualEndTime(Timeline.ToClock(WorkStartTime + CurrentActivity->ActualLength, true) - Base);
+
+			if (Observed)
+			{
+				Implementation::LaidOutActivity &Previous = LaidOut[Index];
+
+				Changed[Index] = (Index >= LaidOutSize || Previous.Laid != CurrentActivity ||
+								  Previous.StartTime != CurrentActivity->ActualStartTime ||
+								  Previous.Length != CurrentActivity->ActualLength ||
+								  Previous.EndTime != CurrentActivity->ActualEndTime);
+
+				Previous.Laid = CurrentActivity;
+				Previous.StartTime = CurrentActivity->ActualStartTime;
+				Previous.Length = CurrentActivity->ActualLength;
+				Previous.EndTime = CurrentActivity->ActualEndTime;
+			}
+		}
+
+		SCHEDULE_COUNT_IN(Visited, ACTIVITIES_VISITED, Last - First);
+	});
+
+	Counted += Visited.Load();
+
+	// Snapshots go on sharing the copies of runs whose activities were laid out where they were
+	for (ScheduleBlock *Block = this->Data->FirstBlock; Block != nullptr; Block = Block->Next)
+	{
+		if (!Block->Copies)
+			continue;
+
+		for (std::size_t Index = 0; Index < Block->Activities.size(); Index++)
+		{
+			Activity const &Laid = *Block->Activities[Index];
+			Activity const &Copy = *(*Block->Copies)[Index];
+
+			SCHEDULE_COUNT_IN(Counted, ACTIVITIES_VISITED, 1);
+
+			if (Laid.ActualStartTime + Base != Copy.ActualStartTime || Laid.ActualLength != Copy.ActualLength ||
+				Laid.ActualEndTime + Base != Copy.ActualEndTime)
+			{
+				Block->Copies.reset();
+				break;
 			}
+		}
+	}
+
+	this->Data->CopiedBase = Base;
 
-			if (CurrentActivity->GetLengthMode() == Activity::LengthMode::FREE)
-				ExpandedLength += CurrentActivity->GetDesiredLength();
+	if (Observed)
+	{
+		// The End activity is never reported
+		std::vector<ActivityRange> Ranges;
+
+		for (std::size_t Index = 0; Index + 1 < Ordered.size(); Index++)
+		{
+			if (!Changed[Index])
+				continue;
+
+			if (!Ranges.empty() && Ranges.back().First + Ranges.back().Count == Index)
+				Ranges.back().Count++;
 			else
-				FixedLength += CurrentActivity->GetActualLength();
+			{
+				ActivityRange const Range = { Index, 1 };
+				Ranges.push_back(Range);
+			}
 		}
+
+		if (!Ranges.empty() || LaidOutSize != Ordered.size())
+			this->Data->Notify(*this, Ranges);
 	}
 }
 
@@ -513,6 +1457,118 @@ void Schedule::Schedule::Implementation::SetLength(Duration const &Length)
 }
 
 
+void Schedule::Schedule::Implementation::Notify(Schedule const &Changed, std::vector<ActivityRange> const &Ranges) const
+{
+	// Observers may remove themselves, or each other, while being told
+	std::vector<std::pair<ObserverHandle, Observer>> const Notified(this->Observers);
+
+	for (auto &Current : Notified)
+		Current.second(Changed, Ranges);
+}
+
+
+void Schedule::Schedule::Implementation::Link(Activity *Added, Activity const *Before)
+{
+	ScheduleBlock *Block;
+	std::vector<Activity *>::iterator Position;
+
+	if (Before != nullptr && Before->Block != nullptr)
+	{
+		Block = Before->Block;
+		Position = std::find(Block->Activities.begin(), Block->Activities.end(), Before);
+	}
+	else
+	{
+		// Appended runs are filled to the chunk size, as snapshots would fill them
+		if (this->LastBlock == nullptr || this->LastBlock->Activities.size() >= ScheduleSnapshot::ChunkSize)
+			this->AddBlock(this->LastBlock);
+
+		Block = this->LastBlock;
+		Position = Block->Activities.end();
+	}
+
+	Block->Activities.insert(Position, Added);
+	Block->Copies.reset();
+	Added->Block = Block;
+
+	// Split runs that grow too long in two
+	if (Block->Activities.size() > ScheduleSnapshot::MaximumChunkSize)
+	{
+		ScheduleBlock * const Second = this->AddBlock(Block);
+		std::vector<Activity *>::iterator const Middle = Block->Activities.begin() + Block->Activities.size() / 2;
+
+		Second->Activities.assign(Middle, Block->Activities.end());
+		Block->Activities.erase(Middle, Block->Activities.end());
+
+		for (auto Moved : Second->Activities)
+			Moved->Block = Second;
+	}
+}
+
+
+void Schedule::Schedule::Implementation::Unlink(Activity *Removed)
+{
+	ScheduleBlock * const Block = Removed->Block;
+
+	if (Block == nullptr)
+		return;
+
+	Block->Activities.erase(std::find(Block->Activities.begin(), Block->Activities.end(), Removed));
+	Block->Copies.reset();
+	Removed->Block = nullptr;
+
+	if (Block->Activities.empty())
+	{
+		this->RemoveBlock(Block);
+		return;
+	}
+
+	// Merge runs that shrink enough to fit together
+	ScheduleBlock * const Next = Block->Next;
+
+	if (Next != nullptr && Block->Activities.size() + Next->Activities.size() <= ScheduleSnapshot::ChunkSize)
+	{
+		for (auto Moved : Next->Activities)
+		{
+			Moved->Block = Block;
+			Block->Activities.push_back(Moved);
+		}
+
+		this->RemoveBlock(Next);
+	}
+}
+
+
+ScheduleBlock *Schedule::Schedule::Implementation::AddBlock(ScheduleBlock *After)
+{
+	ScheduleBlock * const Added = new ScheduleBlock;
+
+	Added->Previous = After;
+	Added->Next = (After != nullptr ? After->Next : this->FirstBlock);
+
+	(Added->Previous != nullptr ? Added->Previous->Next : this->FirstBlock) = Added;
+	(Added->Next != nullptr ? Added->Next->Previous : this->LastBlock) = Added;
+
+	return Added;
+}
+
+
+void Schedule::Schedule::Implementation::RemoveBlock(ScheduleBlock *Removed)
+{
+	(Removed->Previous != nullptr ? Removed->Previous->Next : this->FirstBlock) = Removed->Next;
+	(Removed->Next != nullptr ? Removed->Next->Previous : this->LastBlock) = Removed->Previous;
+
+	delete Removed;
+}
+
+
+void Schedule::Schedule::Implementation::Touch(Activity const &Changed)
+{
+	if (Changed.Block != nullptr)
+		Changed.Block->Copies.reset();
+}
+
+
 void Schedule::Schedule::Implementation::AddActivity(Activity *Add)
 {
 	ActivityList::iterator FindActivity = std::find(this->Activities.begin(), this->Activities.end(), Add);
@@ -20,19 +20,36 @@
 #ifndef SCHEDULE_SCHEDULE
 #define SCHEDULE_SCHEDULE
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
 #include "Activity.hpp"
 #include "Offset.hpp"
+#include "ScheduleMemory.hpp"
+#include "ScheduleStats.hpp"
 
 namespace Schedule
 {
+	// Pause start times mapped to their lengths
+	typedef std::map<Offset, Duration> PauseList;
+
+	class ScheduleSnapshot;
+	struct PublishedLayout;
+
 	class Schedule
 	{
 	public:
 		Schedule(Duration const &Length = Duration(6, 0, 0));
 		Schedule(Schedule &&Other);
 		Schedule(Schedule const &) = delete;
+		// Builds a schedule from copies of Snapshot's activities
+		explicit Schedule(ScheduleSnapshot const &Snapshot);
 		~Schedule();
 
+		Schedule &operator=(Schedule &&Other);
+
 		Duration	GetLength() const;
 		void		SetLength(Duration const &Length);
 
@@ -75,10 +92,91 @@ namespace Schedule
 		void BeginActivity(Activity &Activity, Offset const &Beginning);
 		void ClearBeginning(Activity &Activity);
 
+		// Pauses take time out of the schedule without changing its activities.  Only one pause can be active at a
+		// time, and an active pause takes no time until it is resumed.  Pauses can't overlap; these return false if
+		// they would.
+		PauseList const	&GetPauses() const;
+		Offset const	*GetActivePause() const;
+
+		bool Pause(Offset const &Start);
+		bool Resume(Offset const &End);
+		bool AddPause(Offset const &Start, Duration const &Length);
+		// Forget the active pause, or the pause that started at Start, as though it was never taken
+		bool CancelPause();
+		bool RemovePause(Offset const &Start);
+		void ClearPauses();
+
+		// The number of threads used to lay out schedules of at least the parallel layout threshold's activities.  0,
+		// the default, uses one per core.  The layout is the same however many threads compute it.
+		unsigned int	GetLayoutThreads() const;
+		void			SetLayoutThreads(unsigned int Threads);
+		size_type		GetParallelLayoutThreshold() const;
+		void			SetParallelLayoutThreshold(size_type Threshold);
+
+		static size_type const DefaultParallelLayoutThreshold = 65536;
+
+		// Snapshots share copies of the activities, actual times and all, with the schedule, a run of activities at a
+		// time.  Changing an activity, or laying it out somewhere else, drops its run's copies, so the first snapshot
+		// after a change lays the schedule out and copies only the runs changed since the last one.  Until the next
+		// change, taking another is O(1).  Like any change, this must be done on the thread changing the schedule;
+		// other threads can read the published layout.
+		ScheduleSnapshot GetSnapshot();
+
+		// Publishes a snapshot of the current layout, unless nothing has changed since the last one was published.
+		// Any thread can get the latest published layout, even while this one changes the schedule and lays it out
+		// again.  Getting it is wait-free; publishing waits for readers still copying the layout before last.
+		// Returns null before the first layout is published.
+		void									PublishLayout();
+		std::shared_ptr<PublishedLayout const>	GetPublishedLayout() const;
+
+		// A run of consecutive activities, by index
+		struct ActivityRange
+		{
+			size_type	First;
+			size_type	Count;
+		};
+
+		// Observers are told, after each layout, the ranges of activities whose actual start, length, or end changed,
+		// or which hold a different activity than before, in order.  Activities removed from the end only show as a
+		// smaller size(), and removing the last activity is reported without a layout, with no ranges.  Observers hear
+		// only of changes made after they were added, on whichever thread laid the schedule out, and must not change
+		// the schedule.
+		typedef std::function<void (Schedule const &Changed, std::vector<ActivityRange> const &Ranges)> Observer;
+		typedef unsigned long ObserverHandle;
+
+		ObserverHandle	AddObserver(Observer const &Notify);
+		void			RemoveObserver(ObserverHandle Handle);
+
+		// The heap memory the schedule holds.  Takes time linear in its activities.
+		ScheduleMemory GetMemoryUsage() const;
+
+		// Counts of the layout work done on this schedule, kept only when built with SCHEDULE_STATS.  File work isn't
+		// counted per schedule.
+		ScheduleStats const		&GetScheduleStats() const;
+
+		// Counts of the layout and file work done by the whole process, kept only when built with SCHEDULE_STATS
+		static ScheduleStats	GetStats();
+		static void				ResetStats();
+
 	private:
 		friend class Activity;
 
+		// Marks the layout out of date.  It is recomputed the next time an activity's actual start or length is read,
+		// so a run of changes costs a single layout.
 		void Update();
+		// Like Update, for a change to one of Changed's own settings
+		void Update(Activity const &Changed);
+		void UpdateLayout();
+		// Counts its work in Counted
+		void Layout(ScheduleStats &Counted);
+
+		// Like Update, for a change to when Moved starts.  While the layout is current and nothing after the first
+		// activity is pinned to the clock, a new start for the first activity moves every activity by the same amount,
+		// so only the base the actual times are kept relative to moves.
+		void UpdateStart(Activity const &Moved);
+
+		// What the activities' actual times are kept relative to
+		Offset GetBase() const;
 
 	private:
 		struct Implementation;
@@ -0,0 +1,238 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "Schedule.hpp"
+#include "ScheduleBatch.hpp"
+#include "ScheduleFileIO.hpp"
+
+using namespace Schedule;
+
+namespace
+{
+	// One queue of file indices per thread.  Each thread works through its own queue from the back, and when it is
+	// empty, steals from the front of the others'.
+	class WorkQueues
+	{
+	public:
+		WorkQueues(std::size_t Count, unsigned int Threads) :
+			Queues(Threads)
+		{
+			// Give each thread a contiguous run of files
+			for (std::size_t Item = 0; Item < Count; Item++)
+				this->Queues[Item * Threads / Count].Items.push_front(Item);
+		}
+
+		bool Take(unsigned int Thread, std::size_t &Item)
+		{
+			{
+				Queue &Own = this->Queues[Thread];
+				std::lock_guard<std::mutex> Lock(Own.Mutex);
+
+				if (!Own.Items.empty())
+				{
+					Item = Own.Items.back();
+					Own.Items.pop_back();
+					return true;
+				}
+			}
+
+			for (std::size_t Offset = 1; Offset < this->Queues.size(); Offset++)
+			{
+				Queue &Victim = this->Queues[(Thread + Offset) % this->Queues.size()];
+				std::lock_guard<std::mutex> Lock(Victim.Mutex);
+
+				if (!Victim.Items.empty())
+				{
+					Item = Victim.Items.front();
+					Victim.Items.pop_front();
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+	private:
+		struct Queue
+		{
+			std::mutex				Mutex;
+			std::deque<std::size_t>	Items;
+		};
+
+		std::vector<Queue> Queues;
+	};
+
+
+	std::chrono::microseconds GetElapsed(std::chrono::steady_clock::time_point const &Start)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start);
+	}
+
+
+	void Process(std::string const &FileName, bool Rewrite, ScheduleBatch::Result &Result)
+	{
+		std::ostringstream Errors;
+
+		Result.FileName = FileName;
+		Result.Activities = 0;
+		Result.ReadTime = Result.LayoutTime = Result.WriteTime = std::chrono::microseconds(0);
+
+		std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+		Schedule::Schedule CurrentSchedule = ScheduleFileIO::Read(FileName, Errors);
+
+		Result.ReadTime = GetElapsed(Start);
+
+		if (Errors.tellp() == 0)
+		{
+			// The batch is already spread across the cores
+			CurrentSchedule.SetLayoutThreads(1);
+
+			Start = std::chrono::steady_clock::now();
+
+			// Reading a laid out value brings the layout up to date
+			if (!CurrentSchedule.empty())
+				CurrentSchedule.front()->GetActualStartTime();
+
+			Result.LayoutTime = GetElapsed(Start);
+			Result.Activities = CurrentSchedule.size();
+
+			if (Rewrite)
+			{
+				Start = std::chrono::steady_clock::now();
+
+				ScheduleFileIO::Write(CurrentSchedule, FileName, Errors);
+
+				Result.WriteTime = GetElapsed(Start);
+			}
+		}
+
+		Result.Errors = Errors.str();
+		Result.Succeeded = Result.Errors.empty();
+	}
+}
+
+
+bool ScheduleBatch::GetFileNames(std::string const &Path, std::vector<std::string> &FileNames)
+{
+	struct stat Status;
+
+	if (stat(Path.c_str(), &Status) != 0)
+	{
+		std::cerr << Path << ": cannot open" << std::endl;
+		return false;
+	}
+
+	if (S_ISDIR(Status.st_mode))
+	{
+		DIR * const Directory = opendir(Path.c_str());
+
+		if (Directory == nullptr)
+		{
+			std::cerr << Path << ": cannot read directory" << std::endl;
+			return false;
+		}
+
+		std::vector<std::string> Found;
+
+		while (dirent const * const Entry = readdir(Directory))
+		{
+			std::string const Name = Entry->d_name;
+
+			if (Name.size() > 4 && Name.compare(Name.size() - 4, 4, ".sch") == 0)
+				Found.push_back(Path + "/" + Name);
+		}
+
+		closedir(Directory);
+
+		std::sort(Found.begin(), Found.end());
+		FileNames.insert(FileNames.end(), Found.begin(), Found.end());
+
+		return true;
+	}
+
+	std::ifstream Manifest(Path);
+
+	if (!Manifest)
+	{
+		std::cerr << Path << ": cannot open manifest" << std::endl;
+		return false;
+	}
+
+	std::string::size_type const Separator = Path.find_last_of('/');
+	std::string const Directory = (Separator == std::string::npos ? "" : Path.substr(0, Separator + 1));
+
+	std::string Line;
+	while (std::getline(Manifest, Line))
+	{
+		if (Line.empty() || Line[0] == '#')
+			continue;
+
+		FileNames.push_back(Line[0] == '/' ? Line : Directory + Line);
+	}
+
+	return true;
+}
+
+
+std::vector<ScheduleBatch::Result> ScheduleBatch::Run(std::vector<std::string> const &FileNames, bool Rewrite,
+													  unsigned int Threads)
+{
+	std::vector<Result> Results(FileNames.size());
+
+	if (FileNames.empty())
+		return Results;
+
+	if (Threads == 0)
+		Threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	if (Threads > FileNames.size())
+		Threads = FileNames.size();
+
+	WorkQueues Queues(FileNames.size(), Threads);
+
+	auto const Worker = [&](unsigned int Thread)
+	{
+		std::size_t Item;
+		while (Queues.Take(Thread, Item))
+			Process(FileNames[Item], Rewrite, Results[Item]);
+	};
+
+	std::vector<std::thread> Workers;
+	for (unsigned int Thread = 1; Thread < Threads; Thread++)
+		Workers.emplace_back(Worker, Thread);
+
+	Worker(0);
+
+	for (auto &Thread : Workers)
+		Thread.join();
+
+	return Results;
+}
@@ -0,0 +1,56 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEBATCH
+#define SCHEDULE_SCHEDULEBATCH
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace Schedule
+{
+	// Reads, lays out, and optionally rewrites many schedule files in one process, spread across threads.  Threads
+	// that run out of files steal them from the others.
+	class ScheduleBatch
+	{
+	public:
+		struct Result
+		{
+			std::string		FileName;
+			bool			Succeeded;
+			std::string		Errors;			// What reading or writing the file reported
+			unsigned int	Activities;
+
+			std::chrono::microseconds	ReadTime;
+			std::chrono::microseconds	LayoutTime;
+			std::chrono::microseconds	WriteTime;
+		};
+
+		// Lists the .sch files in Path if it is a directory, in name order.  Otherwise Path is a manifest listing one
+		// file per line; names relative to it are taken relative to its directory.  Blank lines and lines starting
+		// with # are skipped.
+		static bool GetFileNames(std::string const &Path, std::vector<std::string> &FileNames);
+
+		// Returns a result for each of FileNames, in the same order.  A Threads of 0 uses one per core.
+		static std::vector<Result> Run(std::vector<std::string> const &FileNames, bool Rewrite, unsigned int Threads = 0);
+	};
+}
+
+#endif
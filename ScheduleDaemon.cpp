@@ -0,0 +1,481 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <limits.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ScheduleDaemon.hpp"
+#include "ScheduleFileIO.hpp"
+#include "ScheduleStore.hpp"
+
+using namespace Schedule;
+
+// Requests are the schedule file name followed by the command line arguments, each terminated by a null character.
+// The client shuts down its end of the connection once the request is sent.  Responses are the exit code and the
+// size of the standard output, each on its own line, followed by the standard output and then the standard error.
+
+namespace
+{
+	volatile std::sig_atomic_t Stopping = 0;
+
+
+	void HandleStopSignal(int)
+	{
+		Stopping = 1;
+	}
+
+
+	bool GetSocketAddress(std::string const &SocketPath, sockaddr_un &Address)
+	{
+		std::memset(&Address, 0, sizeof(Address));
+		Address.sun_family = AF_UNIX;
+
+		if (SocketPath.size() >= sizeof(Address.sun_path))
+		{
+			std::cerr << SocketPath << ": socket path is too long" << std::endl;
+			return false;
+		}
+
+		std::strcpy(Address.sun_path, SocketPath.c_str());
+		return true;
+	}
+
+
+	// Where the socket goes without a runtime directory.  /tmp is shared, so the socket is kept in a directory of its
+	// own that only the user can enter.
+	std::string GetFallbackDirectory()
+	{
+		std::ostringstream Stream;
+		Stream << "/tmp/schedule-" << getuid();
+		return Stream.str();
+	}
+
+
+	bool IsPrivateDirectory(std::string const &Directory)
+	{
+		struct stat Status;
+
+		return (lstat(Directory.c_str(), &Status) == 0 && S_ISDIR(Status.st_mode) && Status.st_uid == getuid() &&
+				(Status.st_mode & 077) == 0);
+	}
+
+
+	// A socket in the fallback directory is only trusted while nobody else could have put it there
+	bool IsTrustedSocketPath(std::string const &SocketPath)
+	{
+		std::string const Directory = GetFallbackDirectory();
+
+		return (SocketPath.compare(0, Directory.size() + 1, Directory + "/") != 0 || IsPrivateDirectory(Directory));
+	}
+
+
+	bool WriteAll(int Descriptor, std::string const &Data)
+	{
+		std::string::size_type Written = 0;
+		while (Written < Data.size())
+		{
+			ssize_t const Result = write(Descriptor, Data.data() + Written, Data.size() - Written);
+
+			if (Result < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				return false;
+			}
+
+			Written += Result;
+		}
+
+		return true;
+	}
+
+
+	bool ReadAll(int Descriptor, std::string &Data)
+	{
+		char Buffer[4096];
+
+		while (true)
+		{
+			ssize_t const Result = read(Descriptor, Buffer, sizeof(Buffer));
+
+			if (Result < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				return false;
+			}
+
+			if (Result == 0)
+				return true;
+
+			Data.append(Buffer, Result);
+		}
+	}
+
+
+	// Schedules are kept under absolute paths so that every client names the same file the same way
+	std::string GetAbsolutePath(std::string const &FileName)
+	{
+		std::string::size_type const Separator = FileName.find_last_of('/');
+
+		std::string const Directory = (Separator == std::string::npos ? "." : (Separator == 0 ? "/" : FileName.substr(0, Separator)));
+		std::string const Base = (Separator == std::string::npos ? FileName : FileName.substr(Separator + 1));
+
+		char Resolved[PATH_MAX];
+		if (realpath(Directory.c_str(), Resolved) == nullptr)
+			return FileName;
+
+		return std::string(Resolved) + (Resolved[1] != '\0' ? "/" : "") + Base;
+	}
+
+
+	// Sends std::cout and std::cerr to strings for as long as it exists
+	class OutputCapture
+	{
+	public:
+		OutputCapture() :
+			OldOut(std::cout.rdbuf(this->Out.rdbuf())),
+			OldErr(std::cerr.rdbuf(this->Err.rdbuf()))
+		{
+
+		}
+
+		~OutputCapture()
+		{
+			std::cout.rdbuf(this->OldOut);
+			std::cerr.rdbuf(this->OldErr);
+		}
+
+		std::ostringstream	Out;
+		std::ostringstream	Err;
+
+	private:
+		std::streambuf	   *OldOut;
+		std::streambuf	   *OldErr;
+	};
+}
+
+
+struct Schedule::ScheduleDaemon::Implementation
+{
+	Implementation(std::string const &SocketPath, CommandHandler const &Handler) :
+		SocketPath(SocketPath),
+		Handler(Handler),
+		Listener(-1)
+	{
+
+	}
+
+	std::string		SocketPath;
+	CommandHandler	Handler;
+	int				Listener;
+
+	ScheduleStore	Schedules;
+
+	bool Listen();
+	void Serve(int Client);
+};
+
+
+ScheduleDaemon::ScheduleDaemon(std::string const &SocketPath, CommandHandler const &Handler) :
+	Data(new Implementation(SocketPath, Handler))
+{
+
+}
+
+
+ScheduleDaemon::~ScheduleDaemon()
+{
+	if (this->Data->Listener >= 0)
+	{
+		close(this->Data->Listener);
+		unlink(this->Data->SocketPath.c_str());
+	}
+
+	delete this->Data;
+}
+
+
+int ScheduleDaemon::Run()
+{
+	if (!this->Data->Listen())
+		return 2;
+
+	{
+		struct sigaction Action;
+		std::memset(&Action, 0, sizeof(Action));
+		Action.sa_handler = HandleStopSignal;
+
+		// No SA_RESTART, so that poll is interrupted
+		sigaction(SIGINT, &Action, nullptr);
+		sigaction(SIGTERM, &Action, nullptr);
+
+		std::signal(SIGPIPE, SIG_IGN);
+	}
+
+	// Rapid successive write-backs share their fsyncs
+	ScheduleFileIO::SetSyncInterval(std::chrono::milliseconds(1000));
+
+	while (!Stopping)
+	{
+		pollfd Listener = { this->Data->Listener, POLLIN, 0 };
+		int const Result = poll(&Listener, 1, -1);
+
+		if (Result < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			std::cerr << "poll: " << std::strerror(errno) << std::endl;
+			break;
+		}
+
+		int const Client = accept(this->Data->Listener, nullptr, nullptr);
+
+		if (Client < 0)
+			continue;
+
+		this->Data->Serve(Client);
+		close(Client);
+	}
+
+	bool const Written = this->Data->Schedules.WriteBack();
+	bool const Synced = ScheduleFileIO::Sync();
+
+	if (!Written || !Synced)
+	{
+		std::cerr << "Some schedules could not be written back." << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+
+bool ScheduleDaemon::Forward(std::string const &SocketPath, std::string const &FileName,
+							 std::vector<std::string> const &Arguments, int &ExitCode)
+{
+	sockaddr_un Address;
+	if (!IsTrustedSocketPath(SocketPath) || !GetSocketAddress(SocketPath, Address))
+		return false;
+
+	int const Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (Socket < 0)
+		return false;
+
+	if (connect(Socket, reinterpret_cast<sockaddr *>(&Address), sizeof(Address)) != 0)
+	{
+		close(Socket);
+		return false;
+	}
+
+	std::signal(SIGPIPE, SIG_IGN);
+
+	std::string Request = (FileName.empty() ? FileName : GetAbsolutePath(FileName));
+	Request += '\0';
+
+	for (auto &Argument : Arguments)
+	{
+		Request += Argument;
+		Request += '\0';
+	}
+
+	std::string Response;
+	bool const Exchanged = WriteAll(Socket, Request) && shutdown(Socket, SHUT_WR) == 0 && ReadAll(Socket, Response);
+
+	close(Socket);
+
+	std::istringstream Stream(Response);
+	std::string::size_type OutSize;
+
+	if (!Exchanged || (Stream >> ExitCode >> OutSize).fail() || Stream.get() != '\n')
+	{
+		std::cerr << "The schedule daemon did not respond." << std::endl;
+		ExitCode = 2;
+		return true;
+	}
+
+	std::string::size_type const OutStart = Stream.tellg();
+
+	if (OutStart + OutSize > Response.size())
+	{
+		std::cerr << "The schedule daemon sent a truncated response." << std::endl;
+		ExitCode = 2;
+		return true;
+	}
+
+	std::cout.write(Response.data() + OutStart, OutSize);
+	std::cout.flush();
+	std::cerr.write(Response.data() + OutStart + OutSize, Response.size() - OutStart - OutSize);
+
+	return true;
+}
+
+
+std::string ScheduleDaemon::GetDefaultSocketPath()
+{
+	if (char const * const SocketPath = std::getenv("SCHEDULE_SOCKET"))
+		return SocketPath;
+
+	if (char const * const RuntimeDirectory = std::getenv("XDG_RUNTIME_DIR"))
+		return std::string(RuntimeDirectory) + "/schedule.sock";
+
+	return GetFallbackDirectory() + "/schedule.sock";
+}
+
+
+bool Schedule::ScheduleDaemon::Implementation::Listen()
+{
+	sockaddr_un Address;
+	if (!GetSocketAddress(this->SocketPath, Address))
+		return false;
+
+	if (!IsTrustedSocketPath(this->SocketPath))
+	{
+		mkdir(GetFallbackDirectory().c_str(), 0700);
+
+		if (!IsTrustedSocketPath(this->SocketPath))
+		{
+			std::cerr << GetFallbackDirectory() << ": not a directory private to this user" << std::endl;
+			return false;
+		}
+	}
+
+	// Refuse to displace a running daemon, but clear away a socket left behind by one that died
+	{
+		int Probe;
+		if (ScheduleDaemon::Forward(this->SocketPath, "", { "-q", "list" }, Probe))
+		{
+			std::cerr << this->SocketPath << ": a daemon is already running" << std::endl;
+			return false;
+		}
+
+		unlink(this->SocketPath.c_str());
+	}
+
+	this->Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	// Connecting takes write permission on the socket, which is made only the user's as it is bound.  The store's
+	// threads create files with modes of their own, so changing the umask doesn't reach them.
+	bool Bound = false;
+
+	if (this->Listener >= 0)
+	{
+		mode_t const Mask = umask(0177);
+		Bound = (bind(this->Listener, reinterpret_cast<sockaddr *>(&Address), sizeof(Address)) == 0);
+		umask(Mask);
+	}
+
+	if (!Bound || listen(this->Listener, 64) != 0)
+	{
+		std::cerr << this->SocketPath << ": " << std::strerror(errno) << std::endl;
+
+		if (this->Listener >= 0)
+			close(this->Listener);
+
+		this->Listener = -1;
+		return false;
+	}
+
+	return true;
+}
+
+
+void Schedule::ScheduleDaemon::Implementation::Serve(int Client)
+{
+	// Commands run as the daemon's user, so they are only taken from that user
+	{
+		ucred Credentials;
+		socklen_t Size = sizeof(Credentials);
+
+		if (getsockopt(Client, SOL_SOCKET, SO_PEERCRED, &Credentials, &Size) != 0 || Credentials.uid != getuid())
+			return;
+	}
+
+	// Don't let a stalled client hold up everyone else, whether it stops sending its request or reading the response
+	{
+		timeval Timeout = { 1, 0 };
+		setsockopt(Client, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+		setsockopt(Client, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof(Timeout));
+	}
+
+	std::string Request;
+	if (!ReadAll(Client, Request) || Request.empty() || Request.back() != '\0')
+		return;
+
+	std::vector<std::string> Arguments;
+	for (std::string::size_type Start = 0; Start < Request.size(); )
+	{
+		std::string::size_type const End = Request.find('\0', Start);
+		Arguments.push_back(Request.substr(Start, End - Start));
+		Start = End + 1;
+	}
+
+	std::string const FileName = Arguments.front();
+	Arguments.erase(Arguments.begin());
+
+	int ExitCode;
+	std::string Out;
+	std::string Err;
+	{
+		OutputCapture Capture;
+
+		// Probes from a starting daemon name no file
+		if (FileName.empty())
+			ExitCode = 0;
+		else
+		{
+			try
+			{
+				ExitCode = this->Schedules.Run(FileName, [&](Schedule &Resident, std::function<bool ()> const &Modified)
+				{
+					return this->Handler(Resident, FileName, Arguments, Modified);
+				});
+			}
+			catch (std::exception const &e)
+			{
+				std::cerr << e.what() << std::endl;
+				ExitCode = 2;
+			}
+		}
+
+		Out = Capture.Out.str();
+		Err = Capture.Err.str();
+	}
+
+	std::ostringstream Response;
+	Response << ExitCode << "\n" << Out.size() << "\n" << Out << Err;
+
+	WriteAll(Client, Response.str());
+}
+
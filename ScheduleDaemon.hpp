@@ -0,0 +1,68 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEDAEMON
+#define SCHEDULE_SCHEDULEDAEMON
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Schedule.hpp"
+
+namespace Schedule
+{
+	// Keeps schedules resident in a ScheduleStore and serves command line requests for them over a Unix domain socket.
+	// Modified schedules are written back by the store, instead of after every command, so a forwarded command's
+	// changes are not yet on the disk when it returns.  A failed write-back is reported to the next request for that
+	// schedule, and tried again.
+	class ScheduleDaemon
+	{
+	public:
+		// Runs one request against Schedule, read from FileName, writing its output to std::cout and std::cerr.
+		// Calling Save marks the schedule as modified, returning false if its last write-back failed.
+		typedef std::function<int (Schedule &Schedule, std::string const &FileName,
+								   std::vector<std::string> const &Arguments,
+								   std::function<bool ()> const &Save)> CommandHandler;
+
+		ScheduleDaemon(std::string const &SocketPath, CommandHandler const &Handler);
+		ScheduleDaemon(ScheduleDaemon const &) = delete;
+		~ScheduleDaemon();
+
+		// Serves requests until interrupted or terminated, then writes back any modified schedules
+		int Run();
+
+		// Sends a request for FileName to the daemon listening on SocketPath and relays its output.  Returns false,
+		// without running anything, if no daemon is listening.
+		static bool Forward(std::string const &SocketPath, std::string const &FileName,
+							std::vector<std::string> const &Arguments, int &ExitCode);
+
+		// $SCHEDULE_SOCKET if set, otherwise schedule.sock in $XDG_RUNTIME_DIR or in a per-user directory in /tmp.
+		// The daemon makes that directory, and its socket, accessible only to its user, and serves no one else.
+		static std::string GetDefaultSocketPath();
+
+	private:
+		struct Implementation;
+
+		Implementation *Data;
+	};
+}
+
+#endif
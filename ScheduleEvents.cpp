@@ -0,0 +1,266 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ScheduleEvents.hpp"
+#include "TimingWheel.hpp"
+
+using namespace Schedule;
+
+namespace
+{
+	// An activity's two timers
+	struct Registration
+	{
+		Registration() :
+			Registered(nullptr),
+			Generation(0),
+			Starting(false)
+		{
+			this->Start.Context = this;
+			this->End.Context = this;
+		}
+
+		Activity const		*Registered;
+		TimingWheel::Entry	Start;
+		TimingWheel::Entry	End;
+
+		unsigned long		Generation;		// The last change that set the timers
+		bool				Starting;		// Set while the start is being fired
+	};
+}
+
+struct Schedule::ScheduleEvents::Implementation
+{
+	Implementation(Schedule &Watched, Offset const &Now, Handler const &Fire) :
+		Watched(Watched),
+		Fire(Fire),
+		Wheel(new TimingWheel(Now.GetTotalSeconds())),
+		Generation(0)
+	{
+
+	}
+
+	Schedule	   &Watched;
+	Handler			Fire;
+
+	std::unique_ptr<TimingWheel>	Wheel;
+	Schedule::ObserverHandle		Observer;
+
+	std::unordered_map<Activity const *, Registration>	Registrations;
+
+	// The activity each row held when its timers were last set
+	std::vector<Activity const *>	Rows;
+	unsigned long					Generation;
+
+	void Register(Activity const &Registered);
+	void RegisterAll();
+	void Update(Schedule const &Changed, std::vector<Schedule::ActivityRange> const &Ranges);
+};
+
+
+ScheduleEvents::ScheduleEvents(Schedule &Watched, Offset const &Now, Handler const &Fire) :
+	Data(new Implementation(Watched, Now, Fire))
+{
+	this->Data->Observer = Watched.AddObserver([this](Schedule const &Changed, std::vector<Schedule::ActivityRange> const &Ranges)
+	{
+		this->Data->Update(Changed, Ranges);
+	});
+
+	this->Data->RegisterAll();
+}
+
+
+ScheduleEvents::~ScheduleEvents()
+{
+	this->Data->Watched.RemoveObserver(this->Data->Observer);
+
+	// The wheel goes first, since it unlinks the timers
+	this->Data->Wheel.reset();
+
+	delete this->Data;
+}
+
+
+void ScheduleEvents::Advance(Offset const &Now)
+{
+	// Lay out first, so that the observer sets the timers of anything changed, and forgets those of any activity
+	// removed, before they can fire
+	if (!this->Data->Watched.empty())
+		this->Data->Watched.front()->GetActualStartTime();
+
+	TimingWheel::Time const Time = Now.GetTotalSeconds();
+
+	if (Time < this->Data->Wheel->GetTime())
+	{
+		this->Data->Wheel.reset(new TimingWheel(Time));
+		this->Data->RegisterAll();
+		return;
+	}
+
+	std::vector<std::pair<Registration *, Transition>> Fired;
+
+	this->Data->Wheel->Advance(Time, [&](TimingWheel::Entry &Entry)
+	{
+		Registration * const Owner = static_cast<Registration *>(Entry.Context);
+		bool const Starting = (&Entry == &Owner->Start);
+
+		if (Starting)
+			Owner->Starting = true;
+
+		Fired.emplace_back(Owner, Starting ? Transition::START : Transition::END);
+	});
+
+	// Within a second, ends come before starts, except the end of an activity that starts that same second
+	auto const GetOrder = [](std::pair<Registration *, Transition> const &Transitioned)
+	{
+		return (Transitioned.second == Transition::START ? 1 : (Transitioned.first->Starting ? 2 : 0));
+	};
+
+	std::stable_sort(Fired.begin(), Fired.end(), [&](std::pair<Registration *, Transition> const &a,
+													 std::pair<Registration *, Transition> const &b)
+	{
+		TimingWheel::Time const aAt = (a.second == Transition::START ? a.first->Start.At : a.first->End.At);
+		TimingWheel::Time const bAt = (b.second == Transition::START ? b.first->Start.At : b.first->End.At);
+
+		return (aAt != bAt ? aAt < bAt : GetOrder(a) < GetOrder(b));
+	});
+
+	for (auto &Transitioned : Fired)
+	{
+		Registration &Owner = *Transitioned.first;
+		TimingWheel::Time const At = (Transitioned.second == Transition::START ? Owner.Start.At : Owner.End.At);
+
+		this->Data->Fire(*Owner.Registered, Transitioned.second, Offset(0, 0, At));
+	}
+
+	for (auto &Transitioned : Fired)
+		Transitioned.first->Starting = false;
+}
+
+
+bool ScheduleEvents::GetNextTime(Offset &Next) const
+{
+	TimingWheel::Time Time;
+	if (!this->Data->Wheel->GetNextTime(Time))
+		return false;
+
+	Next = Offset(0, 0, Time);
+	return true;
+}
+
+
+Schedule::Schedule::size_type	ScheduleEvents::GetPending() const	{ return this->Data->Wheel->size(); }
+
+
+char const *ScheduleEvents::GetName(Transition Kind)
+{
+	return (Kind == Transition::START ? "start" : "end");
+}
+
+
+// Sets the activity's timers, or cancels those already passed
+void Schedule::ScheduleEvents::Implementation::Register(Activity const &Registered)
+{
+	Registration &Timers = this->Registrations[&Registered];
+	Timers.Registered = &Registered;
+	Timers.Generation = this->Generation;
+
+	std::pair<TimingWheel::Entry *, Offset> const Transitions[] = {
+		{ &Timers.Start, Registered.GetActualStartTime() },
+		{ &Timers.End, Registered.GetActualEndTime() }
+	};
+
+	for (auto &Transitioned : Transitions)
+	{
+		TimingWheel::Time const At = Transitioned.second.GetTotalSeconds();
+
+		if (At > this->Wheel->GetTime())
+			this->Wheel->Insert(*Transitioned.first, At);
+		else
+			this->Wheel->Cancel(*Transitioned.first);
+	}
+}
+
+
+void Schedule::ScheduleEvents::Implementation::RegisterAll()
+{
+	for (auto &Timers : this->Registrations)
+	{
+		this->Wheel->Cancel(Timers.second.Start);
+		this->Wheel->Cancel(Timers.second.End);
+	}
+
+	this->Registrations.clear();
+	this->Rows.assign(this->Watched.begin(), this->Watched.end());
+
+	for (auto Registered : this->Rows)
+		this->Register(*Registered);
+}
+
+
+// Sets the timers of the activities in the changed rows.  An activity that was in one of those rows, or in a row past
+// the end, either moved into another changed row or was removed.
+void Schedule::ScheduleEvents::Implementation::Update(Schedule const &Changed, std::vector<Schedule::ActivityRange> const &Ranges)
+{
+	this->Generation++;
+
+	std::vector<Activity const *> Displaced(this->Rows.begin() + std::min(Changed.size(), this->Rows.size()), this->Rows.end());
+	this->Rows.resize(Changed.size());
+
+	Schedule::const_iterator ActivityIterator = Changed.begin();
+	Schedule::size_type Index = 0;
+
+	for (auto &Range : Ranges)
+	{
+		std::advance(ActivityIterator, Range.First - Index);
+		Index = Range.First;
+
+		for (; Index < Range.First + Range.Count; ++ActivityIterator, Index++)
+		{
+			Activity const * const Current = *ActivityIterator;
+
+			if (this->Rows[Index] != Current)
+			{
+				if (this->Rows[Index] != nullptr)
+					Displaced.push_back(this->Rows[Index]);
+
+				this->Rows[Index] = Current;
+			}
+
+			this->Register(*Current);
+		}
+	}
+
+	for (auto Removed : Displaced)
+	{
+		std::unordered_map<Activity const *, Registration>::iterator const Timers = this->Registrations.find(Removed);
+
+		if (Timers == this->Registrations.end() || Timers->second.Generation == this->Generation)
+			continue;
+
+		this->Wheel->Cancel(Timers->second.Start);
+		this->Wheel->Cancel(Timers->second.End);
+		this->Registrations.erase(Timers);
+	}
+}
@@ -0,0 +1,69 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEEVENTS
+#define SCHEDULE_SCHEDULEEVENTS
+
+#include <functional>
+
+#include "Activity.hpp"
+#include "Offset.hpp"
+#include "Schedule.hpp"
+
+namespace Schedule
+{
+	// Tells when the activities of a schedule start and end.  Each activity's actual start and end are timers in a
+	// TimingWheel, and the schedule is observed so that only the activities a layout moves have their timers set
+	// again.  Times are times of day, in seconds; nothing keeps time itself, so the owner calls Advance as the day
+	// goes by, at the times GetNextTime gives.
+	class ScheduleEvents
+	{
+	public:
+		enum class Transition { START,
+								END };
+
+		// Called as each transition comes due.  Transitions due at the same second come ends first, so that one
+		// activity ends before the next starts.  Handlers must not change the schedule.
+		typedef std::function<void (Activity const &Changed, Transition Kind, Offset const &At)> Handler;
+
+		// Only transitions after Now are told of
+		ScheduleEvents(Schedule &Watched, Offset const &Now, Handler const &Fire);
+		ScheduleEvents(ScheduleEvents const &) = delete;
+		~ScheduleEvents();
+
+		// Fires the transitions due by Now.  A Now earlier than the last is taken to be the next day, and every
+		// transition after it is set again.
+		void Advance(Offset const &Now);
+
+		// When Advance should next be called.  Returns false if no transitions are pending.
+		bool GetNextTime(Offset &Next) const;
+
+		// The number of transitions still to come
+		Schedule::size_type GetPending() const;
+
+		static char const *GetName(Transition Kind);
+
+	private:
+		struct Implementation;
+
+		Implementation *Data;
+	};
+}
+
+#endif
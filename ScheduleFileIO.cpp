@@ -17,86 +17,388 @@
 * Copyright 2015 Chris Foster
 */
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
 #include "Activity.hpp"
 #include "Offset.hpp"
+#include "OffsetTranslator.hpp"
 #include "ScheduleFileIO.hpp"
+#include "ScheduleJournal.hpp"
+#include "ScheduleSnapshot.hpp"
+#include "ScheduleStats.hpp"
+#include "ScheduleTrace.hpp"
 
 using namespace Schedule;
 
-class OffsetTranslator
+namespace
 {
-public:
-	typedef std::string	internal_type;
-	typedef Offset		external_type;
+	std::mutex								SyncMutex;
+	std::chrono::milliseconds				SyncInterval(0);
+	std::chrono::steady_clock::time_point	LastSync;
+	// Files renamed into place whose fsyncs were deferred, with the generation of those that are snapshots
+	std::map<std::string, std::string>		PendingSyncs;
+	std::atomic<unsigned long>				Generations(0);
+
+
+	std::string GetDirectoryName(std::string const &FileName)
+	{
+		std::string::size_type const Separator = FileName.find_last_of('/');
+
+		if (Separator == std::string::npos)
+			return ".";
+
+		return (Separator == 0 ? "/" : FileName.substr(0, Separator));
+	}
+
+
+	bool SyncPath(std::string const &Path, int Flags)
+	{
+		int const Descriptor = open(Path.c_str(), Flags);
+
+		if (Descriptor < 0)
+			return false;
+
+		bool const Result = (fsync(Descriptor) == 0);
+		close(Descriptor);
+
+		return Result;
+	}
 
-	boost::optional<external_type> get_value(internal_type const &v)
+
+	// Once the snapshot of the given generation is on the disk, a journal extending any other can go.  It was removed
+	// no sooner, so that a crash can't leave the snapshot it extends without it.
+	void RetireJournal(std::string const &FileName, std::string const &Generation)
 	{
-		std::istringstream Stream(v);
-		std::list<long> Values;
-		std::string Item;
+		std::string BaseGeneration;
+
+		if (ScheduleJournal::GetBaseGeneration(FileName, BaseGeneration) && BaseGeneration != Generation)
+			std::remove(ScheduleJournal::GetJournalFileName(FileName).c_str());
+	}
+
+
+	// Must be called with SyncMutex held
+	bool SyncPending()
+	{
+		bool Result = true;
+
+		for (auto &Pending : PendingSyncs)
+		{
+			bool const Synced = SyncPath(Pending.first, O_RDONLY) &&
+								SyncPath(GetDirectoryName(Pending.first), O_RDONLY | O_DIRECTORY);
+
+			if (Synced && !Pending.second.empty())
+				RetireJournal(Pending.first, Pending.second);
+
+			Result = Synced && Result;
+		}
+
+		PendingSyncs.clear();
+		LastSync = std::chrono::steady_clock::now();
+
+		return Result;
+	}
+
+
+	// The mode open would give a new file, which umask can only be read by setting.  Read once, before main starts
+	// any threads that could create files while it is changed.
+	mode_t GetCreationMode()
+	{
+		mode_t const Mask = umask(0);
+		umask(Mask);
+
+		return 0666 & ~Mask;
+	}
+
+	mode_t const CreationMode = GetCreationMode();
+
+
+	// Writes Contents to a temporary file next to FileName and renames it into place, so that FileName is never
+	// left half written.  The rename keeps the temporary file's modification time, which is returned in
+	// ModificationTime if it is given.  Generation is set for snapshots, whose stale journals are retired once the
+	// rename is on the disk.
+	bool WriteAtomically(std::string const &Contents, std::string const &FileName, std::ostream &Errors,
+						 timespec *ModificationTime = nullptr, std::string const &Generation = std::string())
+	{
+		std::string TemporaryName = FileName + ".XXXXXX";
+
+		int const Descriptor = mkstemp(&TemporaryName[0]);
+
+		if (Descriptor < 0)
+		{
+			Errors << FileName << ": cannot create temporary file" << std::endl;
+			return false;
+		}
+
+		// Keep the permissions of the file being replaced.  mkstemp creates files only their owner can read.
+		{
+			struct stat Status;
+
+			if (stat(FileName.c_str(), &Status) == 0)
+				fchmod(Descriptor, Status.st_mode & 07777);
+			else
+				fchmod(Descriptor, CreationMode);
+		}
+
+		std::string::size_type Written = 0;
+		while (Written < Contents.size())
+		{
+			ssize_t const Result = write(Descriptor, Contents.data() + Written, Contents.size() - Written);
+
+			if (Result < 0)
+			{
+				Errors << TemporaryName << ": write failed" << std::endl;
+
+				close(Descriptor);
+				unlink(TemporaryName.c_str());
+				return false;
+			}
+
+			Written += Result;
+		}
+
+		std::lock_guard<std::mutex> Lock(SyncMutex);
+
+		std::chrono::steady_clock::time_point const Now = std::chrono::steady_clock::now();
 
-		int Size;
-		for (Size = 0; Size < 3 && std::getline(Stream, Item, ':'); Size++)
+		// Saves arriving within the sync interval share the fsync of a later save
+		bool const Durable = (SyncInterval.count() == 0 || Now - LastSync >= SyncInterval);
+
+		if (Durable && fdatasync(Descriptor) != 0)
+		{
+			Errors << TemporaryName << ": fsync failed" << std::endl;
+
+			close(Descriptor);
+			unlink(TemporaryName.c_str());
+			return false;
+		}
+
+		if (ModificationTime != nullptr)
+		{
+			struct stat Status;
+
+			*ModificationTime = (fstat(Descriptor, &Status) == 0 ? Status.st_mtim : timespec{0, 0});
+		}
+
+		close(Descriptor);
+
+		if (rename(TemporaryName.c_str(), FileName.c_str()) != 0)
+		{
+			Errors << FileName << ": cannot replace file" << std::endl;
+
+			unlink(TemporaryName.c_str());
+			return false;
+		}
+
+		if (Durable)
 		{
-			long Value;
-			std::istringstream(Item) >> Value;
-			Values.push_back(Value);
+			PendingSyncs.erase(FileName);
+
+			bool const Result = SyncPath(GetDirectoryName(FileName), O_RDONLY | O_DIRECTORY);
+
+			if (Result && !Generation.empty())
+				RetireJournal(FileName, Generation);
+
+			return SyncPending() && Result;
 		}
 
-		// Pad the beginning so that there is a value for each denomination
-		for (int a = Size; a < 3; a++)
-			Values.push_front(0);
+		PendingSyncs[FileName] = Generation;
+
+		return true;
+	}
+
+
+	// Flushes deferred fsyncs when the program exits
+	struct PendingSyncFlusher
+	{
+		~PendingSyncFlusher() { ScheduleFileIO::Sync(); }
+	} Flusher;
+
 
-		std::list<long>::const_iterator Position = Values.begin();
+	// Starts a Schedule node with the version and length
+	boost::property_tree::ptree GetScheduleNode(Duration const &Length)
+	{
+		OffsetTranslator Translator;
 
-		long const Hours	= *Position++;
-		long const Minutes	= *Position++;
-		long const Seconds	= *Position;
+		boost::property_tree::ptree ScheduleNode;
+		ScheduleNode.put("<xmlattr>.version", "1.0");
+		ScheduleNode.put("Length", Length, Translator);
 
-		return Offset(Hours, Minutes, Seconds);
+		return ScheduleNode;
 	}
 
-	boost::optional<internal_type> put_value(external_type const &v)
+
+	boost::property_tree::ptree GetActivityNode(Activity const &CurrentActivity)
 	{
+		OffsetTranslator Translator;
+
+		boost::property_tree::ptree ActivityNode;
+
+		if (!CurrentActivity.GetName().empty())
+			ActivityNode.put("Name", CurrentActivity.GetName());
+
+		if (CurrentActivity.GetStartMode() != Activity::StartMode::FREE)
+			ActivityNode.put("StartMode", (CurrentActivity.GetStartMode() == Activity::StartMode::FIXED_ABSOLUTE ?
+											   "Fixed-Absolute" : "Fixed-Relative"));
+
+		if (!CurrentActivity.GetDesiredStartTime().IsZero())
+			ActivityNode.put("Start", CurrentActivity.GetDesiredStartTime(), Translator);
+
+		if (CurrentActivity.GetLengthMode() != Activity::LengthMode::FREE)
+			ActivityNode.put("LengthMode", "Fixed");
+
+		ActivityNode.put("Length", CurrentActivity.GetDesiredLength(), Translator);
+
+		if (Offset const *Beginning = CurrentActivity.GetBeginning())
+			ActivityNode.put("Beginning", *Beginning, Translator);
+
+		return ActivityNode;
+	}
+
+
+	// Finishes ScheduleNode with the pauses and writes it out
+	bool WriteScheduleNode(boost::property_tree::ptree &ScheduleNode, PauseList const &Pauses,
+						   Offset const *ActivePause, std::string const &FileName, std::ostream &Errors,
+						   timespec *ModificationTime = nullptr)
+	{
+		OffsetTranslator Translator;
+
+		// Write each pause, ending with the active one
+		for (auto &Pause : Pauses)
+		{
+			boost::property_tree::ptree PauseNode;
+
+			PauseNode.put("Start", Pause.first, Translator);
+			PauseNode.put("Length", Pause.second, Translator);
+
+			ScheduleNode.add_child("Pause", PauseNode);
+		}
+
+		if (ActivePause != nullptr)
+		{
+			boost::property_tree::ptree PauseNode;
+
+			PauseNode.put("Start", *ActivePause, Translator);
+
+			ScheduleNode.add_child("Pause", PauseNode);
+		}
+
+		// Journals name the snapshot they extend by its generation, which is new with every write
+		std::ostringstream GenerationStream;
+		GenerationStream << std::hex << std::chrono::system_clock::now().time_since_epoch().count() << "-" << getpid() <<
+							"-" << Generations++;
+
+		std::string const Generation = GenerationStream.str();
+		ScheduleNode.put("<xmlattr>.generation", Generation);
+
+		boost::property_tree::ptree Root;
+		Root.add_child("Schedule", ScheduleNode);
+
 		std::ostringstream Stream;
 
-		if (long const Value = v.GetHours())
+		try
 		{
-			Stream << (std::abs(Value) < 10 ? "0" : "") << Value << ":";
+			ScheduleTrace::Span const Serialized("Serialize", "file");
+
+			boost::property_tree::xml_writer_settings<boost::property_tree::ptree::key_type> Settings('\t', 1);
+			boost::property_tree::write_xml(Stream, Root, Settings);
 		}
+		catch (std::exception const &e)
+		{
+			Errors << e.what() << "\n";
+			return false;
+		}
+
+		SCHEDULE_COUNT(WRITE_BYTES, Stream.tellp());
 
-		if (long const Value = v.GetMinutes())
-			Stream << (std::abs(Value) < 10 ? "0" : "") << Value << ":";
-		else
-			Stream << "00:";
+		{
+			ScheduleTrace::Span const Stored("Store", "file");
 
-		if (long const Value = v.GetSeconds())
-			Stream << (std::abs(Value) < 10 ? "0" : "") << Value;
-		else
-			Stream << "00";
+			if (!WriteAtomically(Stream.str(), FileName, Errors, ModificationTime, Generation))
+				return false;
+		}
 
-		return Stream.str();
+		return true;
 	}
-};
+}
 
 
 Schedule::Schedule ScheduleFileIO::Read(std::string const &FileName)
 {
+	return Read(FileName, std::cerr);
+}
+
+
+bool ScheduleFileIO::Write(Schedule const &Schedule, std::string const &FileName)
+{
+	return Write(Schedule, FileName, std::cerr);
+}
+
+
+bool ScheduleFileIO::Write(ScheduleSnapshot const &Snapshot, std::string const &FileName)
+{
+	return Write(Snapshot, FileName, std::cerr);
+}
+
+
+Schedule::Schedule ScheduleFileIO::Read(std::string const &FileName, std::ostream &Errors)
+{
+	SCHEDULE_COUNT(READS, 1);
+	ScheduleTrace::Span const Traced("Read", "file", SCHEDULE_TALLY(READ_NANOSECONDS));
+
 	OffsetTranslator Translator;
 
 	boost::property_tree::ptree Root;
 
 	Schedule Staging;
 
+	// Which snapshot this is, so that only a journal extending it is replayed
+	std::string Generation;
+
 	try
 	{
-		boost::property_tree::read_xml(FileName, Root);
+		{
+			ScheduleTrace::Span const Parsed("Parse", "file");
+
+			// Opened here rather than by read_xml, so that what the parser read can be counted
+			std::ifstream Stream(FileName);
+
+			if (!Stream)
+				throw boost::property_tree::xml_parser_error("cannot open file", FileName, 0);
+
+			try
+			{
+				boost::property_tree::read_xml(Stream, Root);
+			}
+			catch (boost::property_tree::xml_parser_error const &e)
+			{
+				throw boost::property_tree::xml_parser_error(e.message(), FileName, e.line());
+			}
+
+			std::streamoff const Consumed = Stream.tellg();
+
+			if (Consumed > 0)
+				SCHEDULE_COUNT(READ_BYTES, Consumed);
+		}
+
+		ScheduleTrace::Span const Built("Build", "file");
 
 		boost::property_tree::ptree ScheduleNode = Root.get_child("Schedule");
 
+		Generation = ScheduleNode.get<std::string>("<xmlattr>.generation", "");
+
 		if (boost::optional<Duration> Length = ScheduleNode.get_optional<Duration>("Length", Translator))
 		{
 			Staging.SetLength(*Length);
@@ -131,73 +433,134 @@ Schedule::Schedule ScheduleFileIO::Read(std::string const &FileName)
 				if (boost::optional<Offset> Beginning = Child->second.get_optional<Offset>("Beginning", Translator))
 					Staging.BeginActivity(*NewActivity, *Beginning);
 			}
+			else if (Child->first == "Pause")
+			{
+				Offset const Start = Child->second.get<Offset>("Start", Translator);
+
+				// A pause without a length is still active
+				boost::optional<Duration> const Length = Child->second.get_optional<Duration>("Length", Translator);
+
+				if (!(Length ? Staging.AddPause(Start, *Length) : Staging.Pause(Start)))
+					Errors << FileName << ": ignoring a pause that overlaps another" << std::endl;
+			}
 		}
 	}
 	catch (std::exception const &e)
 	{
-		std::cerr << e.what() << std::endl;
+		Errors << e.what() << std::endl;
 
-		return Schedule(Duration());
+		Staging = Schedule(Duration());
 	}
 
+	// Apply any operations logged since the snapshot was written
+	ScheduleTrace::Span const Replayed("Replay journal", "file");
+
+	if (!ScheduleJournal::Replay(Staging, FileName, Generation))
+		Errors << ScheduleJournal::GetJournalFileName(FileName) << ": stopped at a malformed journal record" << std::endl;
+
 	return Staging;
 }
 
 
-bool ScheduleFileIO::Write(Schedule const &Schedule, std::string const &FileName)
+bool ScheduleFileIO::Write(Schedule const &Schedule, std::string const &FileName, std::ostream &Errors)
 {
-	OffsetTranslator Translator;
+	SCHEDULE_COUNT(WRITES, 1);
+	ScheduleTrace::Span const Traced("Write", "file", SCHEDULE_TALLY(WRITE_NANOSECONDS));
 
-	boost::property_tree::ptree Root;
+	boost::property_tree::ptree ScheduleNode = GetScheduleNode(Schedule.GetLength());
+	{
+		ScheduleTrace::Span const Built("Build DOM", "file");
 
-	// Set version and length
-	boost::property_tree::ptree ScheduleNode;
-	ScheduleNode.put("<xmlattr>.version", "1.0");
-	ScheduleNode.put("Length", Schedule.GetLength(), Translator);
+		for (Schedule::Schedule::const_iterator	ActivityIterator = Schedule.begin();
+												ActivityIterator != Schedule.end();
+												++ActivityIterator)
+		{
+			ScheduleNode.add_child("Activity", GetActivityNode(**ActivityIterator));
+		}
+	}
+
+	return WriteScheduleNode(ScheduleNode, Schedule.GetPauses(), Schedule.GetActivePause(), FileName, Errors);
+}
+
+
+bool ScheduleFileIO::Write(ScheduleSnapshot const &Snapshot, std::string const &FileName, std::ostream &Errors,
+						   timespec *ModificationTime)
+{
+	SCHEDULE_COUNT(WRITES, 1);
+	ScheduleTrace::Span const Traced("Write", "file", SCHEDULE_TALLY(WRITE_NANOSECONDS));
 
-	// Write each activity
-	for (Schedule::Schedule::const_iterator	ActivityIterator = Schedule.begin();
-											ActivityIterator != Schedule.end();
-											++ActivityIterator)
+	boost::property_tree::ptree ScheduleNode = GetScheduleNode(Snapshot.GetLength());
 	{
-		Activity const &CurrentActivity = **ActivityIterator;
+		ScheduleTrace::Span const Built("Build DOM", "file");
 
-		boost::property_tree::ptree ActivityNode;
+		Snapshot.ForEach([&](Activity const &CurrentActivity)
+		{
+			ScheduleNode.add_child("Activity", GetActivityNode(CurrentActivity));
+		});
+	}
 
-		if (!CurrentActivity.GetName().empty())
-			ActivityNode.put("Name", CurrentActivity.GetName());
+	return WriteScheduleNode(ScheduleNode, Snapshot.GetPauses(), Snapshot.GetActivePause(), FileName, Errors,
+							 ModificationTime);
+}
 
-		if (CurrentActivity.GetStartMode() != Activity::StartMode::FREE)
-			ActivityNode.put("StartMode", (CurrentActivity.GetStartMode() == Activity::StartMode::FIXED_ABSOLUTE ?
-											   "Fixed-Absolute" : "Fixed-Relative"));
 
-		if (!CurrentActivity.GetDesiredStartTime().IsZero())
-			ActivityNode.put("Start", CurrentActivity.GetDesiredStartTime(), Translator);
+bool ScheduleFileIO::GetGeneration(std::string const &FileName, std::string &Generation)
+{
+	std::ifstream Stream(FileName);
 
-		if (CurrentActivity.GetLengthMode() != Activity::LengthMode::FREE)
-			ActivityNode.put("LengthMode", "Fixed");
+	if (!Stream)
+		return false;
 
-		ActivityNode.put("Length", CurrentActivity.GetDesiredLength(), Translator);
+	// The attribute is on the root element, so the head of the file is enough
+	std::string Head(4096, '\0');
+	Stream.read(&Head[0], Head.size());
+	Head.resize(Stream.gcount());
 
-		if (Offset const *Beginning = CurrentActivity.GetBeginning())
-			ActivityNode.put("Beginning", *Beginning, Translator);
+	std::string const Attribute = "generation=\"";
+	std::string::size_type const Start = Head.find(Attribute);
+	std::string::size_type const End = Start == std::string::npos ? Start : Head.find('"', Start + Attribute.size());
 
-		ScheduleNode.add_child("Activity", ActivityNode);
-	}
+	Generation = End == std::string::npos ? std::string() : Head.substr(Start + Attribute.size(), End - Start - Attribute.size());
+
+	return true;
+}
 
-	// Add to root
-	Root.add_child("Schedule", ScheduleNode);
 
-	try
-	{
-		boost::property_tree::xml_writer_settings<boost::property_tree::ptree::key_type> Settings('\t', 1);
-		boost::property_tree::write_xml(FileName, Root, std::locale(), Settings);
-	}
-	catch (std::exception const &e)
-	{
-		std::cerr << e.what() << "\n";
+bool ScheduleFileIO::WriteFile(std::string const &Contents, std::string const &FileName, std::ostream &Errors)
+{
+	return WriteAtomically(Contents, FileName, Errors);
+}
+
+
+void ScheduleFileIO::SetSyncInterval(std::chrono::milliseconds Interval)
+{
+	std::lock_guard<std::mutex> Lock(SyncMutex);
+	SyncInterval = Interval;
+}
+
+
+std::chrono::milliseconds ScheduleFileIO::GetSyncInterval()
+{
+	std::lock_guard<std::mutex> Lock(SyncMutex);
+	return SyncInterval;
+}
+
+
+bool ScheduleFileIO::GetSyncDeadline(std::chrono::steady_clock::time_point &Deadline)
+{
+	std::lock_guard<std::mutex> Lock(SyncMutex);
+
+	if (PendingSyncs.empty())
 		return false;
-	}
+
+	Deadline = LastSync + SyncInterval;
 
 	return true;
 }
+
+
+bool ScheduleFileIO::Sync()
+{
+	std::lock_guard<std::mutex> Lock(SyncMutex);
+	return SyncPending();
+}
@@ -20,15 +20,53 @@
 #ifndef SCHEDULE_SCHEDULEFILEIO
 #define SCHEDULE_SCHEDULEFILEIO
 
+#include <chrono>
+#include <ostream>
+#include <string>
+
+#include <time.h>
+
 #include "Schedule.hpp"
 
 namespace Schedule
 {
+	class ScheduleSnapshot;
+
 	class ScheduleFileIO
 	{
 	public:
 		static Schedule	Read(std::string const &FileName);
+		// Writes to a temporary file and renames it over FileName, so a failed save never leaves a torn file
 		static bool		Write(Schedule const &Schedule, std::string const &FileName);
+		static bool		Write(ScheduleSnapshot const &Snapshot, std::string const &FileName);
+
+		// As above, but reporting problems to Errors instead of std::cerr
+		static Schedule	Read(std::string const &FileName, std::ostream &Errors);
+		static bool		Write(Schedule const &Schedule, std::string const &FileName, std::ostream &Errors);
+		// If the snapshot is written and ModificationTime is given, it is set to the written file's
+		static bool		Write(ScheduleSnapshot const &Snapshot, std::string const &FileName, std::ostream &Errors,
+							  timespec *ModificationTime = nullptr);
+
+		// Every snapshot written is given a new generation, which its journal records.  Sets Generation to that of
+		// the snapshot in FileName, empty for one written before generations, and returns false if it can't be read.
+		static bool		GetGeneration(std::string const &FileName, std::string &Generation);
+
+		// Writes Contents over FileName the way schedules are written, for the files kept alongside them
+		static bool		WriteFile(std::string const &Contents, std::string const &FileName, std::ostream &Errors);
+
+		// Saves made within Interval of the last fsync are renamed into place without waiting on the disk.  Their
+		// fsyncs are deferred to the next save outside the interval, or to Sync.  An interval of zero syncs every save.
+		// Nothing syncs by itself in between: ScheduleWriter calls Sync once the deadline passes, so its saves are on
+		// the disk within Interval of being renamed into place, and other deferring callers must do the same.
+		static void							SetSyncInterval(std::chrono::milliseconds Interval);
+		static std::chrono::milliseconds	GetSyncInterval();
+
+		// Sets Deadline to when the deferred fsyncs are due, Interval after the last fsync.  Returns false if there
+		// are none.
+		static bool	GetSyncDeadline(std::chrono::steady_clock::time_point &Deadline);
+
+		// Performs any deferred fsyncs.  Also called when the program exits.
+		static bool Sync();
 	};
 }
 
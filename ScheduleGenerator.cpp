@@ -0,0 +1,336 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include "Activity.hpp"
+#include "ScheduleGenerator.hpp"
+
+using namespace Schedule;
+
+namespace
+{
+	// SplitMix64.  The standard distributions are implementation-defined, so values are drawn from the raw generator
+	// to keep schedules the same everywhere.
+	class Random
+	{
+	public:
+		Random(std::uint64_t Seed) :
+			State(Seed)
+		{
+
+		}
+
+		std::uint64_t Next()
+		{
+			std::uint64_t Value = (this->State += 0x9E3779B97F4A7C15ull);
+			Value = (Value ^ (Value >> 30)) * 0xBF58476D1CE4E5B9ull;
+			Value = (Value ^ (Value >> 27)) * 0x94D049BB133111EBull;
+
+			return Value ^ (Value >> 31);
+		}
+
+		// From First to Last, inclusive
+		long GetInteger(long First, long Last)
+		{
+			return First + static_cast<long>(this->Next() % static_cast<std::uint64_t>(Last - First + 1));
+		}
+
+		// From 0 to 1, excluding 1
+		double GetFraction()
+		{
+			return (this->Next() >> 11) * (1.0 / 9007199254740992.0);
+		}
+
+		bool GetChance(double Probability)
+		{
+			return this->GetFraction() < Probability;
+		}
+
+	private:
+		std::uint64_t State;
+	};
+
+
+	Duration GetMinutes(long Minutes)
+	{
+		return Duration(0, Minutes, 0);
+	}
+
+
+	std::string ToString(Offset const &Time)
+	{
+		std::ostringstream Stream;
+		Stream << Time;
+
+		return Stream.str();
+	}
+
+
+	Schedule::Schedule::iterator GetActivity(Schedule::Schedule &Schedule, long Index)
+	{
+		return std::next(Schedule.begin(), Index);
+	}
+}
+
+
+ScheduleGenerator::Parameters::Parameters() :
+	Activities(20),
+	StartTime(8, 0, 0),
+	FixedAbsolute(0.1),
+	FixedRelative(0.05),
+	FixedLength(0.25),
+	Begun(0.2),
+	ConflictingBeginnings(0.1),
+	Pauses(1),
+	ActivePause(false),
+	Seed(1)
+{
+
+}
+
+
+Schedule::Schedule ScheduleGenerator::Generate(Parameters const &Parameters)
+{
+	Random Generator(Parameters.Seed);
+
+	// Activities want from a minute to an hour and a half, and the schedule runs somewhat short or long of them
+	std::vector<long> Lengths(Parameters.Activities);
+	long TotalLength = 0;
+
+	for (auto &Length : Lengths)
+		TotalLength += (Length = Generator.GetInteger(1, 90));
+
+	long const ScheduleLength = TotalLength * Generator.GetInteger(80, 120) / 100 + 1;
+
+	Schedule Result(GetMinutes(ScheduleLength));
+
+	for (unsigned long Index = 0; Index < Parameters.Activities; Index++)
+	{
+		Activity * const NewActivity = new Activity;
+		NewActivity->SetName("Activity " + std::to_string(Index + 1));
+		NewActivity->SetDesiredLength(GetMinutes(Lengths[Index]));
+
+		if (Generator.GetChance(Parameters.FixedLength))
+			NewActivity->SetLengthMode(Activity::LengthMode::FIXED);
+
+		double const StartKind = Generator.GetFraction();
+
+		if (Index == 0)
+			NewActivity->SetDesiredStartTime(Parameters.StartTime);
+		else if (StartKind < Parameters.FixedAbsolute)
+		{
+			NewActivity->SetStartMode(Activity::StartMode::FIXED_ABSOLUTE);
+			NewActivity->SetDesiredStartTime(Parameters.StartTime + GetMinutes(Generator.GetInteger(0, ScheduleLength)));
+		}
+		else if (StartKind < Parameters.FixedAbsolute + Parameters.FixedRelative)
+		{
+			NewActivity->SetStartMode(Activity::StartMode::FIXED_RELATIVE);
+			NewActivity->SetDesiredStartTime(GetMinutes(Generator.GetInteger(0, ScheduleLength)));
+		}
+
+		Result.push_back(NewActivity);
+	}
+
+	// Activities are begun in order, from the first, each about when the one before it finished.  Conflicting
+	// beginnings land anywhere from an hour before the schedule to an hour after it.
+	{
+		unsigned long const BegunCount = static_cast<unsigned long>(Parameters.Begun * Parameters.Activities + 0.5);
+		Offset Next = Parameters.StartTime;
+
+		Schedule::iterator ActivityIterator = Result.begin();
+		for (unsigned long Index = 0; Index < BegunCount; Index++, ++ActivityIterator)
+		{
+			Offset Beginning;
+
+			if (Generator.GetChance(Parameters.ConflictingBeginnings))
+				Beginning = Parameters.StartTime + GetMinutes(Generator.GetInteger(-60, ScheduleLength + 60));
+			else
+			{
+				Beginning = Next + GetMinutes(Generator.GetInteger(0, 10));
+				Next = Beginning + GetMinutes(Lengths[Index] * Generator.GetInteger(50, 150) / 100);
+			}
+
+			Result.BeginActivity(**ActivityIterator, Beginning);
+		}
+	}
+
+	// Pauses that would overlap are tried again elsewhere, a few times
+	for (unsigned int Pause = 0; Pause < Parameters.Pauses; Pause++)
+	{
+		for (int Attempt = 0; Attempt < 8; Attempt++)
+		{
+			Offset const Start = Parameters.StartTime + GetMinutes(Generator.GetInteger(0, ScheduleLength));
+
+			if (Result.AddPause(Start, GetMinutes(Generator.GetInteger(1, 30))))
+				break;
+		}
+	}
+
+	if (Parameters.ActivePause)
+	{
+		for (int Attempt = 0; Attempt < 8; Attempt++)
+		{
+			if (Result.Pause(Parameters.StartTime + GetMinutes(Generator.GetInteger(0, ScheduleLength))))
+				break;
+		}
+	}
+
+	return Result;
+}
+
+
+std::string ScheduleGenerator::Edit(Schedule &Schedule, std::uint64_t Seed)
+{
+	Random Generator(Seed);
+
+	long const Size = Schedule.size();
+	long const Length = Schedule.GetLength().GetTotalMinutes();
+
+	Offset const StartTime = (Schedule.empty() ? Offset(8, 0, 0) : Schedule.front()->GetDesiredStartTime());
+	Offset const Time = StartTime + GetMinutes(Generator.GetInteger(-30, Length + 30));
+
+	long const Index = (Size != 0 ? Generator.GetInteger(0, Size - 1) : 0);
+	std::string const Number = std::to_string(Index + 1);
+
+	std::ostringstream Description;
+
+	switch (Size != 0 ? Generator.GetInteger(0, 10) : 8)
+	{
+	case 0:
+	{
+		Duration const NewLength = GetMinutes(Generator.GetInteger(0, 120));
+		(*GetActivity(Schedule, Index))->SetDesiredLength(NewLength);
+
+		Description << "set the desired length of " << Number << " to " << ToString(NewLength);
+		break;
+	}
+	case 1:
+	{
+		Activity &Changed = **GetActivity(Schedule, Index);
+		bool const Fixed = (Changed.GetLengthMode() == Activity::LengthMode::FREE);
+
+		Changed.SetLengthMode(Fixed ? Activity::LengthMode::FIXED : Activity::LengthMode::FREE);
+
+		Description << (Fixed ? "fixed" : "freed") << " the length of " << Number;
+		break;
+	}
+	case 2:
+	{
+		Activity &Changed = **GetActivity(Schedule, Index);
+
+		switch (Generator.GetInteger(0, 2))
+		{
+		case 0:
+			Changed.SetStartMode(Activity::StartMode::FREE);
+			Description << "freed the start of " << Number;
+			break;
+		case 1:
+			Changed.SetStartMode(Activity::StartMode::FIXED_ABSOLUTE);
+			Changed.SetDesiredStartTime(Time);
+			Description << "fixed the start of " << Number << " at " << ToString(Time);
+			break;
+		default:
+			Changed.SetStartMode(Activity::StartMode::FIXED_RELATIVE);
+			Changed.SetDesiredStartTime(Time - StartTime);
+			Description << "fixed the start of " << Number << " at +" << ToString(Time - StartTime);
+			break;
+		}
+		break;
+	}
+	case 3:
+		Schedule.BeginActivity(**GetActivity(Schedule, Index), Time);
+		Description << "began " << Number << " at " << ToString(Time);
+		break;
+	case 4:
+		Schedule.ClearBeginning(**GetActivity(Schedule, Index));
+		Description << "cleared the beginning of " << Number;
+		break;
+	case 5:
+	{
+		long const Before = Generator.GetInteger(0, Size - 1);
+
+		Activity * const Moved = *GetActivity(Schedule, Index);
+		Schedule.erase(GetActivity(Schedule, Index));
+		Schedule.insert(GetActivity(Schedule, Before), Moved);
+
+		Description << "moved " << Number << " to " << (Before + 1);
+		break;
+	}
+	case 6:
+	{
+		Duration const PauseLength = GetMinutes(Generator.GetInteger(1, 30));
+		bool const Added = Schedule.AddPause(Time, PauseLength);
+
+		Description << (Added ? "paused" : "failed to pause") << " for " << ToString(PauseLength) << " at " << ToString(Time);
+		break;
+	}
+	case 7:
+	{
+		if (Schedule.GetPauses().empty())
+		{
+			Description << "found no pause to remove";
+			break;
+		}
+
+		Offset const Start = std::next(Schedule.GetPauses().begin(),
+									   Generator.GetInteger(0, Schedule.GetPauses().size() - 1))->first;
+		Schedule.RemovePause(Start);
+
+		Description << "removed the pause at " << ToString(Start);
+		break;
+	}
+	case 8:
+	{
+		long const Before = Generator.GetInteger(0, Size);
+
+		Activity * const Added = new Activity;
+		Added->SetName("Added");
+		Added->SetDesiredLength(GetMinutes(Generator.GetInteger(1, 90)));
+
+		Schedule.insert(GetActivity(Schedule, Before), Added);
+
+		Description << "added an activity at " << (Before + 1);
+		break;
+	}
+	case 9:
+	{
+		Schedule::iterator const Removed = GetActivity(Schedule, Index);
+		Activity * const RemovedActivity = *Removed;
+
+		Schedule.erase(Removed);
+		delete RemovedActivity;
+
+		Description << "removed " << Number;
+		break;
+	}
+	default:
+	{
+		Duration const NewLength = GetMinutes(Generator.GetInteger(1, Length * 2 + 60));
+		Schedule.SetLength(NewLength);
+
+		Description << "set the schedule length to " << ToString(NewLength);
+		break;
+	}
+	}
+
+	return Description.str();
+}
@@ -0,0 +1,63 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEGENERATOR
+#define SCHEDULE_SCHEDULEGENERATOR
+
+#include <cstdint>
+#include <string>
+
+#include "Offset.hpp"
+#include "Schedule.hpp"
+
+namespace Schedule
+{
+	// Builds random schedules for benchmarking and testing.  The same parameters and seed always build the same
+	// schedule, on any platform, so a schedule can be reproduced from them alone.
+	class ScheduleGenerator
+	{
+	public:
+		struct Parameters
+		{
+			Parameters();
+
+			unsigned long	Activities;
+			Offset			StartTime;				// The first activity's start
+
+			// Fractions of the activities, from 0 to 1
+			double			FixedAbsolute;
+			double			FixedRelative;
+			double			FixedLength;
+			double			Begun;
+			double			ConflictingBeginnings;	// Of those begun, the fraction begun out of order or out of bounds
+
+			unsigned int	Pauses;
+			bool			ActivePause;
+
+			std::uint64_t	Seed;
+		};
+
+		static Schedule Generate(Parameters const &Parameters);
+
+		// Makes one random change to Schedule, of the kinds the command line makes, and returns a description of it
+		static std::string Edit(Schedule &Schedule, std::uint64_t Seed);
+	};
+}
+
+#endif
@@ -0,0 +1,262 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "Activity.hpp"
+#include "Schedule.hpp"
+#include "ScheduleFileIO.hpp"
+#include "ScheduleHistory.hpp"
+
+using namespace Schedule;
+
+// File format:
+//   Position Fingerprint
+//   S
+//   + Record
+//   - Inverse
+//   S
+//   ...
+// Position is the number of steps that can be undone; the steps after them can be redone.  Each step's records are
+// listed in the order they are applied.  Fingerprint is that of the schedule the file held when the history was saved.
+
+namespace
+{
+	// FNV-1a, over the bytes of each value in turn
+	class Hash
+	{
+	public:
+		Hash() :
+			Value(14695981039346656037ULL)
+		{
+
+		}
+
+		void Add(void const *Data, std::size_t Size)
+		{
+			for (std::size_t Index = 0; Index < Size; Index++)
+			{
+				this->Value ^= static_cast<unsigned char const *>(Data)[Index];
+				this->Value *= 1099511628211ULL;
+			}
+		}
+
+		void Add(long Number)					{ this->Add(&Number, sizeof(Number)); }
+		void Add(Offset const &Time)			{ this->Add(Time.GetTotalSeconds()); }
+		void Add(std::string const &String)		{ this->Add(static_cast<long>(String.size())); this->Add(String.data(), String.size()); }
+
+		std::uint64_t Value;
+	};
+}
+
+ScheduleHistory::ScheduleHistory(std::string const &FileName) :
+	FileName(FileName),
+	Loaded(false),
+	Position(0)
+{
+
+}
+
+
+void ScheduleHistory::Load(Schedule const &Current)
+{
+	if (this->Loaded)
+		return;
+
+	this->Loaded = true;
+
+	std::string const HistoryFileName = GetHistoryFileName(this->FileName);
+	std::ifstream Stream(HistoryFileName);
+
+	if (!Stream)
+		return;
+
+	std::string Fingerprint;
+
+	if (!(Stream >> this->Position >> Fingerprint) || Fingerprint != GetFingerprint(Current))
+	{
+		std::cerr << HistoryFileName << ": the schedule was changed without its history, so the history was discarded" <<
+					 std::endl;
+
+		this->Position = 0;
+		std::remove(HistoryFileName.c_str());
+		return;
+	}
+
+	std::string Line;
+	std::getline(Stream, Line);
+
+	while (std::getline(Stream, Line))
+	{
+		if (Line == "S")
+			this->Steps.push_back(Step());
+		else if (!this->Steps.empty() && Line.size() > 2 && (Line[0] == '+' || Line[0] == '-'))
+			(Line[0] == '+' ? this->Steps.back().Records : this->Steps.back().Inverse) += Line.substr(2) + "\n";
+	}
+
+	if (this->Position > this->Steps.size())
+		this->Position = this->Steps.size();
+}
+
+
+void ScheduleHistory::Push(std::string const &Records, std::string const &Inverse)
+{
+	this->Steps.resize(this->Position);
+
+	if (this->Steps.size() == MaximumDepth)
+		this->Steps.erase(this->Steps.begin());
+
+	Step const NewStep = { Records, Inverse };
+	this->Steps.push_back(NewStep);
+
+	this->Position = this->Steps.size();
+}
+
+
+bool ScheduleHistory::GetUndo(std::string &Records) const
+{
+	if (this->Position == 0)
+		return false;
+
+	Records = this->Steps[this->Position - 1].Inverse;
+	return true;
+}
+
+
+bool ScheduleHistory::GetRedo(std::string &Records) const
+{
+	if (this->Position == this->Steps.size())
+		return false;
+
+	Records = this->Steps[this->Position].Records;
+	return true;
+}
+
+
+void ScheduleHistory::Undone()	{ this->Position--; }
+void ScheduleHistory::Redone()	{ this->Position++; }
+
+
+bool ScheduleHistory::Save(Schedule const &Saved)
+{
+	if (!this->Loaded)
+		return true;
+
+	std::string const HistoryFileName = GetHistoryFileName(this->FileName);
+
+	if (this->Steps.empty())
+	{
+		std::remove(HistoryFileName.c_str());
+		return true;
+	}
+
+	std::ostringstream Stream;
+
+	Stream << this->Position << " " << GetFingerprint(Saved) << "\n";
+
+	for (auto &CurrentStep : this->Steps)
+	{
+		Stream << "S\n";
+
+		for (std::string::size_type Start = 0; Start < CurrentStep.Records.size(); )
+		{
+			std::string::size_type const End = CurrentStep.Records.find('\n', Start);
+			Stream << "+ " << CurrentStep.Records.substr(Start, End - Start + 1);
+			Start = End + 1;
+		}
+
+		for (std::string::size_type Start = 0; Start < CurrentStep.Inverse.size(); )
+		{
+			std::string::size_type const End = CurrentStep.Inverse.find('\n', Start);
+			Stream << "- " << CurrentStep.Inverse.substr(Start, End - Start + 1);
+			Start = End + 1;
+		}
+	}
+
+	return ScheduleFileIO::WriteFile(Stream.str(), HistoryFileName, std::cerr);
+}
+
+
+void ScheduleHistory::AddMemoryUsage(ScheduleMemory &Usage) const
+{
+	Usage.AddString(Usage.Journal, this->FileName);
+
+	if (this->Steps.capacity() != 0)
+	{
+		Usage.Journal += this->Steps.capacity() * sizeof(Step);
+		Usage.Allocations++;
+	}
+
+	for (auto &Current : this->Steps)
+	{
+		Usage.AddString(Usage.Journal, Current.Records);
+		Usage.AddString(Usage.Journal, Current.Inverse);
+	}
+}
+
+
+std::string ScheduleHistory::GetHistoryFileName(std::string const &FileName) { return FileName + ".history"; }
+
+
+std::string ScheduleHistory::GetFingerprint(Schedule const &Schedule)
+{
+	// An empty name isn't written, so it is read back as the default
+	static std::string const DefaultName = Activity().GetName();
+
+	Hash Fingerprint;
+
+	Fingerprint.Add(Schedule.GetLength());
+
+	for (auto Current : Schedule)
+	{
+		Fingerprint.Add(!Current->GetName().empty() ? Current->GetName() : DefaultName);
+		Fingerprint.Add(static_cast<long>(Current->GetStartMode()));
+		Fingerprint.Add(Current->GetDesiredStartTime());
+		Fingerprint.Add(static_cast<long>(Current->GetLengthMode()));
+		Fingerprint.Add(Current->GetDesiredLength());
+
+		Offset const *Beginning = Current->GetBeginning();
+		Fingerprint.Add(Beginning != nullptr ? 1L : 0L);
+
+		if (Beginning != nullptr)
+			Fingerprint.Add(*Beginning);
+	}
+
+	for (auto &Pause : Schedule.GetPauses())
+	{
+		Fingerprint.Add(Pause.first);
+		Fingerprint.Add(Pause.second);
+	}
+
+	Offset const *ActivePause = Schedule.GetActivePause();
+	Fingerprint.Add(ActivePause != nullptr ? 1L : 0L);
+
+	if (ActivePause != nullptr)
+		Fingerprint.Add(*ActivePause);
+
+	std::ostringstream Formatted;
+	Formatted << std::hex << std::setw(16) << std::setfill('0') << Fingerprint.Value;
+
+	return Formatted.str();
+}
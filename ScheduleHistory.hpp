@@ -0,0 +1,84 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEHISTORY
+#define SCHEDULE_SCHEDULEHISTORY
+
+#include <string>
+#include <vector>
+
+#include "ScheduleMemory.hpp"
+
+namespace Schedule
+{
+	class Schedule;
+
+	// The undo and redo stacks of a schedule file, kept in a sidecar next to it.  Each step holds the journal records
+	// that made its changes and the records that reverse them, so the history grows with the edits made rather than
+	// with the size of the schedule.  Records find activities by index, so the history also keeps a fingerprint of
+	// the schedule it was saved with, and is only used with that schedule.
+	class ScheduleHistory
+	{
+	public:
+		ScheduleHistory(std::string const &FileName);
+		~ScheduleHistory() { }
+
+		// Reads the history saved next to the file, unless it was saved with a schedule other than Current, which
+		// means the file was changed without it.  Such a history is discarded.
+		void Load(Schedule const &Current);
+
+		// Adds a step to undo.  Any steps that were undone can no longer be redone.
+		void Push(std::string const &Records, std::string const &Inverse);
+
+		// Get the records that undo or redo the next step.  Return false if there is no such step.
+		bool GetUndo(std::string &Records) const;
+		bool GetRedo(std::string &Records) const;
+		// Move past the next step, once its records have been applied
+		void Undone();
+		void Redone();
+
+		// Saved is the schedule as its file now holds it
+		bool Save(Schedule const &Saved);
+
+		// Adds the steps held in memory to Usage's journal
+		void AddMemoryUsage(ScheduleMemory &Usage) const;
+
+		static std::string GetHistoryFileName(std::string const &FileName);
+
+		// A hash of everything a schedule's file keeps of it
+		static std::string GetFingerprint(Schedule const &Schedule);
+
+		// Older steps are forgotten
+		static unsigned int const MaximumDepth = 100;
+
+	private:
+		struct Step
+		{
+			std::string Records;
+			std::string Inverse;
+		};
+
+		std::string			FileName;
+		bool				Loaded;
+		std::vector<Step>	Steps;
+		std::size_t			Position;	// The number of steps that can be undone
+	};
+}
+
+#endif
@@ -0,0 +1,629 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "ScheduleFileIO.hpp"
+#include "ScheduleJournal.hpp"
+#include "ScheduleSnapshot.hpp"
+
+using namespace Schedule;
+
+// Record format, one per line, after a first line of
+//   G Generation	(of the snapshot the log extends)
+//
+//   I Index StartMode LengthMode Start Length Name
+//   M Index StartMode LengthMode Start Length Name
+//   V MoveIndex BeforeIndex
+//   E Index
+//   B Index Beginning
+//   C Index
+//   L Length
+//   P Time
+//   R Time
+//   U				(cancels the active pause)
+//   A Start Length	(adds a finished pause)
+//   D Start		(removes a finished pause)
+//   X
+// Times are stored as total seconds.  Names run to the end of the line, with backslashes and newlines escaped.
+
+namespace
+{
+	std::string EscapeName(std::string const &Name)
+	{
+		std::string Result;
+
+		for (char Character : Name)
+		{
+			if (Character == '\\')
+				Result += "\\\\";
+			else if (Character == '\n')
+				Result += "\\n";
+			else
+				Result += Character;
+		}
+
+		return Result;
+	}
+
+
+	std::string UnescapeName(std::string const &Name)
+	{
+		std::string Result;
+
+		for (std::string::const_iterator Character = Name.begin(); Character != Name.end(); ++Character)
+		{
+			if (*Character == '\\' && Character + 1 != Name.end())
+			{
+				++Character;
+				Result += (*Character == 'n' ? '\n' : *Character);
+			}
+			else
+				Result += *Character;
+		}
+
+		return Result;
+	}
+
+
+	Schedule::Schedule::iterator GetActivityIterator(Schedule::Schedule &Schedule, unsigned int Index)
+	{
+		Schedule::Schedule::iterator Result = Schedule.begin();
+		std::advance(Result, Index - 1);
+		return Result;
+	}
+
+
+	bool ReadActivityRecord(std::istringstream &Stream, Activity &Activity)
+	{
+		int StartMode;
+		int LengthMode;
+		long Start;
+		long Length;
+
+		if ((Stream >> StartMode >> LengthMode >> Start >> Length).fail() ||
+			StartMode < 0 || StartMode > 2 || LengthMode < 0 || LengthMode > 1)
+		{
+			return false;
+		}
+
+		std::string Name;
+		Stream.get();
+		std::getline(Stream, Name);
+
+		Activity.SetName(UnescapeName(Name));
+		Activity.SetStartMode(static_cast<Activity::StartMode>(StartMode));
+		Activity.SetLengthMode(static_cast<Activity::LengthMode>(LengthMode));
+		Activity.SetDesiredStartTime(Offset(0, 0, Start));
+		Activity.SetDesiredLength(Duration(0, 0, Length));
+
+		return true;
+	}
+}
+
+
+ScheduleJournal::ScheduleJournal(std::string const &FileName, Schedule const &Current) :
+	FileName(FileName),
+	CompactionThreshold(DefaultCompactionThreshold),
+	History(FileName)
+{
+	if (!FileName.empty())
+		this->History.Load(Current);
+}
+
+
+void ScheduleJournal::Insert(unsigned int Index, Activity const &Inserted)
+{
+	std::ostringstream Inverse;
+	Inverse << "E " << Index << "\n";
+
+	this->AddRecord(GetActivityRecord('I', Index, Inserted), Inverse.str());
+}
+
+
+void ScheduleJournal::Modify(unsigned int Index, Activity const &Previous, Activity const &Modified)
+{
+	this->AddRecord(GetActivityRecord('M', Index, Modified), GetActivityRecord('M', Index, Previous));
+}
+
+
+void ScheduleJournal::Move(unsigned int MoveIndex, unsigned int BeforeIndex, unsigned int Size)
+{
+	std::ostringstream Stream;
+	Stream << "V " << MoveIndex << " " << BeforeIndex << "\n";
+
+	// Where the activity ended up
+	unsigned int const Position = (MoveIndex == BeforeIndex ? Size : (BeforeIndex > MoveIndex ? BeforeIndex - 1 : BeforeIndex));
+
+	// Move it back before the activity that followed it, or to the end if it was last
+	std::ostringstream Inverse;
+	if (Position != MoveIndex)
+	{
+		unsigned int const Before = (MoveIndex == Size ? Position : (Position < MoveIndex ? MoveIndex + 1 : MoveIndex));
+		Inverse << "V " << Position << " " << Before << "\n";
+	}
+
+	this->AddRecord(Stream.str(), Inverse.str());
+}
+
+
+void ScheduleJournal::Erase(unsigned int Index, Activity const &Erased)
+{
+	std::ostringstream Stream;
+	Stream << "E " << Index << "\n";
+
+	std::ostringstream Inverse;
+	Inverse << GetActivityRecord('I', Index, Erased);
+
+	if (Offset const *Beginning = Erased.GetBeginning())
+		Inverse << "B " << Index << " " << Beginning->GetTotalSeconds() << "\n";
+
+	this->AddRecord(Stream.str(), Inverse.str());
+}
+
+
+void ScheduleJournal::Begin(unsigned int Index, Offset const *Previous, Offset const &Beginning)
+{
+	std::ostringstream Stream;
+	Stream << "B " << Index << " " << Beginning.GetTotalSeconds() << "\n";
+
+	std::ostringstream Inverse;
+	if (Previous != nullptr)
+		Inverse << "B " << Index << " " << Previous->GetTotalSeconds() << "\n";
+	else
+		Inverse << "C " << Index << "\n";
+
+	this->AddRecord(Stream.str(), Inverse.str());
+}
+
+
+void ScheduleJournal::ClearBeginning(unsigned int Index, Offset const &Previous)
+{
+	std::ostringstream Stream;
+	Stream << "C " << Index << "\n";
+
+	std::ostringstream Inverse;
+	Inverse << "B " << Index << " " << Previous.GetTotalSeconds() << "\n";
+
+	this->AddRecord(Stream.str(), Inverse.str());
+}
+
+
+void ScheduleJournal::SetLength(Duration const &Previous, Duration const &Length)
+{
+	std::ostringstream Stream;
+	Stream << "L " << Length.GetTotalSeconds() << "\n";
+
+	std::ostringstream Inverse;
+	Inverse << "L " << Previous.GetTotalSeconds() << "\n";
+
+	this->AddRecord(Stream.str(), Inverse.str());
+}
+
+
+void ScheduleJournal::Pause(Offset const &Time)
+{
+	std::ostringstream Stream;
+	Stream << "P " << Time.GetTotalSeconds() << "\n";
+
+	this->AddRecord(Stream.str(), "U\n");
+}
+
+
+void ScheduleJournal::Resume(Offset const &PauseStart, Offset const &Time)
+{
+	std::ostringstream Stream;
+	Stream << "R " << Time.GetTotalSeconds() << "\n";
+
+	std::ostringstream Inverse;
+	Inverse << "D " << PauseStart.GetTotalSeconds() << "\n" <<
+			   "P " << PauseStart.GetTotalSeconds() << "\n";
+
+	this->AddRecord(Stream.str(), Inverse.str());
+}
+
+
+void ScheduleJournal::ClearPauses(PauseList const &Previous, Offset const *PreviousActivePause)
+{
+	std::ostringstream Inverse;
+
+	for (auto &Pause : Previous)
+		Inverse << "A " << Pause.first.GetTotalSeconds() << " " << Pause.second.GetTotalSeconds() << "\n";
+
+	if (PreviousActivePause != nullptr)
+		Inverse << "P " << PreviousActivePause->GetTotalSeconds() << "\n";
+
+	this->AddRecord("X\n", Inverse.str());
+}
+
+
+bool ScheduleJournal::IsEmpty() const { return this->Pending.empty(); }
+
+
+unsigned long	ScheduleJournal::GetCompactionThreshold() const						{ return this->CompactionThreshold; }
+void			ScheduleJournal::SetCompactionThreshold(unsigned long Threshold)	{ this->CompactionThreshold = Threshold; }
+
+
+bool ScheduleJournal::Commit(Schedule const &Schedule)
+{
+	if (this->Pending.empty())
+		return true;
+
+	// A log without a snapshot to replay it over, or extending a snapshot that has since been replaced, is folded
+	// immediately.  The latter is left by a save whose fsyncs were deferred, until they are performed, or by one that
+	// stopped before it removed the log.
+	std::string Generation;
+	std::string BaseGeneration;
+
+	bool const Snapshotted = ScheduleFileIO::GetGeneration(this->FileName, Generation);
+
+	if (Snapshotted && GetBaseGeneration(this->FileName, BaseGeneration) && BaseGeneration != Generation)
+		ScheduleFileIO::Sync();
+
+	bool const Folding = (!Snapshotted ||
+						  (GetBaseGeneration(this->FileName, BaseGeneration) && BaseGeneration != Generation));
+
+	if (Folding)
+	{
+		this->Pending.clear();
+		return ScheduleFileIO::Write(Schedule, this->FileName);
+	}
+
+	std::streamoff JournalSize;
+	{
+		std::ofstream Stream(GetJournalFileName(this->FileName), std::ios::out | std::ios::app | std::ios::ate);
+
+		if (Stream.tellp() == 0)
+			Stream << "G " << Generation << "\n";
+
+		if (!(Stream << this->Pending).flush())
+		{
+			std::cerr << GetJournalFileName(this->FileName) << ": cannot append to journal" << std::endl;
+			return false;
+		}
+
+		JournalSize = Stream.tellp();
+	}
+
+	this->Pending.clear();
+
+	// Fold the log back into the snapshot.  Writing the snapshot retires the log once it is on the disk.
+	if (JournalSize < 0 || static_cast<unsigned long>(JournalSize) > this->CompactionThreshold)
+		return ScheduleFileIO::Write(Schedule, this->FileName);
+
+	return true;
+}
+
+
+bool ScheduleJournal::CommitHistory(Schedule const &Saved)
+{
+	if (this->FileName.empty())
+		return true;
+
+	this->PushStep();
+
+	return this->History.Save(Saved);
+}
+
+
+bool ScheduleJournal::CanUndo() const
+{
+	std::string Records;
+
+	return !this->FileName.empty() && (!this->Step.empty() || this->History.GetUndo(Records));
+}
+
+
+bool ScheduleJournal::CanRedo() const
+{
+	std::string Records;
+
+	return !this->FileName.empty() && this->Step.empty() && this->History.GetRedo(Records);
+}
+
+
+void ScheduleJournal::AddMemoryUsage(ScheduleMemory &Usage) const
+{
+	Usage.AddString(Usage.Journal, this->FileName);
+	Usage.AddString(Usage.Journal, this->Pending);
+	Usage.AddString(Usage.Journal, this->Step);
+	Usage.AddString(Usage.Journal, this->StepInverse);
+
+	this->History.AddMemoryUsage(Usage);
+}
+
+
+unsigned int ScheduleJournal::Undo(Schedule &Schedule, unsigned int Count)
+{
+	if (this->FileName.empty())
+		return 0;
+
+	// Changes not yet in the history are undone first
+	this->PushStep();
+
+	unsigned int Taken;
+	std::string Records;
+
+	for (Taken = 0; Taken < Count && this->History.GetUndo(Records); Taken++)
+	{
+		if (!this->ApplyStep(Schedule, Records, "undo"))
+			break;
+
+		this->History.Undone();
+		this->Pending += Records;
+	}
+
+	return Taken;
+}
+
+
+unsigned int ScheduleJournal::Redo(Schedule &Schedule, unsigned int Count)
+{
+	if (this->FileName.empty())
+		return 0;
+
+	this->PushStep();
+
+	unsigned int Taken;
+	std::string Records;
+
+	for (Taken = 0; Taken < Count && this->History.GetRedo(Records); Taken++)
+	{
+		if (!this->ApplyStep(Schedule, Records, "redo"))
+			break;
+
+		this->History.Redone();
+		this->Pending += Records;
+	}
+
+	return Taken;
+}
+
+
+std::string ScheduleJournal::GetJournalFileName(std::string const &FileName) { return FileName + ".journal"; }
+
+
+bool ScheduleJournal::GetBaseGeneration(std::string const &FileName, std::string &Generation)
+{
+	std::ifstream Journal(GetJournalFileName(FileName));
+
+	if (!Journal)
+		return false;
+
+	std::string Header;
+	std::getline(Journal, Header);
+
+	Generation = (Header.compare(0, 2, "G ") == 0 ? Header.substr(2) : std::string());
+	return true;
+}
+
+
+bool ScheduleJournal::Replay(Schedule &Schedule, std::string const &FileName, std::string const &Generation)
+{
+	std::ifstream Journal(GetJournalFileName(FileName));
+
+	if (!Journal)
+		return true;
+
+	std::string Record;
+
+	// Logs from before generations were kept start with a record
+	if (!std::getline(Journal, Record))
+		return true;
+
+	if (Record.compare(0, 2, "G ") == 0)
+	{
+		if (Record.substr(2) != Generation)
+			return true;
+	}
+	else if (!Generation.empty())
+		return true;
+	else if (!Apply(Schedule, Record))
+		return false;
+
+	while (std::getline(Journal, Record))
+	{
+		if (!Apply(Schedule, Record))
+			return false;
+	}
+
+	return true;
+}
+
+
+bool ScheduleJournal::Apply(Schedule &Schedule, std::string const &Record)
+{
+	std::istringstream Stream(Record);
+
+	char Type;
+	if ((Stream >> Type).fail())
+		return true;
+
+	if (Type == 'L')
+	{
+		long Length;
+		if ((Stream >> Length).fail())
+			return false;
+
+		Schedule.SetLength(Duration(0, 0, Length));
+		return true;
+	}
+
+	if (Type == 'P' || Type == 'R' || Type == 'D')
+	{
+		long Time;
+		if ((Stream >> Time).fail())
+			return false;
+
+		return (Type == 'P' ? Schedule.Pause(Offset(0, 0, Time)) :
+			   (Type == 'R' ? Schedule.Resume(Offset(0, 0, Time)) :
+							  Schedule.RemovePause(Offset(0, 0, Time))));
+	}
+
+	if (Type == 'A')
+	{
+		long Start;
+		long Length;
+		if ((Stream >> Start >> Length).fail())
+			return false;
+
+		return Schedule.AddPause(Offset(0, 0, Start), Duration(0, 0, Length));
+	}
+
+	if (Type == 'U')
+		return Schedule.CancelPause();
+
+	if (Type == 'X')
+	{
+		Schedule.ClearPauses();
+		return true;
+	}
+
+	unsigned int Index;
+	if ((Stream >> Index).fail() || Index == 0)
+		return false;
+
+	if (Type == 'I')
+	{
+		if (Index > Schedule.size() + 1)
+			return false;
+
+		Activity *NewActivity = new Activity;
+		if (!ReadActivityRecord(Stream, *NewActivity))
+		{
+			delete NewActivity;
+			return false;
+		}
+
+		Schedule.insert(GetActivityIterator(Schedule, Index), NewActivity);
+		return true;
+	}
+
+	if (Index > Schedule.size())
+		return false;
+
+	Schedule::Schedule::iterator ActivityIterator = GetActivityIterator(Schedule, Index);
+
+	if (Type == 'M')
+		return ReadActivityRecord(Stream, **ActivityIterator);
+
+	if (Type == 'V')
+	{
+		unsigned int BeforeIndex;
+		if ((Stream >> BeforeIndex).fail() || BeforeIndex == 0 || BeforeIndex > Schedule.size())
+			return false;
+
+		Schedule::Schedule::iterator BeforeIterator = GetActivityIterator(Schedule, BeforeIndex);
+
+		Activity * const MoveActivity = *ActivityIterator;
+		Schedule.erase(ActivityIterator);
+
+		if (Index == BeforeIndex)
+			Schedule.push_back(MoveActivity);
+		else
+			Schedule.insert(BeforeIterator, MoveActivity);
+	}
+	else if (Type == 'E')
+	{
+		Activity * const EraseActivity = *ActivityIterator;
+		Schedule.erase(ActivityIterator);
+		delete EraseActivity;
+	}
+	else if (Type == 'B')
+	{
+		long Beginning;
+		if ((Stream >> Beginning).fail())
+			return false;
+
+		Schedule.BeginActivity(**ActivityIterator, Offset(0, 0, Beginning));
+	}
+	else if (Type == 'C')
+		Schedule.ClearBeginning(**ActivityIterator);
+	else
+		return false;
+
+	return true;
+}
+
+
+void ScheduleJournal::AddRecord(std::string const &Record, std::string const &Inverse)
+{
+	this->Pending += Record;
+	this->Step += Record;
+	this->StepInverse.insert(0, Inverse);
+}
+
+
+void ScheduleJournal::PushStep()
+{
+	if (this->Step.empty())
+		return;
+
+	this->History.Push(this->Step, this->StepInverse);
+
+	this->Step.clear();
+	this->StepInverse.clear();
+}
+
+
+bool ScheduleJournal::ApplyStep(Schedule &Schedule, std::string const &Records, char const *Action) const
+{
+	// Tried on a copy first, so that a step that can't be applied leaves the schedule as it was
+	{
+		::Schedule::Schedule Trial(Schedule.GetSnapshot());
+
+		std::istringstream Stream(Records);
+		std::string Record;
+
+		while (std::getline(Stream, Record))
+		{
+			if (!Apply(Trial, Record))
+			{
+				std::cerr << ScheduleHistory::GetHistoryFileName(this->FileName) << ": cannot " << Action << " " << Record <<
+							 std::endl;
+				return false;
+			}
+		}
+	}
+
+	std::istringstream Stream(Records);
+	std::string Record;
+
+	while (std::getline(Stream, Record))
+		Apply(Schedule, Record);
+
+	return true;
+}
+
+
+std::string ScheduleJournal::GetActivityRecord(char Type, unsigned int Index, Activity const &Activity)
+{
+	std::ostringstream Stream;
+
+	Stream << Type << " " << Index << " " <<
+			  static_cast<int>(Activity.GetStartMode()) << " " <<
+			  static_cast<int>(Activity.GetLengthMode()) << " " <<
+			  Activity.GetDesiredStartTime().GetTotalSeconds() << " " <<
+			  Activity.GetDesiredLength().GetTotalSeconds() << " " <<
+			  EscapeName(Activity.GetName()) << "\n";
+
+	return Stream.str();
+}
@@ -0,0 +1,118 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEJOURNAL
+#define SCHEDULE_SCHEDULEJOURNAL
+
+#include <string>
+
+#include "Activity.hpp"
+#include "Offset.hpp"
+#include "Schedule.hpp"
+#include "ScheduleHistory.hpp"
+
+namespace Schedule
+{
+	// Records mutations of a schedule as compact operation records, to be appended to a sidecar log next to the
+	// schedule file instead of rewriting the whole file.  Indices are 1-based, as displayed by the command line.
+	// The records that would undo each mutation are kept too, and handed to the schedule's history by
+	// CommitHistory.  Mutations are described after they are made, along with what they replaced.
+	class ScheduleJournal
+	{
+	public:
+		// Current is the schedule as read from FileName, which its history must have been saved with
+		ScheduleJournal(std::string const &FileName, Schedule const &Current);
+		~ScheduleJournal() { }
+
+		// The activity now at Index was inserted there
+		void Insert(unsigned int Index, Activity const &Inserted);
+		// The desired attributes of the activity at Index were changed from those of Previous
+		void Modify(unsigned int Index, Activity const &Previous, Activity const &Modified);
+		// Mirrors the move command: if MoveIndex equals BeforeIndex, the activity was moved to the end.  Size is the
+		// number of activities in the schedule.
+		void Move(unsigned int MoveIndex, unsigned int BeforeIndex, unsigned int Size);
+		// Erased is the activity that was at Index.  Call this before deleting it.
+		void Erase(unsigned int Index, Activity const &Erased);
+		void Begin(unsigned int Index, Offset const *Previous, Offset const &Beginning);
+		void ClearBeginning(unsigned int Index, Offset const &Previous);
+		void SetLength(Duration const &Previous, Duration const &Length);
+		void Pause(Offset const &Time);
+		// PauseStart is when the pause ended at Time began
+		void Resume(Offset const &PauseStart, Offset const &Time);
+		void ClearPauses(PauseList const &Previous, Offset const *PreviousActivePause);
+
+		bool	IsEmpty() const;
+
+		// Once the log grows past this many bytes, Commit folds it back into a snapshot
+		unsigned long	GetCompactionThreshold() const;
+		void			SetCompactionThreshold(unsigned long Threshold);
+
+		// Appends the pending records to the log, compacting it into a full write of Schedule if it has grown past
+		// the compaction threshold.  Schedule must be the result of applying the pending records.  A log left from a
+		// snapshot since replaced is never appended to; Schedule is written in full instead.
+		bool Commit(Schedule const &Schedule);
+
+		// Adds the mutations described since the last call to the history as one step that can be undone, and saves
+		// the history.  Saved is the schedule as its file now holds it.  Does nothing if the journal has no file name.
+		bool CommitHistory(Schedule const &Saved);
+
+		// Adds the pending records and the history held in memory to Usage's journal
+		void AddMemoryUsage(ScheduleMemory &Usage) const;
+
+		// Undo or redo up to Count steps of the history, logging what was applied.  Returns the number of steps taken.
+		// A step that can't be applied is left in place, and stops the rest.  The history is saved by CommitHistory.
+		unsigned int Undo(Schedule &Schedule, unsigned int Count);
+		unsigned int Redo(Schedule &Schedule, unsigned int Count);
+		bool CanUndo() const;
+		bool CanRedo() const;
+
+		static std::string	GetJournalFileName(std::string const &FileName);
+
+		// Each log begins with the generation of the snapshot it extends.  Gets that of FileName's log, or returns
+		// false if there is none.  Logs written before generations were kept extend snapshots without one.
+		static bool			GetBaseGeneration(std::string const &FileName, std::string &Generation);
+
+		// Applies the records logged for FileName to Schedule, whose snapshot has the given generation.  A log that
+		// extends another snapshot has already been folded into this one, and is skipped.  Stops at the first
+		// malformed record.
+		static bool			Replay(Schedule &Schedule, std::string const &FileName, std::string const &Generation);
+		// Applies one record
+		static bool			Apply(Schedule &Schedule, std::string const &Record);
+
+		static unsigned long const DefaultCompactionThreshold = 64 * 1024;
+
+	private:
+		void AddRecord(std::string const &Record, std::string const &Inverse);
+		void PushStep();
+		// Applies a step's records, unless any of them can't be.  Action names the step in errors.
+		bool ApplyStep(Schedule &Schedule, std::string const &Records, char const *Action) const;
+
+		static std::string GetActivityRecord(char Type, unsigned int Index, Activity const &Activity);
+
+		std::string		FileName;
+		std::string		Pending;
+		unsigned long	CompactionThreshold;
+
+		ScheduleHistory	History;
+		std::string		Step;			// The records of the mutations since the last CommitHistory
+		std::string		StepInverse;	// The records that undo them, newest first
+	};
+}
+
+#endif
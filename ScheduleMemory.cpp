@@ -0,0 +1,54 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include "ScheduleMemory.hpp"
+
+using namespace Schedule;
+
+ScheduleMemory::ScheduleMemory() :
+	Activities(0),
+	Names(0),
+	Beginnings(0),
+	Nodes(0),
+	Caches(0),
+	State(0),
+	Journal(0),
+	Allocations(0)
+{
+
+}
+
+
+std::size_t ScheduleMemory::GetTotal() const
+{
+	return this->Activities + this->Names + this->Beginnings + this->Nodes + this->Caches + this->State + this->Journal;
+}
+
+
+void ScheduleMemory::AddString(std::size_t &Bytes, std::string const &String)
+{
+	// An empty string's capacity is what fits inside the string itself
+	static std::string::size_type const InternalCapacity = std::string().capacity();
+
+	if (String.capacity() > InternalCapacity)
+	{
+		Bytes += String.capacity() + 1;
+		this->Allocations++;
+	}
+}
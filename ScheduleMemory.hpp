@@ -0,0 +1,61 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEMEMORY
+#define SCHEDULE_SCHEDULEMEMORY
+
+#include <cstddef>
+#include <string>
+
+namespace Schedule
+{
+	// The heap memory held by a schedule, by what holds it.  Sizes are those asked of the allocator, not counting its
+	// own overhead, which the number of allocations gives a sense of.  Container nodes and shared pointer control
+	// blocks are sized as libstdc++ lays them out.
+	struct ScheduleMemory
+	{
+		ScheduleMemory();
+
+		std::size_t	Activities;		// The activity objects, including the schedule's hidden end
+		std::size_t	Names;			// Names too long to be kept inside their activities
+		std::size_t	Beginnings;
+		std::size_t	Nodes;			// The nodes of the activity and pause lists
+		std::size_t	Caches;			// The cached snapshot and the published layout, counting what they share once
+		std::size_t	State;			// The schedule's own bookkeeping
+		std::size_t	Journal;		// Journal records and undo history, when a journal is counted too
+		std::size_t	Allocations;
+
+		std::size_t GetTotal() const;
+
+		// Adds the size of String's buffer to Bytes, unless the string is short enough to be kept inside itself
+		void AddString(std::size_t &Bytes, std::string const &String);
+
+		// The size of a node of a std::list or std::map of T
+		template <typename T>
+		static std::size_t GetListNodeSize() { return 2 * sizeof(void *) + sizeof(T); }
+
+		template <typename T>
+		static std::size_t GetMapNodeSize() { return 4 * sizeof(void *) + sizeof(T); }
+
+		// The size of the control block std::make_shared allocates along with the object
+		static std::size_t const SharedOverhead = sizeof(void *) + 2 * sizeof(int);
+	};
+}
+
+#endif
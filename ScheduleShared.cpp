@@ -0,0 +1,506 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Activity.hpp"
+#include "ScheduleShared.hpp"
+
+using namespace Schedule;
+
+namespace
+{
+	std::uint32_t const SharedMagic = 0x53434844;	// "SCHD"
+	std::uint32_t const SharedVersion = 1;
+
+	// Readers give up on a publisher that seems to have stopped part way through writing
+	int const ReadAttempts = 10000;
+
+	// Times are seconds since midnight.  Indices equal to Size mean there is no such activity.
+	struct SharedHeader
+	{
+		std::atomic<std::uint32_t>	Sequence;		// Odd while the publisher writes
+
+		std::uint32_t	Magic;
+		std::uint32_t	Version;
+		std::uint32_t	Capacity;		// The rows the segment has room for
+		std::uint32_t	Size;
+		std::uint32_t	Current;
+		std::uint32_t	Next;
+		std::int32_t	Boundary;		// -1 if nothing is to come
+		std::int64_t	Published;
+	};
+
+	struct SharedRow
+	{
+		std::int32_t	StartTime;
+		std::int32_t	EndTime;
+		char			Name[ScheduleShared::MaximumNameLength + 1];
+	};
+
+	static_assert(ATOMIC_INT_LOCK_FREE == 2, "the sequence must be lock free to be shared between processes");
+
+
+	std::size_t GetSegmentSize(std::size_t Rows)
+	{
+		return sizeof(SharedHeader) + Rows * sizeof(SharedRow);
+	}
+
+
+	void SetRow(ScheduleShared::Row &Set, Schedule::Schedule::size_type Index, SharedRow const &From)
+	{
+		Set.Index = Index;
+		Set.Name.assign(From.Name, strnlen(From.Name, sizeof(From.Name)));
+		Set.StartTime = Offset(0, 0, From.StartTime);
+		Set.EndTime = Offset(0, 0, From.EndTime);
+	}
+
+
+	void SetRow(ScheduleShared::Row &Set, Schedule::Schedule::size_type Index, Activity const &From)
+	{
+		Set.Index = Index;
+		Set.Name = From.GetName().substr(0, ScheduleShared::MaximumNameLength);
+		Set.StartTime = From.GetActualStartTime();
+		Set.EndTime = From.GetActualEndTime();
+	}
+
+
+	// Whether a live publisher holds the segment Name.  One that can't be opened belongs to someone else, and is
+	// treated as published.
+	bool IsPublished(std::string const &Name)
+	{
+		int const Descriptor = shm_open(Name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+
+		if (Descriptor < 0)
+			return (errno != ENOENT);
+
+		bool const Locked = (flock(Descriptor, LOCK_EX | LOCK_NB) != 0 && errno == EWOULDBLOCK);
+		close(Descriptor);
+
+		return Locked;
+	}
+
+
+	// Copies what is under way at Now out of Count rows, using Current if it is still under way, and returns false if
+	// the rows don't bear each other out.  What a reader copies may be torn, so nothing is trusted until the sequence
+	// shows it wasn't; until then, it must only be kept in bounds.
+	bool FindStatus(SharedRow const *Rows, std::uint32_t Count, std::uint32_t Current, std::uint32_t Next,
+					std::int32_t Now, ScheduleShared::Status &Found)
+	{
+		if (Current >= Count || Rows[Current].StartTime > Now || Now >= Rows[Current].EndTime)
+		{
+			for (Current = 0; Current < Count; Current++)
+			{
+				if (Rows[Current].StartTime <= Now && Now < Rows[Current].EndTime)
+					break;
+			}
+
+			if (Current < Count)
+				Next = Current + 1;
+			else
+			{
+				for (Next = 0; Next < Count && Rows[Next].StartTime <= Now; Next++) { }
+			}
+		}
+
+		if (Next > Count)
+			return false;
+
+		Found.Size = Count;
+		Found.Current = ScheduleShared::Row();
+		Found.Next = ScheduleShared::Row();
+		Found.Current.Index = Current;
+		Found.Next.Index = Next;
+
+		if (Current < Count)
+			SetRow(Found.Current, Current, Rows[Current]);
+
+		if (Next < Count)
+			SetRow(Found.Next, Next, Rows[Next]);
+
+		Found.HasBoundary = (Current < Count || Next < Count);
+
+		if (Found.HasBoundary)
+			Found.Boundary = (Current < Count ? Found.Current.EndTime : Found.Next.StartTime);
+
+		return true;
+	}
+
+
+	// The activity to come after Current, which is under way at Now unless it is Watched.size()
+	Schedule::Schedule::size_type GetNext(Schedule::Schedule const &Watched, Schedule::Schedule::size_type Current,
+										  Offset const &Now)
+	{
+		if (Current < Watched.size())
+			return Current + 1;
+
+		Schedule::Schedule::size_type Next = 0;
+
+		for (auto Upcoming : Watched)
+		{
+			if (Now < Upcoming->GetActualStartTime())
+				break;
+
+			Next++;
+		}
+
+		return Next;
+	}
+}
+
+std::string::size_type const ScheduleShared::MaximumNameLength;
+
+struct Schedule::ScheduleShared::Implementation
+{
+	Implementation(std::string const &Name) :
+		Name(Name),
+		Descriptor(-1),
+		Mapping(MAP_FAILED),
+		Capacity(0)
+	{
+
+	}
+
+	std::string		Name;
+	int				Descriptor;
+	void		   *Mapping;
+	std::uint32_t	Capacity;
+
+	SharedHeader &GetHeader() { return *static_cast<SharedHeader *>(this->Mapping); }
+	SharedRow *GetRows() { return reinterpret_cast<SharedRow *>(static_cast<char *>(this->Mapping) + sizeof(SharedHeader)); }
+
+	bool Reserve(Schedule::size_type Rows);
+	void Write(SharedRow &Written, Activity const &From);
+};
+
+
+ScheduleShared::Row::Row() :
+	Index(0)
+{
+
+}
+
+
+ScheduleShared::Status::Status() :
+	Published(0),
+	Size(0),
+	HasBoundary(false)
+{
+
+}
+
+
+ScheduleShared::ScheduleShared(std::string const &Name) :
+	Data(new Implementation(Name))
+{
+	// The publisher holds a lock on its segment until it stops.  A segment left behind by a publisher that died is
+	// replaced, rather than written over under its readers; one that is still published is left alone.
+	for (int Attempt = 0; Attempt < 2; Attempt++)
+	{
+		this->Data->Descriptor = shm_open(Name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+
+		if (this->Data->Descriptor >= 0 || errno != EEXIST)
+			break;
+
+		if (IsPublished(Name))
+		{
+			std::cerr << Name << ": another process is publishing under this name" << std::endl;
+			return;
+		}
+
+		shm_unlink(Name.c_str());
+	}
+
+	if (this->Data->Descriptor < 0 || flock(this->Data->Descriptor, LOCK_EX | LOCK_NB) != 0 || !this->Data->Reserve(64))
+		std::cerr << Name << ": cannot create shared memory: " << std::strerror(errno) << std::endl;
+}
+
+
+ScheduleShared::~ScheduleShared()
+{
+	if (this->Data->Mapping != MAP_FAILED)
+		munmap(this->Data->Mapping, GetSegmentSize(this->Data->Capacity));
+
+	// Removed while still locked, so that another publisher can't take the name over in between
+	if (this->Data->Descriptor >= 0)
+	{
+		shm_unlink(this->Data->Name.c_str());
+		close(this->Data->Descriptor);
+	}
+
+	delete this->Data;
+}
+
+
+bool ScheduleShared::IsOpen() const
+{
+	return (this->Data->Mapping != MAP_FAILED);
+}
+
+
+void ScheduleShared::Publish(Schedule const &Published, Schedule::size_type Current,
+							 std::vector<Schedule::ActivityRange> const &Changed, bool Everything)
+{
+	if (!this->IsOpen())
+		return;
+
+	Offset const Now = Offset::GetLocalTimeOfDay();
+
+	// Lay out before writing, so that readers aren't kept waiting
+	if (!Published.empty())
+		Published.front()->GetActualStartTime();
+
+	if (!this->Data->Reserve(Published.size()))
+	{
+		std::cerr << this->Data->Name << ": cannot grow shared memory: " << std::strerror(errno) << std::endl;
+		return;
+	}
+
+	SharedHeader &Header = this->Data->GetHeader();
+	SharedRow * const Rows = this->Data->GetRows();
+
+	Schedule::size_type const Next = GetNext(Published, Current, Now);
+
+	std::uint32_t const Sequence = Header.Sequence.load(std::memory_order_relaxed);
+	Header.Sequence.store(Sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (Header.Size != Published.size())
+		Everything = true;
+
+	Header.Magic = SharedMagic;
+	Header.Version = SharedVersion;
+	Header.Capacity = this->Data->Capacity;
+	Header.Size = Published.size();
+	Header.Current = Current;
+	Header.Next = Next;
+	Header.Published = std::time(nullptr);
+
+	if (Everything)
+	{
+		Schedule::size_type Index = 0;
+
+		for (auto Written : Published)
+			this->Data->Write(Rows[Index++], *Written);
+	}
+	else
+	{
+		Schedule::const_iterator ActivityIterator = Published.begin();
+		Schedule::size_type Index = 0;
+
+		for (auto &Range : Changed)
+		{
+			std::advance(ActivityIterator, Range.First - Index);
+			Index = Range.First;
+
+			for (; Index < Range.First + Range.Count; ++ActivityIterator, Index++)
+				this->Data->Write(Rows[Index], **ActivityIterator);
+		}
+	}
+
+	if (Current < Published.size())
+		Header.Boundary = Rows[Current].EndTime;
+	else
+		Header.Boundary = (Next < Published.size() ? Rows[Next].StartTime : -1);
+
+	Header.Sequence.store(Sequence + 2, std::memory_order_release);
+}
+
+
+bool ScheduleShared::Read(std::string const &Name, Offset const &Now, Status &Read)
+{
+	int const Descriptor = shm_open(Name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+
+	if (Descriptor < 0)
+		return false;
+
+	bool Found = false;
+	void *Mapping = MAP_FAILED;
+	std::size_t Mapped = 0;
+
+	for (int Attempt = 0; Attempt < ReadAttempts && !Found; Attempt++)
+	{
+		// Map the whole segment, again if it has grown since it was last mapped
+		struct stat Segment;
+		if (fstat(Descriptor, &Segment) < 0 || static_cast<std::size_t>(Segment.st_size) < sizeof(SharedHeader))
+			break;
+
+		if (static_cast<std::size_t>(Segment.st_size) != Mapped)
+		{
+			if (Mapping != MAP_FAILED)
+				munmap(Mapping, Mapped);
+
+			Mapped = Segment.st_size;
+			Mapping = mmap(nullptr, Mapped, PROT_READ, MAP_SHARED, Descriptor, 0);
+
+			if (Mapping == MAP_FAILED)
+				break;
+		}
+
+		SharedHeader const &Header = *static_cast<SharedHeader const *>(Mapping);
+		SharedRow const * const Rows = reinterpret_cast<SharedRow const *>(static_cast<char const *>(Mapping) + sizeof(SharedHeader));
+		std::uint32_t const MappedRows = (Mapped - sizeof(SharedHeader)) / sizeof(SharedRow);
+
+		for (; Attempt < ReadAttempts; Attempt++)
+		{
+			std::uint32_t const Sequence = Header.Sequence.load(std::memory_order_acquire);
+
+			if (Sequence % 2 != 0)
+			{
+				sched_yield();
+				continue;
+			}
+
+			std::uint32_t const Magic = Header.Magic;
+			std::uint32_t const Version = Header.Version;
+			std::uint32_t const Size = Header.Size;
+			std::int64_t const Published = Header.Published;
+
+			bool const Consistent = FindStatus(Rows, std::min(Size, MappedRows), Header.Current, Header.Next,
+											   Now.GetTotalSeconds(), Read);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (Header.Sequence.load(std::memory_order_relaxed) != Sequence)
+				continue;
+
+			// The segment was created but nothing has been published yet
+			if (Magic != SharedMagic || Version != SharedVersion)
+			{
+				Attempt = ReadAttempts;
+				break;
+			}
+
+			// Rows past the mapping mean the segment has grown
+			if (Size > MappedRows || !Consistent)
+				break;
+
+			Read.Published = Published;
+			Found = true;
+			break;
+		}
+	}
+
+	if (Mapping != MAP_FAILED)
+		munmap(Mapping, Mapped);
+
+	close(Descriptor);
+
+	return Found;
+}
+
+
+void ScheduleShared::GetStatus(Schedule const &Laid, Offset const &Now, Status &Found)
+{
+	Found = Status();
+	Found.Size = Laid.size();
+	Found.Current.Index = 0;
+
+	for (auto Current : Laid)
+	{
+		if (Current->GetActualStartTime() <= Now && Now < Current->GetActualEndTime())
+			break;
+
+		Found.Current.Index++;
+	}
+
+	Found.Next.Index = GetNext(Laid, Found.Current.Index, Now);
+
+	Schedule::const_iterator ActivityIterator = Laid.begin();
+	Schedule::size_type Index = 0;
+
+	for (Row *Set : { &Found.Current, &Found.Next })
+	{
+		if (Set->Index >= Laid.size())
+			continue;
+
+		std::advance(ActivityIterator, Set->Index - Index);
+		Index = Set->Index;
+
+		SetRow(*Set, Index, **ActivityIterator);
+	}
+
+	Found.HasBoundary = (Found.Current.Index < Laid.size() || Found.Next.Index < Laid.size());
+
+	if (Found.HasBoundary)
+		Found.Boundary = (Found.Current.Index < Laid.size() ? Found.Current.EndTime : Found.Next.StartTime);
+}
+
+
+std::string ScheduleShared::GetDefaultName()
+{
+	if (char const * const Name = std::getenv("SCHEDULE_SHARED"))
+		return Name;
+
+	std::ostringstream Stream;
+	Stream << "/schedule-" << getuid();
+	return Stream.str();
+}
+
+
+// Grows the segment to hold at least Rows rows, at least doubling it so that growing is rare.  Readers that mapped
+// the smaller segment see that it grew when they next read its size.
+bool Schedule::ScheduleShared::Implementation::Reserve(Schedule::size_type Rows)
+{
+	if (Rows <= this->Capacity && this->Mapping != MAP_FAILED)
+		return true;
+
+	std::uint32_t const Capacity = std::max<Schedule::size_type>(Rows, 2 * this->Capacity);
+
+	if (ftruncate(this->Descriptor, GetSegmentSize(Capacity)) < 0)
+		return false;
+
+	void * const Mapping = mmap(nullptr, GetSegmentSize(Capacity), PROT_READ | PROT_WRITE, MAP_SHARED, this->Descriptor, 0);
+
+	if (Mapping == MAP_FAILED)
+		return false;
+
+	if (this->Mapping != MAP_FAILED)
+		munmap(this->Mapping, GetSegmentSize(this->Capacity));
+
+	this->Mapping = Mapping;
+	this->Capacity = Capacity;
+
+	return true;
+}
+
+
+void Schedule::ScheduleShared::Implementation::Write(SharedRow &Written, Activity const &From)
+{
+	Written.StartTime = From.GetActualStartTime().GetTotalSeconds();
+	Written.EndTime = From.GetActualEndTime().GetTotalSeconds();
+
+	std::string::size_type const Length = std::min(From.GetName().size(), MaximumNameLength);
+	std::memcpy(Written.Name, From.GetName().data(), Length);
+	std::memset(Written.Name + Length, 0, sizeof(Written.Name) - Length);
+}
@@ -0,0 +1,97 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULESHARED
+#define SCHEDULE_SCHEDULESHARED
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "Offset.hpp"
+#include "Schedule.hpp"
+
+namespace Schedule
+{
+	// Publishes a laid out schedule in a POSIX shared memory segment, so that status bars can learn what is under way
+	// and what comes next without reading the file or laying it out.  The segment holds the index of the activity
+	// under way, the time of the next start or end, and a row of actual times and name for each activity.  It is
+	// guarded by a sequence lock: the publisher makes the sequence odd while it writes, and readers retry if the
+	// sequence was odd, or moved while they read.  Only one process can publish under a name, and only its user can
+	// read the segment.
+	class ScheduleShared
+	{
+	public:
+		// Longer names are cut short in the segment
+		static std::string::size_type const MaximumNameLength = 47;
+
+		struct Row
+		{
+			Row();
+
+			Schedule::size_type	Index;
+			std::string			Name;
+			Offset				StartTime;
+			Offset				EndTime;
+		};
+
+		// What is under way at a time of day.  An index equal to Size means there is no such activity.
+		struct Status
+		{
+			Status();
+
+			std::time_t			Published;		// When the layout was published, or zero if it wasn't
+			Schedule::size_type	Size;
+			Row					Current;
+			Row					Next;
+			bool				HasBoundary;
+			Offset				Boundary;		// When Current ends, or else Next starts
+		};
+
+		// Creates the segment Name, replacing any a publisher that has stopped left behind.  IsOpen returns false if it
+		// can't be created, or another process is still publishing under Name.
+		explicit ScheduleShared(std::string const &Name);
+		ScheduleShared(ScheduleShared const &) = delete;
+		~ScheduleShared();
+
+		bool IsOpen() const;
+
+		// Writes Published's layout, with Current as the activity under way.  Unless Everything is set, only the rows
+		// in Changed are written again.
+		void Publish(Schedule const &Published, Schedule::size_type Current,
+					 std::vector<Schedule::ActivityRange> const &Changed, bool Everything);
+
+		// Reads what is under way at Now from the segment Name.  Returns false if nothing is published under Name,
+		// or the publisher has stopped part way through writing.
+		static bool Read(std::string const &Name, Offset const &Now, Status &Read);
+
+		// Finds what is under way at Now in Laid itself, as Read would find it once Laid was published
+		static void GetStatus(Schedule const &Laid, Offset const &Now, Status &Found);
+
+		// $SCHEDULE_SHARED if set, otherwise a per-user name
+		static std::string GetDefaultName();
+
+	private:
+		struct Implementation;
+
+		Implementation *Data;
+	};
+}
+
+#endif
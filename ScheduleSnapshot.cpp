@@ -0,0 +1,179 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include "ScheduleSnapshot.hpp"
+
+using namespace Schedule;
+
+ScheduleSnapshot::State::State() :
+	Length(6, 0, 0),
+	Paused(false),
+	Size(0)
+{
+
+}
+
+
+ScheduleSnapshot::ScheduleSnapshot() :
+	Data(std::make_shared<State>())
+{
+
+}
+
+
+ScheduleSnapshot::ScheduleSnapshot(std::shared_ptr<State const> const &Data) :
+	Data(Data)
+{
+
+}
+
+
+ScheduleSnapshot::size_type	ScheduleSnapshot::size() const	{ return this->Data->Size; }
+bool						ScheduleSnapshot::empty() const	{ return this->Data->Size == 0; }
+
+
+Activity const &ScheduleSnapshot::operator[](size_type Index) const
+{
+	size_type ChunkIndex;
+	size_type Position;
+	this->Locate(Index, ChunkIndex, Position);
+
+	return *(*this->Data->Chunks[ChunkIndex])[Position];
+}
+
+
+Duration			ScheduleSnapshot::GetLength() const	{ return this->Data->Length; }
+PauseList const	   &ScheduleSnapshot::GetPauses() const	{ return this->Data->Pauses; }
+
+
+Offset const *ScheduleSnapshot::GetActivePause() const
+{
+	return (this->Data->Paused ? &this->Data->ActivePause : nullptr);
+}
+
+
+ScheduleSnapshot ScheduleSnapshot::Insert(size_type Index, Activity const &Inserted) const
+{
+	return this->InsertPointer(Index, std::make_shared<Activity const>(Inserted));
+}
+
+
+ScheduleSnapshot ScheduleSnapshot::Replace(size_type Index, Activity const &Replacement) const
+{
+	size_type ChunkIndex;
+	size_type Position;
+	this->Locate(Index, ChunkIndex, Position);
+
+	std::shared_ptr<Chunk> NewChunk = std::make_shared<Chunk>(*this->Data->Chunks[ChunkIndex]);
+	(*NewChunk)[Position] = std::make_shared<Activity const>(Replacement);
+
+	std::shared_ptr<State> NewData = std::make_shared<State>(*this->Data);
+	NewData->Chunks[ChunkIndex] = NewChunk;
+
+	return ScheduleSnapshot(NewData);
+}
+
+
+ScheduleSnapshot ScheduleSnapshot::Erase(size_type Index) const
+{
+	size_type ChunkIndex;
+	size_type Position;
+	this->Locate(Index, ChunkIndex, Position);
+
+	std::shared_ptr<State> NewData = std::make_shared<State>(*this->Data);
+
+	if (NewData->Chunks[ChunkIndex]->size() == 1)
+		NewData->Chunks.erase(NewData->Chunks.begin() + ChunkIndex);
+	else
+	{
+		std::shared_ptr<Chunk> NewChunk = std::make_shared<Chunk>(*this->Data->Chunks[ChunkIndex]);
+		NewChunk->erase(NewChunk->begin() + Position);
+
+		NewData->Chunks[ChunkIndex] = NewChunk;
+	}
+
+	NewData->Size--;
+
+	return ScheduleSnapshot(NewData);
+}
+
+
+ScheduleSnapshot ScheduleSnapshot::Move(size_type From, size_type To) const
+{
+	size_type ChunkIndex;
+	size_type Position;
+	this->Locate(From, ChunkIndex, Position);
+
+	// The activity itself is shared, not copied
+	ActivityPointer const Moved = (*this->Data->Chunks[ChunkIndex])[Position];
+
+	return this->Erase(From).InsertPointer(To, Moved);
+}
+
+
+ScheduleSnapshot ScheduleSnapshot::SetLength(Duration const &Length) const
+{
+	std::shared_ptr<State> NewData = std::make_shared<State>(*this->Data);
+	NewData->Length = Length;
+
+	return ScheduleSnapshot(NewData);
+}
+
+
+void ScheduleSnapshot::Locate(size_type Index, size_type &ChunkIndex, size_type &Position) const
+{
+	ChunkIndex = 0;
+	Position = Index;
+
+	while (ChunkIndex + 1 < this->Data->Chunks.size() && Position >= this->Data->Chunks[ChunkIndex]->size())
+		Position -= this->Data->Chunks[ChunkIndex++]->size();
+}
+
+
+ScheduleSnapshot ScheduleSnapshot::InsertPointer(size_type Index, ActivityPointer const &Inserted) const
+{
+	std::shared_ptr<State> NewData = std::make_shared<State>(*this->Data);
+	NewData->Size++;
+
+	if (NewData->Chunks.empty())
+	{
+		NewData->Chunks.push_back(std::make_shared<Chunk const>(1, Inserted));
+		return ScheduleSnapshot(NewData);
+	}
+
+	// Appending lands at the end of the last chunk
+	size_type ChunkIndex;
+	size_type Position;
+	this->Locate(Index, ChunkIndex, Position);
+
+	std::shared_ptr<Chunk> NewChunk = std::make_shared<Chunk>(*this->Data->Chunks[ChunkIndex]);
+	NewChunk->insert(NewChunk->begin() + Position, Inserted);
+
+	if (NewChunk->size() > MaximumChunkSize)
+	{
+		std::shared_ptr<Chunk> const SecondHalf = std::make_shared<Chunk>(NewChunk->begin() + NewChunk->size() / 2, NewChunk->end());
+		NewChunk->erase(NewChunk->begin() + NewChunk->size() / 2, NewChunk->end());
+
+		NewData->Chunks.insert(NewData->Chunks.begin() + ChunkIndex + 1, SecondHalf);
+	}
+
+	NewData->Chunks[ChunkIndex] = NewChunk;
+
+	return ScheduleSnapshot(NewData);
+}
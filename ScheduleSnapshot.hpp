@@ -0,0 +1,116 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULESNAPSHOT
+#define SCHEDULE_SCHEDULESNAPSHOT
+
+#include <memory>
+#include <vector>
+
+#include "Activity.hpp"
+#include "Offset.hpp"
+#include "Schedule.hpp"
+
+namespace Schedule
+{
+	// An immutable copy of a schedule's activities, length, and pauses.  Copying a snapshot is O(1), and each change
+	// returns a new snapshot that shares everything with the old one except the activities it touched and the
+	// chunk of the list that held them.  Alternatives to a schedule can be built as snapshots of it and laid out
+	// by constructing a Schedule from them.
+	class ScheduleSnapshot
+	{
+	public:
+		typedef std::size_t size_type;
+
+		// An empty schedule of the default length
+		ScheduleSnapshot();
+
+		size_type	size() const;
+		bool		empty() const;
+
+		// Indices are 0-based
+		Activity const &operator[](size_type Index) const;
+
+		// Calls Function with each activity in order
+		template <typename FunctionType>
+		void ForEach(FunctionType const &Function) const
+		{
+			for (auto &Chunk : this->Data->Chunks)
+			{
+				for (auto &Current : *Chunk)
+					Function(*Current);
+			}
+		}
+
+		Duration			GetLength() const;
+		PauseList const	   &GetPauses() const;
+		Offset const	   *GetActivePause() const;
+
+		// Index may be size(), to append
+		ScheduleSnapshot Insert(size_type Index, Activity const &Inserted) const;
+		ScheduleSnapshot Replace(size_type Index, Activity const &Replacement) const;
+		ScheduleSnapshot Erase(size_type Index) const;
+		// Moves the activity at From so that it ends up at To
+		ScheduleSnapshot Move(size_type From, size_type To) const;
+		ScheduleSnapshot SetLength(Duration const &Length) const;
+
+	private:
+		friend class Schedule;
+
+		typedef std::shared_ptr<Activity const>	ActivityPointer;
+		typedef std::vector<ActivityPointer>	Chunk;
+
+		struct State
+		{
+			State();
+
+			Duration	Length;
+
+			PauseList	Pauses;
+			bool		Paused;
+			Offset		ActivePause;
+
+			std::vector<std::shared_ptr<Chunk const>>	Chunks;
+			size_type									Size;
+		};
+
+		ScheduleSnapshot(std::shared_ptr<State const> const &Data);
+
+		// Finds the chunk holding Index and Index's position within it
+		void Locate(size_type Index, size_type &ChunkIndex, size_type &Position) const;
+
+		ScheduleSnapshot InsertPointer(size_type Index, ActivityPointer const &Inserted) const;
+
+		// Chunks are split when they grow past MaximumChunkSize
+		static size_type const ChunkSize = 64;
+		static size_type const MaximumChunkSize = 2 * ChunkSize;
+
+		std::shared_ptr<State const> Data;
+	};
+
+
+	// A schedule's layout as it stood when it was published.  The snapshot's activities hold their actual times.
+	struct PublishedLayout
+	{
+		unsigned long		Version;	// The number of changes made to the schedule before it was laid out
+		ScheduleSnapshot	Snapshot;
+	};
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include "ScheduleStats.hpp"
+
+using namespace Schedule;
+
+Stats::SharedCounts Schedule::Stats::Process;
+
+ScheduleStats::ScheduleStats() :
+	Counts()
+{
+
+}
+
+
+ScheduleStats &ScheduleStats::operator+=(ScheduleStats const &Added)
+{
+	for (int Counted = 0; Counted < COUNTERS; Counted++)
+		this->Counts[Counted] += Added.Counts[Counted];
+
+	return *this;
+}
+
+
+char const *ScheduleStats::GetName(Counter Counted)
+{
+	static char const * const Names[COUNTERS] = {
+		"updates",
+		"layouts",
+		"shifts",
+		"activities_visited",
+		"segments",
+		"beginning_conflicts",
+		"end_time_clamps",
+		"layout_ns",
+		"reads",
+		"read_bytes",
+		"read_ns",
+		"writes",
+		"write_bytes",
+		"write_ns"
+	};
+
+	return Names[Counted];
+}
+
+
+Stats::SharedCounts::SharedCounts()
+{
+	this->Reset();
+}
+
+
+ScheduleStats Stats::SharedCounts::Load() const
+{
+	ScheduleStats Result;
+
+	for (int Counted = 0; Counted < ScheduleStats::COUNTERS; Counted++)
+		Result.Counts[Counted] = this->Counts[Counted].load(std::memory_order_relaxed);
+
+	return Result;
+}
+
+
+void Stats::SharedCounts::Add(ScheduleStats const &Added)
+{
+	for (int Counted = 0; Counted < ScheduleStats::COUNTERS; Counted++)
+	{
+		if (Added.Counts[Counted] != 0)
+			this->Counts[Counted].fetch_add(Added.Counts[Counted], std::memory_order_relaxed);
+	}
+}
+
+
+void Stats::SharedCounts::Reset()
+{
+	for (auto &Count : this->Counts)
+		Count.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,119 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULESTATS
+#define SCHEDULE_SCHEDULESTATS
+
+#include <atomic>
+
+#include "ScheduleTrace.hpp"
+
+namespace Schedule
+{
+	// Counts of the work done laying schedules out and reading and writing them.  Each schedule counts its own layout
+	// work, and adds it to the whole process's counts once each layout is done; file work is only counted for the
+	// process.  Times are counted by the ScheduleTrace spans around the work.  They are only kept when built with
+	// SCHEDULE_STATS defined.  Otherwise, SCHEDULE_COUNT and SCHEDULE_COUNT_IN compile to nothing, SCHEDULE_TALLY
+	// gives spans nowhere to add their times, and every count stays 0.
+	struct ScheduleStats
+	{
+		enum Counter
+		{
+			UPDATES,				// Changes to a schedule's layout
+			LAYOUTS,
+			SHIFTS,					// Layouts moved as a whole by a new start for the first activity, without laying out
+			ACTIVITIES_VISITED,		// Summed over the passes of every layout
+			SEGMENTS,				// Spaces between fixed starts and beginnings that were stretched
+			BEGINNING_CONFLICTS,	// Beginnings earlier than the activities before them allowed
+			END_TIME_CLAMPS,		// Starts and lengths cut short by the end of the schedule
+			LAYOUT_NANOSECONDS,
+			READS,
+			READ_BYTES,				// As consumed by the parser
+			READ_NANOSECONDS,
+			WRITES,
+			WRITE_BYTES,
+			WRITE_NANOSECONDS,
+			COUNTERS
+		};
+
+		ScheduleStats();
+
+		ScheduleStats &operator+=(ScheduleStats const &Added);
+
+		// The counter's name, in lower case with underscores
+		static char const *GetName(Counter Counted);
+
+#ifdef SCHEDULE_STATS
+		static bool const Enabled = true;
+#else
+		static bool const Enabled = false;
+#endif
+
+		unsigned long long Counts[COUNTERS];
+	};
+
+
+	namespace Stats
+	{
+		// Counts that many threads add to at once
+		struct SharedCounts
+		{
+			SharedCounts();
+
+			ScheduleStats Load() const;
+			void Add(ScheduleStats const &Added);
+			void Reset();
+
+			std::atomic<unsigned long long> Counts[ScheduleStats::COUNTERS];
+		};
+
+		// The whole process's counts
+		extern SharedCounts Process;
+
+		inline void Add(unsigned long long &Count, unsigned long long Amount)
+		{
+			Count += Amount;
+		}
+
+		inline void Add(std::atomic<unsigned long long> &Count, unsigned long long Amount)
+		{
+			Count.fetch_add(Amount, std::memory_order_relaxed);
+		}
+	}
+
+
+#ifdef SCHEDULE_STATS
+// Counted is a ScheduleStats, or a SharedCounts for counts added to from many threads
+#define SCHEDULE_COUNT_IN(Counted, Counter, Amount) \
+	(::Schedule::Stats::Add((Counted).Counts[::Schedule::ScheduleStats::Counter], (Amount)))
+#define SCHEDULE_COUNT(Counter, Amount) SCHEDULE_COUNT_IN(::Schedule::Stats::Process, Counter, Amount)
+// Where a ScheduleTrace::Span adds its time to a counter
+#define SCHEDULE_TALLY_IN(Counted, Counter) \
+	(::Schedule::ScheduleTrace::Tally((Counted).Counts[::Schedule::ScheduleStats::Counter]))
+#define SCHEDULE_TALLY(Counter) SCHEDULE_TALLY_IN(::Schedule::Stats::Process, Counter)
+#else
+// The amount isn't evaluated, but counts as used
+#define SCHEDULE_COUNT_IN(Counted, Counter, Amount) ((void)sizeof(Amount))
+#define SCHEDULE_COUNT(Counter, Amount) ((void)0)
+#define SCHEDULE_TALLY_IN(Counted, Counter) (::Schedule::ScheduleTrace::Tally())
+#define SCHEDULE_TALLY(Counter) (::Schedule::ScheduleTrace::Tally())
+#endif
+}
+
+#endif
@@ -0,0 +1,455 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include "ScheduleFileIO.hpp"
+#include "ScheduleStore.hpp"
+#include "ScheduleWriter.hpp"
+
+using namespace Schedule;
+
+std::chrono::milliseconds const ScheduleStore::WriteBehindDelay(500);
+
+namespace
+{
+	timespec GetModificationTime(std::string const &FileName)
+	{
+		struct stat Status;
+
+		if (stat(FileName.c_str(), &Status) != 0)
+			return timespec{0, 0};
+
+		return Status.st_mtim;
+	}
+
+
+	bool IsSameTime(timespec const &First, timespec const &Second)
+	{
+		return First.tv_sec == Second.tv_sec && First.tv_nsec == Second.tv_nsec;
+	}
+
+
+	struct Resident
+	{
+		Resident() :
+			Loaded(false),
+			Dirty(false),
+			Saving(0),
+			WriteFailed(false),
+			Evicted(false),
+			MeasuredSize(0),
+			MeasuredCount(0)
+		{
+
+		}
+
+		// Schedule::GetMemoryUsage is linear in the schedule, so it is only called when the schedule is read or was
+		// empty, and when its shard is over budget.  In between, the size measured is scaled by the number of
+		// activities.
+		std::size_t GetEstimatedSize()
+		{
+			if (this->MeasuredCount == 0)
+				this->Measure();
+
+			return this->MeasuredCount == 0 ? this->MeasuredSize :
+											  this->MeasuredSize * this->Data.size() / this->MeasuredCount;
+		}
+
+		void Measure()
+		{
+			this->MeasuredSize = this->Data.GetMemoryUsage().GetTotal();
+			this->MeasuredCount = this->Data.size();
+		}
+
+		std::mutex			Mutex;	// Held while the schedule is in use or being written
+		Schedule::Schedule	Data;
+		bool				Loaded;
+		timespec			ModificationTime;
+		bool				Dirty;
+		unsigned int		Saving;		// Saves queued with the writer and not yet attempted
+		bool				WriteFailed;	// The last attempt to write it back failed
+		bool				Evicted;	// Set once it has been dropped; whoever holds it must look it up again
+		std::size_t			MeasuredSize;
+		std::size_t			MeasuredCount;
+	};
+
+
+	struct Entry
+	{
+		std::shared_ptr<Resident>			Schedule;
+		std::list<std::string>::iterator	Recent;
+		std::size_t							Size;
+	};
+
+
+	struct Shard
+	{
+		Shard() :
+			Size(0)
+		{
+
+		}
+
+		std::mutex								Mutex;
+		std::unordered_map<std::string, Entry>	Entries;
+		std::list<std::string>					Recent;	// Most recently used first
+		std::size_t								Size;
+	};
+
+
+	typedef std::pair<std::string, std::shared_ptr<Resident>> ModifiedSchedule;
+}
+
+struct Schedule::ScheduleStore::Implementation
+{
+	Implementation(std::size_t MemoryBudget, unsigned int Shards) :
+		Shards(Shards),
+		ShardBudget(MemoryBudget / Shards),
+		Stopping(false)
+	{
+
+	}
+
+	std::vector<Shard>	Shards;
+	std::size_t			ShardBudget;
+
+	// Schedules waiting to be written back, the thread that hands them to the writer, and the writer
+	std::mutex								WriterMutex;
+	std::condition_variable					WriterCondition;
+	std::vector<ModifiedSchedule>			Modified;
+	std::chrono::steady_clock::time_point	WriteBehindDeadline;
+	bool									Stopping;
+	std::thread								WriteBehindThread;
+	ScheduleWriter							Writer;
+
+	Shard &GetShard(std::string const &FileName);
+
+	// Finds the schedule, adding it unloaded if it isn't resident, and marks it most recently used
+	std::shared_ptr<Resident> Find(std::string const &FileName);
+	void MarkModified(std::string const &FileName, std::shared_ptr<Resident> const &Modified);
+	void Resize(std::string const &FileName, std::shared_ptr<Resident> const &Resized, std::size_t Size);
+	// Drops idle, saved schedules from the back of Current until it is within its budget.  Current must be locked.
+	// The most recently used schedule always stays.
+	void Evict(Shard &Current);
+
+	// Hands snapshots of the modified schedules to the writer
+	void QueueWriteBack();
+	void Saved(ModifiedSchedule const &Saved, bool Written, timespec const &ModificationTime);
+	void WriteBehind();
+};
+
+
+ScheduleStore::ScheduleStore(std::size_t MemoryBudget, unsigned int Shards) :
+	Data(new Implementation(MemoryBudget, std::max(Shards, 1u)))
+{
+	// The writer mustn't take signals meant for the threads using the store
+	sigset_t All;
+	sigset_t Previous;
+	sigfillset(&All);
+
+	pthread_sigmask(SIG_SETMASK, &All, &Previous);
+	this->Data->WriteBehindThread = std::thread(&Implementation::WriteBehind, this->Data);
+	pthread_sigmask(SIG_SETMASK, &Previous, nullptr);
+}
+
+
+ScheduleStore::~ScheduleStore()
+{
+	{
+		std::lock_guard<std::mutex> Lock(this->Data->WriterMutex);
+		this->Data->Stopping = true;
+	}
+
+	this->Data->WriterCondition.notify_one();
+	this->Data->WriteBehindThread.join();
+
+	this->WriteBack();
+
+	delete this->Data;
+}
+
+
+int ScheduleStore::Run(std::string const &FileName, Function const &Function)
+{
+	while (true)
+	{
+		std::shared_ptr<Resident> const Current = this->Data->Find(FileName);
+		std::unique_lock<std::mutex> Lock(Current->Mutex);
+
+		// Dropped between being found and being locked
+		if (Current->Evicted)
+			continue;
+
+		// Pick up edits made to the file by others, unless they would discard our own.  Until a queued save is written,
+		// the file's time says nothing about who changed it.  Reading happens with only this schedule locked, so the
+		// rest of its shard isn't held up.
+		timespec const ModificationTime = GetModificationTime(FileName);
+
+		if (!Current->Loaded ||
+			(!Current->Dirty && Current->Saving == 0 && !IsSameTime(Current->ModificationTime, ModificationTime)))
+		{
+			Current->Data = ScheduleFileIO::Read(FileName);
+			Current->ModificationTime = ModificationTime;
+			Current->Loaded = true;
+			Current->Measure();
+		}
+
+		// Changes are only on the disk once written back, so the caller hears of a failure at its next use
+		if (Current->WriteFailed)
+			std::cerr << FileName << ": earlier changes could not be written back; they are kept and will be tried again"
+					  << std::endl;
+
+		int const Result = Function(Current->Data, [&]()
+		{
+			this->Data->MarkModified(FileName, Current);
+			return !Current->WriteFailed;
+		});
+
+		std::size_t const Size = Current->GetEstimatedSize();
+		Lock.unlock();
+
+		this->Data->Resize(FileName, Current, Size);
+
+		return Result;
+	}
+}
+
+
+bool ScheduleStore::WriteBack()
+{
+	// Failures already tried again are forgotten first, so that only this write-back's are reported
+	this->Data->Writer.Flush();
+
+	this->Data->QueueWriteBack();
+	return this->Data->Writer.Flush();
+}
+
+
+std::size_t ScheduleStore::GetResidentCount() const
+{
+	std::size_t Count = 0;
+
+	for (auto &Current : this->Data->Shards)
+	{
+		std::lock_guard<std::mutex> Lock(Current.Mutex);
+		Count += Current.Entries.size();
+	}
+
+	return Count;
+}
+
+
+std::size_t ScheduleStore::GetResidentSize() const
+{
+	std::size_t Size = 0;
+
+	for (auto &Current : this->Data->Shards)
+	{
+		std::lock_guard<std::mutex> Lock(Current.Mutex);
+		Size += Current.Size;
+	}
+
+	return Size;
+}
+
+
+Shard &Schedule::ScheduleStore::Implementation::GetShard(std::string const &FileName)
+{
+	return this->Shards[std::hash<std::string>()(FileName) % this->Shards.size()];
+}
+
+
+std::shared_ptr<Resident> Schedule::ScheduleStore::Implementation::Find(std::string const &FileName)
+{
+	Shard &Current = this->GetShard(FileName);
+	std::lock_guard<std::mutex> Lock(Current.Mutex);
+
+	std::unordered_map<std::string, Entry>::iterator const Found = Current.Entries.find(FileName);
+
+	if (Found != Current.Entries.end())
+	{
+		Current.Recent.splice(Current.Recent.begin(), Current.Recent, Found->second.Recent);
+		return Found->second.Schedule;
+	}
+
+	Current.Recent.push_front(FileName);
+
+	Entry &Added = Current.Entries[FileName];
+	Added.Schedule = std::make_shared<Resident>();
+	Added.Recent = Current.Recent.begin();
+	Added.Size = 0;
+
+	return Added.Schedule;
+}
+
+
+void Schedule::ScheduleStore::Implementation::MarkModified(std::string const &FileName,
+														   std::shared_ptr<Resident> const &Modified)
+{
+	// Modified is locked by the caller
+	if (Modified->Dirty)
+		return;
+
+	Modified->Dirty = true;
+
+	std::lock_guard<std::mutex> Lock(this->WriterMutex);
+
+	if (this->Modified.empty())
+	{
+		this->WriteBehindDeadline = std::chrono::steady_clock::now() + WriteBehindDelay;
+		this->WriterCondition.notify_one();
+	}
+
+	this->Modified.emplace_back(FileName, Modified);
+}
+
+
+void Schedule::ScheduleStore::Implementation::Resize(std::string const &FileName,
+													 std::shared_ptr<Resident> const &Resized, std::size_t Size)
+{
+	Shard &Current = this->GetShard(FileName);
+	std::lock_guard<std::mutex> Lock(Current.Mutex);
+
+	std::unordered_map<std::string, Entry>::iterator const Found = Current.Entries.find(FileName);
+
+	if (Found != Current.Entries.end() && Found->second.Schedule == Resized)
+	{
+		Current.Size = Current.Size - Found->second.Size + Size;
+		Found->second.Size = Size;
+	}
+
+	this->Evict(Current);
+}
+
+
+void Schedule::ScheduleStore::Implementation::Evict(Shard &Current)
+{
+	std::list<std::string>::iterator Candidate = Current.Recent.end();
+
+	while (Current.Size > this->ShardBudget && Current.Recent.size() > 1 && --Candidate != Current.Recent.begin())
+	{
+		std::unordered_map<std::string, Entry>::iterator const Found = Current.Entries.find(*Candidate);
+
+		{
+			Resident &Evicted = *Found->second.Schedule;
+			std::unique_lock<std::mutex> Lock(Evicted.Mutex, std::try_to_lock);
+
+			// Schedules in use or waiting to be written back stay
+			if (!Lock.owns_lock() || Evicted.Dirty || Evicted.Saving > 0)
+				continue;
+
+			// The shard may only seem over budget because of an estimate
+			Evicted.Measure();
+
+			Current.Size = Current.Size - Found->second.Size + Evicted.MeasuredSize;
+			Found->second.Size = Evicted.MeasuredSize;
+
+			if (Current.Size <= this->ShardBudget)
+				break;
+
+			Evicted.Evicted = true;
+		}
+
+		Current.Size -= Found->second.Size;
+		Current.Entries.erase(Found);
+
+		Candidate = Current.Recent.erase(Candidate);
+	}
+}
+
+
+void Schedule::ScheduleStore::Implementation::QueueWriteBack()
+{
+	std::vector<ModifiedSchedule> Writing;
+	{
+		std::lock_guard<std::mutex> Lock(this->WriterMutex);
+		Writing.swap(this->Modified);
+	}
+
+	for (auto &Modified : Writing)
+	{
+		std::lock_guard<std::mutex> Lock(Modified.second->Mutex);
+
+		this->Writer.Save(Modified.second->Data, Modified.first,
+						  [this, Modified](bool Written, timespec const &ModificationTime)
+		{
+			this->Saved(Modified, Written, ModificationTime);
+		});
+
+		Modified.second->Dirty = false;
+		Modified.second->Saving++;
+	}
+}
+
+
+void Schedule::ScheduleStore::Implementation::Saved(ModifiedSchedule const &Saved, bool Written,
+													timespec const &ModificationTime)
+{
+	{
+		std::lock_guard<std::mutex> Lock(Saved.second->Mutex);
+		Saved.second->Saving--;
+
+		// Try again later rather than dropping the changes.  The time is the writer's own, since the file may have
+		// been changed again by now.
+		Saved.second->WriteFailed = !Written;
+
+		if (Written)
+			Saved.second->ModificationTime = ModificationTime;
+		else
+			this->MarkModified(Saved.first, Saved.second);
+	}
+
+	// It can now be dropped, if its shard is over budget
+	Shard &Current = this->GetShard(Saved.first);
+	std::lock_guard<std::mutex> Lock(Current.Mutex);
+
+	this->Evict(Current);
+}
+
+
+void Schedule::ScheduleStore::Implementation::WriteBehind()
+{
+	std::unique_lock<std::mutex> Lock(this->WriterMutex);
+
+	while (!this->Stopping)
+	{
+		if (this->Modified.empty())
+			this->WriterCondition.wait(Lock);
+		else if (this->WriterCondition.wait_until(Lock, this->WriteBehindDeadline) == std::cv_status::timeout)
+		{
+			Lock.unlock();
+			this->QueueWriteBack();
+			Lock.lock();
+		}
+	}
+}
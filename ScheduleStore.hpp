@@ -0,0 +1,74 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULESTORE
+#define SCHEDULE_SCHEDULESTORE
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "Schedule.hpp"
+
+namespace Schedule
+{
+	// Holds many schedules in memory, keyed by file name, for use from many threads at once.  A schedule is read the
+	// first time it is used, and read again if its file is changed by someone else while it is unmodified here.
+	// Modified schedules are handed to a ScheduleWriter WriteBehindDelay after they were first modified.  When the
+	// schedules held outgrow the memory budget, the least recently used saved ones are dropped.
+	//
+	// The schedules are spread over shards by name.  Looking a schedule up only locks its shard, and only for as long
+	// as the lookup takes, so work on different schedules goes on in parallel.
+	class ScheduleStore
+	{
+	public:
+		// Calling Modified marks the schedule to be written back.  The changes aren't on the disk when it returns; it
+		// returns false if the schedule's last write-back failed, which Run also reports to std::cerr.
+		typedef std::function<int (Schedule &Schedule, std::function<bool ()> const &Modified)> Function;
+
+		ScheduleStore(std::size_t MemoryBudget = DefaultMemoryBudget, unsigned int Shards = DefaultShards);
+		ScheduleStore(ScheduleStore const &) = delete;
+		// Writes back any modified schedules
+		~ScheduleStore();
+
+		// Runs Function on the schedule in FileName with that schedule locked, and returns what it returns
+		int Run(std::string const &FileName, Function const &Function);
+
+		// Writes back every modified schedule now and waits for the writes.  Returns false if any couldn't be written;
+		// those are tried again later.
+		bool WriteBack();
+
+		std::size_t GetResidentCount() const;
+		// The memory held by resident schedules, in bytes.  Schedule::GetMemoryUsage counts it when a schedule is read
+		// and when its shard is over budget; in between, it is estimated from the number of activities.
+		std::size_t GetResidentSize() const;
+
+		static std::size_t const				DefaultMemoryBudget = 256 * 1024 * 1024;
+		static unsigned int const				DefaultShards = 64;
+		static std::chrono::milliseconds const	WriteBehindDelay;
+
+	private:
+		struct Implementation;
+
+		Implementation *Data;
+	};
+}
+
+#endif
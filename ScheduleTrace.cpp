@@ -0,0 +1,259 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <unistd.h>
+
+#include "ScheduleTrace.hpp"
+
+using namespace Schedule;
+
+namespace
+{
+	struct Event
+	{
+		char const		*Name;
+		char const		*Category;
+		char const		*ArgumentName;
+		long long		Argument;
+		long long		Start;		// Nanoseconds on the steady clock
+		long long		Duration;
+		unsigned int	Thread;
+	};
+
+
+	struct ThreadBuffer;
+
+	// Guards everything below, but not the contents of the buffers, which have their own locks
+	std::mutex					TraceMutex;
+	std::string					TraceFileName;
+	std::set<ThreadBuffer *>	Buffers;
+	std::vector<Event>			Retired;		// Events of threads that have exited, oldest first
+	unsigned long long			Dropped = 0;
+	unsigned int				NextThread = 1;
+
+	std::size_t const RetiredLimit = 16 * ScheduleTrace::BufferSize;
+
+
+	// A thread's ring of events.  Only its own thread records into it, so its lock is only contended while a trace
+	// is being started or written.
+	struct ThreadBuffer
+	{
+		ThreadBuffer() :
+			Recorded(0)
+		{
+			std::lock_guard<std::mutex> Lock(TraceMutex);
+
+			this->Thread = NextThread++;
+			Buffers.insert(this);
+		}
+
+		// A thread's events outlive it, until the trace is written
+		~ThreadBuffer()
+		{
+			std::lock_guard<std::mutex> Lock(TraceMutex);
+			std::lock_guard<std::mutex> BufferLock(this->Mutex);
+
+			this->Collect(Retired);
+			Buffers.erase(this);
+
+			// Only the newest events of threads that have exited are kept
+			if (Retired.size() > RetiredLimit)
+			{
+				Dropped += Retired.size() - RetiredLimit;
+				Retired.erase(Retired.begin(), Retired.end() - RetiredLimit);
+			}
+		}
+
+		// Appends the kept events to Out, oldest first, and empties the ring.  Must be called with the lock held.
+		void Collect(std::vector<Event> &Out)
+		{
+			std::size_t const Size = this->Events.size();
+
+			if (this->Recorded > Size)
+			{
+				Dropped += this->Recorded - Size;
+
+				for (std::size_t Index = 0; Index < Size; Index++)
+					Out.push_back(this->Events[(this->Recorded + Index) % Size]);
+			}
+			else
+				Out.insert(Out.end(), this->Events.begin(), this->Events.begin() + this->Recorded);
+
+			this->Recorded = 0;
+		}
+
+		std::mutex			Mutex;
+		std::vector<Event>	Events;		// Allocated on the first event
+		unsigned long long	Recorded;
+		unsigned int		Thread;
+	};
+
+
+	ThreadBuffer &GetThreadBuffer()
+	{
+		thread_local ThreadBuffer Buffer;
+		return Buffer;
+	}
+
+
+	void WriteString(std::ostream &Stream, char const *String)
+	{
+		Stream << '"';
+
+		for (; *String != '\0'; String++)
+		{
+			if (*String == '"' || *String == '\\')
+				Stream << '\\';
+
+			Stream << *String;
+		}
+
+		Stream << '"';
+	}
+
+
+	// Chrome traces count in microseconds
+	void WriteMicroseconds(std::ostream &Stream, long long Nanoseconds)
+	{
+		char Fraction[] = ".000";
+		for (int Digit = 3; Digit > 0; Digit--, Nanoseconds /= 10)
+			Fraction[Digit] = '0' + Nanoseconds % 10;
+
+		Stream << Nanoseconds << Fraction;
+	}
+}
+
+std::atomic<bool> ScheduleTrace::Started(false);
+
+
+void ScheduleTrace::Start(std::string const &FileName)
+{
+	std::lock_guard<std::mutex> Lock(TraceMutex);
+
+	for (auto Buffer : Buffers)
+	{
+		std::lock_guard<std::mutex> BufferLock(Buffer->Mutex);
+		Buffer->Recorded = 0;
+	}
+
+	Retired.clear();
+	Dropped = 0;
+	TraceFileName = FileName;
+
+	Started.store(true, std::memory_order_relaxed);
+}
+
+
+bool ScheduleTrace::Stop()
+{
+	if (!Started.exchange(false))
+		return true;
+
+	std::vector<Event> Events;
+	std::string FileName;
+	unsigned long long DroppedEvents;
+	{
+		std::lock_guard<std::mutex> Lock(TraceMutex);
+
+		Events.swap(Retired);
+
+		for (auto Buffer : Buffers)
+		{
+			std::lock_guard<std::mutex> BufferLock(Buffer->Mutex);
+			Buffer->Collect(Events);
+		}
+
+		FileName.swap(TraceFileName);
+		DroppedEvents = Dropped;
+	}
+
+	std::ofstream File(FileName);
+	if (!File)
+	{
+		std::cerr << FileName << ": cannot open file" << std::endl;
+		return false;
+	}
+
+	pid_t const Process = getpid();
+
+	File << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << DroppedEvents << "},\"traceEvents\":[";
+
+	for (std::vector<Event>::size_type Index = 0; Index < Events.size(); Index++)
+	{
+		Event const &Current = Events[Index];
+
+		File << (Index != 0 ? ",\n" : "\n") << "{\"ph\":\"X\",\"pid\":" << Process << ",\"tid\":" << Current.Thread <<
+				",\"name\":";
+		WriteString(File, Current.Name);
+		File << ",\"cat\":";
+		WriteString(File, Current.Category);
+		File << ",\"ts\":";
+		WriteMicroseconds(File, Current.Start);
+		File << ",\"dur\":";
+		WriteMicroseconds(File, Current.Duration);
+
+		if (Current.ArgumentName != nullptr)
+		{
+			File << ",\"args\":{";
+			WriteString(File, Current.ArgumentName);
+			File << ":" << Current.Argument << "}";
+		}
+
+		File << "}";
+	}
+
+	File << "\n]}\n";
+	File.close();
+
+	if (!File)
+	{
+		std::cerr << FileName << ": write failed" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+void ScheduleTrace::Record(char const *Name, char const *Category, char const *ArgumentName, long long Argument,
+						   std::chrono::steady_clock::time_point const &Start,
+						   std::chrono::steady_clock::time_point const &End)
+{
+	ThreadBuffer &Buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> Lock(Buffer.Mutex);
+
+	if (Buffer.Events.empty())
+		Buffer.Events.resize(BufferSize);
+
+	Event &Recorded = Buffer.Events[Buffer.Recorded++ % BufferSize];
+
+	Recorded.Name = Name;
+	Recorded.Category = Category;
+	Recorded.ArgumentName = ArgumentName;
+	Recorded.Argument = Argument;
+	Recorded.Start = std::chrono::duration_cast<std::chrono::nanoseconds>(Start.time_since_epoch()).count();
+	Recorded.Duration = std::chrono::duration_cast<std::chrono::nanoseconds>(End - Start).count();
+	Recorded.Thread = Buffer.Thread;
+}
@@ -0,0 +1,149 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULETRACE
+#define SCHEDULE_SCHEDULETRACE
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace Schedule
+{
+	// Records spans of work as Chrome trace events, which chrome://tracing and Perfetto can open.  Each thread records
+	// into its own ring buffer, so spans on different threads never contend, and only the most recent events of a
+	// long trace are kept.  While no trace is started, a span costs a single relaxed load.
+	class ScheduleTrace
+	{
+	public:
+		// Starts recording, discarding anything recorded before.  The trace is written to FileName by Stop.
+		static void Start(std::string const &FileName);
+
+		// Stops recording and writes the trace out.  Spans still open on other threads may be lost.  Returns false
+		// if the file couldn't be written; does nothing and returns true if no trace was started.
+		static bool Stop();
+
+		static bool IsStarted() { return Started.load(std::memory_order_relaxed); }
+
+		// Events kept per thread.  Older events are overwritten once a thread records more.
+		static std::size_t const BufferSize = 16384;
+
+		// Where a span's time is added, in nanoseconds, besides the trace: a count, a count that many threads add to,
+		// or nowhere
+		class Tally
+		{
+		public:
+			Tally() :
+				Count(nullptr),
+				SharedCount(nullptr)
+			{
+
+			}
+
+			Tally(unsigned long long &Count) :
+				Count(&Count),
+				SharedCount(nullptr)
+			{
+
+			}
+
+			Tally(std::atomic<unsigned long long> &SharedCount) :
+				Count(nullptr),
+				SharedCount(&SharedCount)
+			{
+
+			}
+
+			bool IsEmpty() const { return this->Count == nullptr && this->SharedCount == nullptr; }
+
+			void Add(unsigned long long Nanoseconds) const
+			{
+				if (this->Count != nullptr)
+					*this->Count += Nanoseconds;
+				else if (this->SharedCount != nullptr)
+					this->SharedCount->fetch_add(Nanoseconds, std::memory_order_relaxed);
+			}
+
+		private:
+			unsigned long long				*Count;
+			std::atomic<unsigned long long>	*SharedCount;
+		};
+
+		// Records the time from its construction to its destruction while a trace is started, and adds it to Timed.
+		// The clock is only read if one of them needs it.  Name, Category, and ArgumentName must be string literals, or
+		// otherwise outlive the trace.
+		class Span
+		{
+		public:
+			Span(char const *Name, char const *Category, char const *ArgumentName = nullptr, long long Argument = 0) :
+				Span(Name, Category, Tally(), ArgumentName, Argument)
+			{
+
+			}
+
+			Span(char const *Name, char const *Category, Tally const &Timed, char const *ArgumentName = nullptr,
+				 long long Argument = 0) :
+				Name(Name),
+				Category(Category),
+				ArgumentName(ArgumentName),
+				Argument(Argument),
+				Timed(Timed),
+				Traced(IsStarted()),
+				Start(this->Traced || !Timed.IsEmpty() ? std::chrono::steady_clock::now() :
+														 std::chrono::steady_clock::time_point())
+			{
+
+			}
+
+			~Span()
+			{
+				if (!this->Traced && this->Timed.IsEmpty())
+					return;
+
+				std::chrono::steady_clock::time_point const End = std::chrono::steady_clock::now();
+
+				this->Timed.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(End - this->Start).count());
+
+				if (this->Traced)
+					Record(this->Name, this->Category, this->ArgumentName, this->Argument, this->Start, End);
+			}
+
+			Span(Span const &) = delete;
+			Span &operator=(Span const &) = delete;
+
+		private:
+			char const * const							Name;
+			char const * const							Category;
+			char const * const							ArgumentName;
+			long long const								Argument;
+			Tally const									Timed;
+			bool const									Traced;
+			std::chrono::steady_clock::time_point const	Start;
+		};
+
+	private:
+		static void Record(char const *Name, char const *Category, char const *ArgumentName, long long Argument,
+						   std::chrono::steady_clock::time_point const &Start,
+						   std::chrono::steady_clock::time_point const &End);
+
+		static std::atomic<bool> Started;
+	};
+}
+
+#endif
@@ -0,0 +1,514 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "Activity.hpp"
+#include "ScheduleFileIO.hpp"
+#include "ScheduleJournal.hpp"
+#include "ScheduleWatch.hpp"
+
+using namespace Schedule;
+
+namespace
+{
+	volatile std::sig_atomic_t Stopping = 0;
+	volatile std::sig_atomic_t Resized = 0;
+
+
+	void HandleStopSignal(int)
+	{
+		Stopping = 1;
+	}
+
+
+	void HandleResizeSignal(int)
+	{
+		Resized = 1;
+	}
+
+
+	typedef std::vector<Schedule::Schedule::ActivityRange> RangeList;
+
+
+	void AddRange(RangeList &Ranges, Schedule::Schedule::size_type First, Schedule::Schedule::size_type Count)
+	{
+		if (!Ranges.empty() && Ranges.back().First + Ranges.back().Count == First)
+			Ranges.back().Count += Count;
+		else
+		{
+			Schedule::Schedule::ActivityRange const Range = { First, Count };
+			Ranges.push_back(Range);
+		}
+	}
+
+
+	// Sorts the ranges and joins those that overlap or touch
+	void JoinRanges(RangeList &Ranges)
+	{
+		std::sort(Ranges.begin(), Ranges.end(),
+			[](Schedule::Schedule::ActivityRange const &a, Schedule::Schedule::ActivityRange const &b) { return a.First < b.First; });
+
+		RangeList Joined;
+
+		for (auto &Range : Ranges)
+		{
+			if (!Joined.empty() && Range.First <= Joined.back().First + Joined.back().Count)
+			{
+				Joined.back().Count = std::max(Joined.back().Count, Range.First + Range.Count - Joined.back().First);
+			}
+			else
+				Joined.push_back(Range);
+		}
+
+		Ranges.swap(Joined);
+	}
+
+
+	// The local time of day, and the wall clock time it was read at
+	Offset GetTimeOfDay(std::time_t &Now)
+	{
+		Now = std::time(nullptr);
+
+		std::tm Local;
+		localtime_r(&Now, &Local);
+
+		return Offset(Local.tm_hour, Local.tm_min, Local.tm_sec);
+	}
+
+
+	Schedule::Schedule::size_type GetCurrent(Schedule::Schedule const &Watched, Offset const &Now)
+	{
+		Schedule::Schedule::size_type Index = 0;
+
+		for (auto Current : Watched)
+		{
+			if (Current->GetActualStartTime() <= Now && Now < Current->GetActualEndTime())
+				break;
+
+			Index++;
+		}
+
+		return Index;
+	}
+
+
+	bool SameBeginning(Offset const *a, Offset const *b)
+	{
+		return (a == nullptr || b == nullptr ? a == b : *a == *b);
+	}
+}
+
+struct Schedule::ScheduleWatch::Implementation
+{
+	Implementation(std::string const &FileName, Redraw const &Draw, ScheduleEvents::Handler const &Transition) :
+		FileName(FileName),
+		Draw(Draw),
+		Transition(Transition),
+		Current(0),
+		Notifications(-1),
+		Timer(-1)
+	{
+
+	}
+
+	std::string				FileName;
+	Redraw					Draw;
+	ScheduleEvents::Handler	Transition;
+
+	Schedule					Watched;
+	Schedule::size_type			Current;
+
+	// The activities the last layouts moved, as told to the schedule's observer
+	RangeList					Moved;
+
+	std::unique_ptr<ScheduleEvents>	Events;
+
+	int Notifications;
+	int Timer;
+
+	bool Watch();
+	void SetTimer();
+
+	void Reload();
+	void Tick();
+};
+
+
+ScheduleWatch::ScheduleWatch(std::string const &FileName, Redraw const &Draw, ScheduleEvents::Handler const &Transition) :
+	Data(new Implementation(FileName, Draw, Transition))
+{
+
+}
+
+
+ScheduleWatch::~ScheduleWatch()
+{
+	if (this->Data->Notifications >= 0)
+		close(this->Data->Notifications);
+
+	if (this->Data->Timer >= 0)
+		close(this->Data->Timer);
+
+	// The events observe the schedule, so they go first
+	this->Data->Events.reset();
+
+	delete this->Data;
+}
+
+
+int ScheduleWatch::Run()
+{
+	{
+		std::ostringstream Errors;
+		this->Data->Watched = ScheduleFileIO::Read(this->Data->FileName, Errors);
+		std::cerr << Errors.str();
+	}
+
+	if (!this->Data->Watch())
+		return 2;
+
+	this->Data->Watched.AddObserver([this](Schedule const &, RangeList const &Ranges)
+	{
+		this->Data->Moved.insert(this->Data->Moved.end(), Ranges.begin(), Ranges.end());
+	});
+
+	{
+		struct sigaction Action;
+		std::memset(&Action, 0, sizeof(Action));
+
+		// No SA_RESTART, so that poll is interrupted
+		Action.sa_handler = HandleStopSignal;
+		sigaction(SIGINT, &Action, nullptr);
+		sigaction(SIGTERM, &Action, nullptr);
+
+		Action.sa_handler = HandleResizeSignal;
+		sigaction(SIGWINCH, &Action, nullptr);
+	}
+
+	{
+		std::time_t Now;
+		Offset const TimeOfDay = GetTimeOfDay(Now);
+
+		this->Data->Events.reset(new ScheduleEvents(this->Data->Watched, TimeOfDay,
+			[this](Activity const &Changed, ScheduleEvents::Transition Kind, Offset const &At)
+			{
+				if (this->Data->Transition)
+					this->Data->Transition(Changed, Kind, At);
+			}));
+
+		this->Data->Current = GetCurrent(this->Data->Watched, TimeOfDay);
+		this->Data->Draw(this->Data->Watched, this->Data->Current, RangeList(), true);
+	}
+
+	while (!Stopping)
+	{
+		this->Data->SetTimer();
+
+		pollfd Watched[] = { { this->Data->Notifications, POLLIN, 0 }, { this->Data->Timer, POLLIN, 0 } };
+		int const Result = poll(Watched, 2, -1);
+
+		if (Resized)
+		{
+			Resized = 0;
+			this->Data->Draw(this->Data->Watched, this->Data->Current, RangeList(), true);
+		}
+
+		if (Result < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			std::cerr << "poll: " << std::strerror(errno) << std::endl;
+			return 2;
+		}
+
+		if (Watched[0].revents & POLLIN)
+			this->Data->Reload();
+
+		if (Watched[1].revents & POLLIN)
+			this->Data->Tick();
+	}
+
+	return 0;
+}
+
+
+bool ScheduleWatch::Merge(Schedule &Target, Schedule const &Source, RangeList &Changed)
+{
+	bool Reshaped = false;
+
+	if (Target.GetLength() != Source.GetLength())
+	{
+		Target.SetLength(Source.GetLength());
+		Reshaped = true;
+	}
+
+	Schedule::iterator TargetIterator = Target.begin();
+	Schedule::const_iterator SourceIterator = Source.begin();
+	Schedule::size_type Index = 0;
+
+	for (; TargetIterator != Target.end() && SourceIterator != Source.end(); ++TargetIterator, ++SourceIterator, Index++)
+	{
+		Activity &Into = **TargetIterator;
+		Activity const &From = **SourceIterator;
+
+		bool Modified = false;
+
+		if (Into.GetName() != From.GetName())
+		{
+			Into.SetName(From.GetName());
+			Modified = true;
+		}
+
+		if (Into.GetStartMode() != From.GetStartMode())
+		{
+			Into.SetStartMode(From.GetStartMode());
+			Modified = true;
+		}
+
+		if (Into.GetLengthMode() != From.GetLengthMode())
+		{
+			Into.SetLengthMode(From.GetLengthMode());
+			Modified = true;
+		}
+
+		if (Into.GetDesiredStartTime() != From.GetDesiredStartTime())
+		{
+			Into.SetDesiredStartTime(From.GetDesiredStartTime());
+			Modified = true;
+		}
+
+		if (Into.GetDesiredLength() != From.GetDesiredLength())
+		{
+			Into.SetDesiredLength(From.GetDesiredLength());
+			Modified = true;
+		}
+
+		if (!SameBeginning(Into.GetBeginning(), From.GetBeginning()))
+		{
+			if (From.GetBeginning() != nullptr)
+				Target.BeginActivity(Into, *From.GetBeginning());
+			else
+				Target.ClearBeginning(Into);
+
+			Modified = true;
+		}
+
+		if (Modified)
+			AddRange(Changed, Index, 1);
+	}
+
+	if (TargetIterator != Target.end() || SourceIterator != Source.end())
+		Reshaped = true;
+
+	while (TargetIterator != Target.end())
+	{
+		Activity * const Removed = *TargetIterator;
+
+		TargetIterator = Target.erase(TargetIterator);
+		delete Removed;
+	}
+
+	for (; SourceIterator != Source.end(); ++SourceIterator, Index++)
+	{
+		Target.push_back(new Activity(**SourceIterator));
+		AddRange(Changed, Index, 1);
+	}
+
+	Offset const * const TargetPause = Target.GetActivePause();
+	Offset const * const SourcePause = Source.GetActivePause();
+
+	if (Target.GetPauses() != Source.GetPauses() || !SameBeginning(TargetPause, SourcePause))
+	{
+		Target.ClearPauses();
+
+		for (auto &Pause : Source.GetPauses())
+			Target.AddPause(Pause.first, Pause.second);
+
+		if (SourcePause != nullptr)
+			Target.Pause(*SourcePause);
+
+		Reshaped = true;
+	}
+
+	return Reshaped;
+}
+
+
+// Watches the directory rather than the file, since saves rename a new file over the old one, and then delete the
+// journal, if there was one
+bool Schedule::ScheduleWatch::Implementation::Watch()
+{
+	std::string::size_type const Slash = this->FileName.rfind('/');
+	std::string const Directory = (Slash == std::string::npos ? "." : (Slash == 0 ? "/" : this->FileName.substr(0, Slash)));
+
+	this->Notifications = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (this->Notifications < 0 || inotify_add_watch(this->Notifications, Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0)
+	{
+		std::cerr << Directory << ": cannot watch directory: " << std::strerror(errno) << std::endl;
+		return false;
+	}
+
+	// Wakes when the wall clock is set, too, so that a changed clock doesn't leave the timer waiting for the wrong time
+	this->Timer = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (this->Timer < 0)
+	{
+		std::cerr << "timerfd_create: " << std::strerror(errno) << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Sets the timer for when the events next need advancing, or for midnight, when the day's times start over
+void Schedule::ScheduleWatch::Implementation::SetTimer()
+{
+	std::time_t Now;
+	Offset const TimeOfDay = GetTimeOfDay(Now);
+
+	// Anything changed since the last layout sets its timers again here
+	if (!this->Watched.empty())
+		this->Watched.front()->GetActualStartTime();
+
+	Offset Next;
+	if (!this->Events->GetNextTime(Next) || Next > Offset(24, 0, 0))
+		Next = Offset(24, 0, 0);
+
+	itimerspec Setting;
+	std::memset(&Setting, 0, sizeof(Setting));
+	Setting.it_value.tv_sec = Now + (Next - TimeOfDay).GetTotalSeconds();
+
+	timerfd_settime(this->Timer, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &Setting, nullptr);
+}
+
+
+void Schedule::ScheduleWatch::Implementation::Reload()
+{
+	// Only changes to the schedule or its journal matter, and a burst of them is merged once
+	bool Relevant = false;
+	{
+		std::string::size_type const Slash = this->FileName.rfind('/');
+		std::string const Name = this->FileName.substr(Slash == std::string::npos ? 0 : Slash + 1);
+		std::string const JournalName = Name + ScheduleJournal::GetJournalFileName("");
+
+		alignas(inotify_event) char Buffer[4096];
+		ssize_t Size;
+
+		while ((Size = read(this->Notifications, Buffer, sizeof(Buffer))) > 0)
+		{
+			for (char *Position = Buffer; Position < Buffer + Size; )
+			{
+				inotify_event const * const Event = reinterpret_cast<inotify_event const *>(Position);
+
+				if (Event->len != 0 && (Name == Event->name || JournalName == Event->name))
+					Relevant = true;
+
+				Position += sizeof(inotify_event) + Event->len;
+			}
+		}
+	}
+
+	if (!Relevant)
+		return;
+
+	// A file caught part way through a change is left for the notification that finishes it
+	std::ostringstream Errors;
+	Schedule const Source = ScheduleFileIO::Read(this->FileName, Errors);
+
+	if (!Errors.str().empty())
+		return;
+
+	RangeList Changed;
+	bool const Reshaped = ScheduleWatch::Merge(this->Watched, Source, Changed);
+
+	// Lay out now, so the observer adds what moved
+	if (!this->Watched.empty())
+		this->Watched.front()->GetActualStartTime();
+
+	Changed.insert(Changed.end(), this->Moved.begin(), this->Moved.end());
+	this->Moved.clear();
+
+	std::time_t Now;
+	Schedule::size_type const Current = GetCurrent(this->Watched, GetTimeOfDay(Now));
+
+	if (Current != this->Current)
+	{
+		if (this->Current < this->Watched.size())
+			AddRange(Changed, this->Current, 1);
+
+		if (Current < this->Watched.size())
+			AddRange(Changed, Current, 1);
+
+		this->Current = Current;
+	}
+
+	JoinRanges(Changed);
+
+	if (Reshaped || !Changed.empty())
+		this->Draw(this->Watched, this->Current, Changed, Reshaped);
+}
+
+
+void Schedule::ScheduleWatch::Implementation::Tick()
+{
+	// Fails with ECANCELED when the clock was set, which only means the timer must be set again
+	std::uint64_t Expirations;
+	if (read(this->Timer, &Expirations, sizeof(Expirations)) < 0 && errno != ECANCELED)
+		return;
+
+	std::time_t Now;
+	Offset const TimeOfDay = GetTimeOfDay(Now);
+
+	this->Events->Advance(TimeOfDay);
+
+	Schedule::size_type const Current = GetCurrent(this->Watched, TimeOfDay);
+
+	if (Current == this->Current)
+		return;
+
+	RangeList Changed;
+
+	if (this->Current < this->Watched.size())
+		AddRange(Changed, this->Current, 1);
+
+	if (Current < this->Watched.size())
+		AddRange(Changed, Current, 1);
+
+	this->Current = Current;
+
+	JoinRanges(Changed);
+	this->Draw(this->Watched, this->Current, Changed, false);
+}
@@ -0,0 +1,65 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEWATCH
+#define SCHEDULE_SCHEDULEWATCH
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Schedule.hpp"
+#include "ScheduleEvents.hpp"
+
+namespace Schedule
+{
+	// Keeps a schedule file in memory while it is shown, and redraws only what changes.  Changes other programs make
+	// to the file or its journal are noticed through inotify and merged into the schedule activity by activity, and a
+	// timer set for the next time an activity starts or ends, as ScheduleEvents keeps them, moves the mark of the
+	// activity under way.  In between, the watch sleeps in poll.
+	class ScheduleWatch
+	{
+	public:
+		// Draws Watched.  Current is the index of the activity under way, or Watched.size() if there is none.  Unless
+		// Everything is set, only the activities in Changed need drawing again.
+		typedef std::function<void (Schedule const &Watched, Schedule::size_type Current,
+									std::vector<Schedule::ActivityRange> const &Changed, bool Everything)> Redraw;
+
+		// Transition, if given, is called as each activity starts and ends
+		ScheduleWatch(std::string const &FileName, Redraw const &Draw,
+					  ScheduleEvents::Handler const &Transition = ScheduleEvents::Handler());
+		ScheduleWatch(ScheduleWatch const &) = delete;
+		~ScheduleWatch();
+
+		// Draws the schedule, then watches it until interrupted or terminated.  Returns 2 if the file's directory
+		// can't be watched.
+		int Run();
+
+		// Makes Target like Source, changing only the activities that differ from Source's.  The indices of the
+		// changed activities are added to Changed.  Returns true if the schedule's length, size, or pauses changed.
+		static bool Merge(Schedule &Target, Schedule const &Source, std::vector<Schedule::ActivityRange> &Changed);
+
+	private:
+		struct Implementation;
+
+		Implementation *Data;
+	};
+}
+
+#endif
@@ -0,0 +1,209 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "ScheduleFileIO.hpp"
+#include "ScheduleSnapshot.hpp"
+#include "ScheduleWriter.hpp"
+
+using namespace Schedule;
+
+struct Schedule::ScheduleWriter::Implementation
+{
+	Implementation() :
+		Writing(false),
+		Failed(false),
+		Stopping(false)
+	{
+
+	}
+
+	struct PendingSave
+	{
+		ScheduleSnapshot		Snapshot;
+		std::vector<Callback>	Callbacks;
+	};
+
+	std::mutex											Mutex;
+	std::condition_variable								Queued;
+	std::condition_variable								Finished;
+	std::deque<std::string>								Order;	// File names, in the order they were first queued
+	std::unordered_map<std::string, PendingSave>		Pending;
+	bool												Writing;
+	bool												Failed;
+	bool												Stopping;
+	std::thread											Writer;
+
+	void Write();
+};
+
+
+ScheduleWriter::ScheduleWriter() :
+	Data(new Implementation)
+{
+	// The writer mustn't take signals meant for the threads saving
+	sigset_t All;
+	sigset_t Previous;
+	sigfillset(&All);
+
+	pthread_sigmask(SIG_SETMASK, &All, &Previous);
+	this->Data->Writer = std::thread(&Implementation::Write, this->Data);
+	pthread_sigmask(SIG_SETMASK, &Previous, nullptr);
+}
+
+
+ScheduleWriter::~ScheduleWriter()
+{
+	{
+		std::lock_guard<std::mutex> Lock(this->Data->Mutex);
+		this->Data->Stopping = true;
+	}
+
+	this->Data->Queued.notify_one();
+	this->Data->Writer.join();
+
+	delete this->Data;
+}
+
+
+void ScheduleWriter::Save(Schedule &Schedule, std::string const &FileName, Callback const &Done)
+{
+	this->Save(Schedule.GetSnapshot(), FileName, Done);
+}
+
+
+void ScheduleWriter::Save(ScheduleSnapshot const &Snapshot, std::string const &FileName, Callback const &Done)
+{
+	// A replaced snapshot is freed after the lock is released, so the writer isn't held up
+	ScheduleSnapshot Replaced;
+
+	{
+		std::lock_guard<std::mutex> Lock(this->Data->Mutex);
+
+		std::unordered_map<std::string, Implementation::PendingSave>::iterator Found = this->Data->Pending.find(FileName);
+
+		if (Found == this->Data->Pending.end())
+		{
+			Found = this->Data->Pending.insert(std::make_pair(FileName, Implementation::PendingSave{ Snapshot, { } })).first;
+			this->Data->Order.push_back(FileName);
+		}
+		else
+		{
+			Replaced = Found->second.Snapshot;
+			Found->second.Snapshot = Snapshot;
+		}
+
+		if (Done)
+			Found->second.Callbacks.push_back(Done);
+	}
+
+	this->Data->Queued.notify_one();
+}
+
+
+bool ScheduleWriter::Flush()
+{
+	std::unique_lock<std::mutex> Lock(this->Data->Mutex);
+
+	this->Data->Finished.wait(Lock, [&]() { return this->Data->Pending.empty() && !this->Data->Writing; });
+
+	bool const Succeeded = !this->Data->Failed;
+	this->Data->Failed = false;
+
+	return Succeeded;
+}
+
+
+std::size_t ScheduleWriter::GetPendingCount() const
+{
+	std::lock_guard<std::mutex> Lock(this->Data->Mutex);
+	return this->Data->Pending.size();
+}
+
+
+void Schedule::ScheduleWriter::Implementation::Write()
+{
+	std::unique_lock<std::mutex> Lock(this->Mutex);
+
+	std::function<bool ()> const Woken = [&]() { return !this->Order.empty() || this->Stopping; };
+
+	while (true)
+	{
+		// Saves whose fsyncs were deferred are synced once they are due, if nothing else is written first
+		std::chrono::steady_clock::time_point SyncDeadline;
+
+		if (!ScheduleFileIO::GetSyncDeadline(SyncDeadline))
+			this->Queued.wait(Lock, Woken);
+		else if (!this->Queued.wait_until(Lock, SyncDeadline, Woken))
+		{
+			this->Writing = true;
+			Lock.unlock();
+
+			bool const Synced = ScheduleFileIO::Sync();
+
+			Lock.lock();
+			this->Writing = false;
+
+			if (!Synced)
+				this->Failed = true;
+
+			this->Finished.notify_all();
+			continue;
+		}
+
+		// Whatever is waiting when the writer is stopped is still written
+		if (this->Order.empty())
+			return;
+
+		std::string const FileName = this->Order.front();
+		this->Order.pop_front();
+
+		PendingSave Save = std::move(this->Pending[FileName]);
+		this->Pending.erase(FileName);
+
+		this->Writing = true;
+		Lock.unlock();
+
+		timespec ModificationTime{0, 0};
+		bool const Written = ScheduleFileIO::Write(Save.Snapshot, FileName, std::cerr, &ModificationTime);
+
+		for (auto &Done : Save.Callbacks)
+			Done(Written, ModificationTime);
+
+		Lock.lock();
+		this->Writing = false;
+
+		if (!Written)
+			this->Failed = true;
+
+		this->Finished.notify_all();
+	}
+}
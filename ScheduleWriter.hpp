@@ -0,0 +1,65 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_SCHEDULEWRITER
+#define SCHEDULE_SCHEDULEWRITER
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include <time.h>
+
+#include "Schedule.hpp"
+
+namespace Schedule
+{
+	// Saves schedules on a background thread.  The caller only pays for a snapshot of the schedule; serializing it
+	// and writing it out happen on the writer's thread.  Saving a file that is still waiting to be written replaces
+	// the waiting snapshot, so a burst of saves costs a single write.  Fsyncs ScheduleFileIO defers are performed by
+	// the writer once they are due.  Problems are reported to std::cerr.
+	class ScheduleWriter
+	{
+	public:
+		// Called on the writer's thread once the save, or a later one that replaced it, has been attempted.  If it was
+		// written, ModificationTime is the file's as the writer left it.
+		typedef std::function<void (bool Written, timespec const &ModificationTime)> Callback;
+
+		ScheduleWriter();
+		ScheduleWriter(ScheduleWriter const &) = delete;
+		// Finishes every waiting save
+		~ScheduleWriter();
+
+		void Save(Schedule &Schedule, std::string const &FileName, Callback const &Done = Callback());
+		void Save(ScheduleSnapshot const &Snapshot, std::string const &FileName, Callback const &Done = Callback());
+
+		// Waits until every save made so far has been attempted.  Returns false if any save has failed since the last
+		// call.
+		bool Flush();
+
+		std::size_t GetPendingCount() const;
+
+	private:
+		struct Implementation;
+
+		Implementation *Data;
+	};
+}
+
+#endif
@@ -0,0 +1,176 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "ThreadPool.hpp"
+
+using namespace Schedule;
+
+namespace
+{
+	struct Job
+	{
+		std::function<void ()> const	*Task;
+		unsigned int					Unclaimed;	// Calls no pool thread has started
+		unsigned int					Running;
+		std::condition_variable			Finished;
+	};
+}
+
+struct Schedule::ThreadPool::Implementation
+{
+	Implementation() :
+		Stopping(false)
+	{
+
+	}
+
+	std::mutex					Mutex;
+	std::condition_variable		Queued;
+	std::deque<Job *>			Jobs;		// Jobs with calls left to start, oldest first
+	std::vector<std::thread>	Threads;
+	bool						Stopping;
+
+	void Work();
+};
+
+
+ThreadPool::ThreadPool() :
+	Data(new Implementation)
+{
+
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> Lock(this->Data->Mutex);
+		this->Data->Stopping = true;
+	}
+
+	this->Data->Queued.notify_all();
+
+	for (auto &Thread : this->Data->Threads)
+		Thread.join();
+
+	delete this->Data;
+}
+
+
+std::size_t ThreadPool::GetThreads() const
+{
+	std::lock_guard<std::mutex> Lock(this->Data->Mutex);
+	return this->Data->Threads.size();
+}
+
+
+void ThreadPool::Run(unsigned int Helpers, std::function<void ()> const &Task)
+{
+	if (Helpers == 0)
+	{
+		Task();
+		return;
+	}
+
+	Job Current;
+	Current.Task = &Task;
+	Current.Unclaimed = Helpers;
+	Current.Running = 0;
+
+	{
+		std::lock_guard<std::mutex> Lock(this->Data->Mutex);
+
+		if (this->Data->Threads.size() < Helpers)
+		{
+			// Pool threads mustn't take signals meant for the threads using the pool
+			sigset_t All;
+			sigset_t Previous;
+			sigfillset(&All);
+
+			pthread_sigmask(SIG_SETMASK, &All, &Previous);
+
+			while (this->Data->Threads.size() < Helpers)
+				this->Data->Threads.emplace_back(&Implementation::Work, this->Data);
+
+			pthread_sigmask(SIG_SETMASK, &Previous, nullptr);
+		}
+
+		this->Data->Jobs.push_back(&Current);
+	}
+
+	for (unsigned int Helper = 0; Helper < Helpers; Helper++)
+		this->Data->Queued.notify_one();
+
+	Task();
+
+	std::unique_lock<std::mutex> Lock(this->Data->Mutex);
+
+	if (Current.Unclaimed != 0)
+	{
+		this->Data->Jobs.erase(std::find(this->Data->Jobs.begin(), this->Data->Jobs.end(), &Current));
+		Current.Unclaimed = 0;
+	}
+
+	Current.Finished.wait(Lock, [&Current]() { return Current.Running == 0; });
+}
+
+
+ThreadPool &ThreadPool::GetShared()
+{
+	static ThreadPool * const Shared = new ThreadPool;
+	return *Shared;
+}
+
+
+void ThreadPool::Implementation::Work()
+{
+	std::unique_lock<std::mutex> Lock(this->Mutex);
+
+	for (;;)
+	{
+		this->Queued.wait(Lock, [this]() { return this->Stopping || !this->Jobs.empty(); });
+
+		if (this->Stopping)
+			return;
+
+		Job &Claimed = *this->Jobs.front();
+
+		if (--Claimed.Unclaimed == 0)
+			this->Jobs.pop_front();
+
+		Claimed.Running++;
+
+		Lock.unlock();
+		(*Claimed.Task)();
+		Lock.lock();
+
+		if (--Claimed.Running == 0 && Claimed.Unclaimed == 0)
+			Claimed.Finished.notify_all();
+	}
+}
@@ -0,0 +1,56 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_THREADPOOL
+#define SCHEDULE_THREADPOOL
+
+#include <cstddef>
+#include <functional>
+
+namespace Schedule
+{
+	// Threads kept waiting for work, so that work split across cores doesn't pay to start and stop threads each time.
+	// The pool grows to as many threads as it is asked for at once, and they last as long as it does.
+	class ThreadPool
+	{
+	public:
+		ThreadPool();
+		ThreadPool(ThreadPool const &) = delete;
+		// Waits for the pool's threads to finish what they are running
+		~ThreadPool();
+
+		std::size_t GetThreads() const;
+
+		// Calls Task on this thread and on up to Helpers of the pool's, and returns once every call has returned.
+		// Calls that no pool thread has started by the time this thread's returns are skipped, so Task should take
+		// its work from a shared queue until the queue is empty.
+		void Run(unsigned int Helpers, std::function<void ()> const &Task);
+
+		// The pool shared by the whole process.  It is never destroyed, so its threads can run work for other static
+		// objects' destructors.
+		static ThreadPool &GetShared();
+
+	private:
+		struct Implementation;
+
+		Implementation *Data;
+	};
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#include "TimingWheel.hpp"
+
+using namespace Schedule;
+
+// A timer sits in the lowest wheel whose span, counted from the start of the current time's slot in the wheel above,
+// reaches it: the lowest level k at which its time and the current time agree on every bit above the first
+// SlotBits * (k + 1).  As the current time enters a slot of a higher wheel, that slot's timers are placed again, and
+// so move down a level.
+
+TimingWheel::Entry::Entry() :
+	At(0),
+	Context(nullptr),
+	Next(nullptr),
+	Previous(nullptr)
+{
+
+}
+
+
+TimingWheel::TimingWheel(Time Now) :
+	Current(Now),
+	Pending(0)
+{
+	for (auto &Wheel : this->Wheels)
+	{
+		for (auto &Head : Wheel)
+			Head.Next = Head.Previous = &Head;
+	}
+
+	this->Due.Next = this->Due.Previous = &this->Due;
+	this->Overflow.Next = this->Overflow.Previous = &this->Overflow;
+}
+
+
+// Leaves the entries still pending unlinked, so their owners see them as not pending
+TimingWheel::~TimingWheel()
+{
+	auto const Clear = [](Entry &Head)
+	{
+		while (Head.Next != &Head)
+			Unlink(*Head.Next);
+	};
+
+	for (auto &Wheel : this->Wheels)
+	{
+		for (auto &Head : Wheel)
+			Clear(Head);
+	}
+
+	Clear(this->Due);
+	Clear(this->Overflow);
+}
+
+
+TimingWheel::Time	TimingWheel::GetTime() const	{ return this->Current; }
+std::size_t			TimingWheel::size() const		{ return this->Pending; }
+
+
+void TimingWheel::Insert(Entry &Added, Time At)
+{
+	this->Cancel(Added);
+
+	Added.At = At;
+	this->Place(Added);
+
+	this->Pending++;
+}
+
+
+void TimingWheel::Cancel(Entry &Cancelled)
+{
+	if (!Cancelled.IsPending())
+		return;
+
+	Unlink(Cancelled);
+	this->Pending--;
+}
+
+
+void TimingWheel::Advance(Time Now, std::function<void (Entry &Fired)> const &Fire)
+{
+	// Timers inserted while firing, even those already due, wait for the next slot or the next Advance
+	auto const FireAll = [&](Entry &Head)
+	{
+		Entry Firing;
+		Splice(Head, Firing);
+
+		while (Firing.Next != &Firing)
+		{
+			Entry &Fired = *Firing.Next;
+
+			Unlink(Fired);
+			this->Pending--;
+
+			Fire(Fired);
+		}
+	};
+
+	FireAll(this->Due);
+
+	while (this->Current < Now)
+	{
+		// Skip straight to the second before anything happens, since no slot until then holds anything
+		Time Next;
+		if (!this->GetNextTime(Next) || Next > Now)
+		{
+			this->Current = Now;
+			break;
+		}
+
+		if (Next > this->Current + 1)
+			this->Current = Next - 1;
+
+		this->Current++;
+
+		if ((this->Current & ((Time(1) << (SlotBits * Levels)) - 1)) == 0)
+			this->Cascade(this->Overflow);
+
+		for (int Level = Levels - 1; Level > 0; Level--)
+		{
+			if ((this->Current & ((Time(1) << (SlotBits * Level)) - 1)) == 0)
+				this->Cascade(this->Wheels[Level][(this->Current >> (SlotBits * Level)) & (Slots - 1)]);
+		}
+
+		FireAll(this->Wheels[0][this->Current & (Slots - 1)]);
+	}
+}
+
+
+bool TimingWheel::GetNextTime(Time &Next) const
+{
+	if (this->Due.Next != &this->Due)
+	{
+		Next = this->Current;
+		return true;
+	}
+
+	// Each wheel's slots come after all of those in the wheels below it
+	for (int Level = 0; Level < Levels; Level++)
+	{
+		int const Shift = SlotBits * Level;
+		Time const Block = (this->Current >> (Shift + SlotBits)) << (Shift + SlotBits);
+
+		for (int Slot = ((this->Current >> Shift) & (Slots - 1)) + 1; Slot < Slots; Slot++)
+		{
+			if (this->Wheels[Level][Slot].Next != &this->Wheels[Level][Slot])
+			{
+				Next = Block + (Time(Slot) << Shift);
+				return true;
+			}
+		}
+	}
+
+	if (this->Overflow.Next != &this->Overflow)
+	{
+		Next = ((this->Current >> (SlotBits * Levels)) + 1) << (SlotBits * Levels);
+		return true;
+	}
+
+	return false;
+}
+
+
+void TimingWheel::Place(Entry &Placed)
+{
+	if (Placed.At <= this->Current)
+	{
+		Link(this->Due, Placed);
+		return;
+	}
+
+	for (int Level = 0; Level < Levels; Level++)
+	{
+		int const Shift = SlotBits * (Level + 1);
+
+		if ((Placed.At >> Shift) == (this->Current >> Shift))
+		{
+			Link(this->Wheels[Level][(Placed.At >> (SlotBits * Level)) & (Slots - 1)], Placed);
+			return;
+		}
+	}
+
+	Link(this->Overflow, Placed);
+}
+
+
+// Places each of Head's timers again.  Those still out of reach of the wheels go back into the overflow list, so the
+// list is emptied first.  Those due now go into the current slot of the lowest wheel, which is fired next.
+void TimingWheel::Cascade(Entry &Head)
+{
+	Entry Moved;
+	Splice(Head, Moved);
+
+	while (Moved.Next != &Moved)
+	{
+		Entry &Placed = *Moved.Next;
+
+		Unlink(Placed);
+
+		if (Placed.At == this->Current)
+			Link(this->Wheels[0][this->Current & (Slots - 1)], Placed);
+		else
+			this->Place(Placed);
+	}
+}
+
+
+// Moves the whole of From's list onto the empty head To
+void TimingWheel::Splice(Entry &From, Entry &To)
+{
+	if (From.Next == &From)
+	{
+		To.Next = To.Previous = &To;
+		return;
+	}
+
+	To.Next = From.Next;
+	To.Previous = From.Previous;
+	To.Next->Previous = &To;
+	To.Previous->Next = &To;
+	From.Next = From.Previous = &From;
+}
+
+
+void TimingWheel::Link(Entry &Head, Entry &Linked)
+{
+	Linked.Previous = Head.Previous;
+	Linked.Next = &Head;
+	Head.Previous->Next = &Linked;
+	Head.Previous = &Linked;
+}
+
+
+void TimingWheel::Unlink(Entry &Unlinked)
+{
+	Unlinked.Previous->Next = Unlinked.Next;
+	Unlinked.Next->Previous = Unlinked.Previous;
+	Unlinked.Next = Unlinked.Previous = nullptr;
+}
@@ -0,0 +1,100 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+#ifndef SCHEDULE_TIMINGWHEEL
+#define SCHEDULE_TIMINGWHEEL
+
+#include <cstddef>
+#include <functional>
+
+namespace Schedule
+{
+	// Timers at a resolution of one second, kept in a hierarchy of wheels of 64 slots each.  Inserting and cancelling
+	// are O(1) however many timers are pending; each timer is moved down a wheel at most once per level as its time
+	// draws near.  Timers more than 2^24 seconds off wait in an overflow list until they are in reach.
+	class TimingWheel
+	{
+	public:
+		typedef long long Time;
+
+		// A timer.  Entries belong to whoever inserts them, and must stay put, and be cancelled or fired, before
+		// they are destroyed or inserted again.
+		struct Entry
+		{
+			Entry();
+			Entry(Entry const &) = delete;
+			Entry &operator=(Entry const &) = delete;
+
+			bool IsPending() const { return this->Next != nullptr; }
+
+			Time	At;
+			void   *Context;	// For the owner's use
+
+		private:
+			friend class TimingWheel;
+
+			Entry	*Next;
+			Entry	*Previous;
+		};
+
+		// The wheel starts at Now, as though every second up to it has passed
+		explicit TimingWheel(Time Now);
+		TimingWheel(TimingWheel const &) = delete;
+		~TimingWheel();
+
+		Time		GetTime() const;
+		std::size_t	size() const;
+
+		// Sets Added to fire once the wheel reaches At.  A time already passed fires on the next Advance.
+		void Insert(Entry &Added, Time At);
+		// Does nothing if Cancelled isn't pending
+		void Cancel(Entry &Cancelled);
+
+		// Moves the wheel on to Now, firing each timer that comes due, earliest first.  Fire may insert and cancel
+		// timers, including those due at the same time.
+		void Advance(Time Now, std::function<void (Entry &Fired)> const &Fire);
+
+		// A time at or before the earliest pending timer, at which the wheel should next be advanced.  Timers in the
+		// higher wheels are only known to the nearest of their slots, so advancing then may not fire anything.
+		// Returns false if nothing is pending.
+		bool GetNextTime(Time &Next) const;
+
+	private:
+		static int const			SlotBits = 6;
+		static int const			Slots = 1 << SlotBits;
+		static int const			Levels = 4;
+
+		// Each list is circular around its head
+		Entry	Wheels[Levels][Slots];
+		Entry	Due;		// Inserted at or before the current time
+		Entry	Overflow;
+
+		Time		Current;
+		std::size_t	Pending;
+
+		void Place(Entry &Placed);
+		void Cascade(Entry &Head);
+
+		static void Splice(Entry &From, Entry &To);
+		static void Link(Entry &Head, Entry &Linked);
+		static void Unlink(Entry &Unlinked);
+	};
+}
+
+#endif
@@ -0,0 +1,472 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+// Times the library's hot paths and writes the results to standard output as JSON.  The layout follows Google
+// Benchmark's, so that runs can be compared with its tools.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Activity.hpp"
+#include "Offset.hpp"
+#include "OffsetTranslator.hpp"
+#include "Schedule.hpp"
+#include "ScheduleFileIO.hpp"
+#include "ScheduleShared.hpp"
+#include "TimingWheel.hpp"
+
+struct Result
+{
+	std::string		Name;
+	unsigned long	Iterations;
+	double			Nanoseconds;	// Per iteration
+	unsigned long	Items;			// Processed per iteration, for the items_per_second field; 0 for none
+};
+
+
+// Keeps the compiler from discarding what is being timed
+volatile long Sink;
+
+
+std::string		Filter;
+double			MinimumTime = 0.1;
+unsigned long	MaximumActivities = 1000000;
+
+std::vector<Result> Results;
+
+
+// Runs Function(Iterations) with growing iteration counts until a run takes at least MinimumTime, and records that run
+void Measure(std::string const &Name, unsigned long Items, std::function<void (unsigned long Iterations)> const &Function)
+{
+	if (Name.find(Filter) == std::string::npos)
+		return;
+
+	unsigned long Iterations = 1;
+
+	while (true)
+	{
+		std::chrono::steady_clock::time_point const Start = std::chrono::steady_clock::now();
+
+		Function(Iterations);
+
+		double const Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+		if (Elapsed >= MinimumTime || Iterations >= 1000000000)
+		{
+			Result const Finished = { Name, Iterations, Elapsed * 1e9 / Iterations, Items };
+			Results.push_back(Finished);
+
+			std::cerr << Name << ": " << Finished.Nanoseconds << " ns" << std::endl;
+			return;
+		}
+
+		// Aim a little past the minimum so that the next run is likely the last
+		Iterations = (Elapsed > 0.0 ? std::max<unsigned long>(Iterations * 2, Iterations * MinimumTime * 1.2 / Elapsed) :
+									  Iterations * 10);
+	}
+}
+
+
+enum class Mix { FREE,
+				 MIXED,
+				 FIXED };
+
+char const *GetMixName(Mix Type)
+{
+	switch (Type)
+	{
+	case Mix::FREE:		return "free";
+	case Mix::MIXED:	return "mixed";
+	default:			return "fixed";
+	}
+}
+
+
+// Fills Schedule with Count activities.  The mixed schedule fixes one length in eight and one start in sixteen; the
+// fixed one fixes every other length and one start in four.
+void Populate(Schedule::Schedule &Schedule, unsigned long Count, Mix Type)
+{
+	// Lengths average a quarter of an hour
+	Schedule.SetLength(Schedule::Duration(Count / 4 + 1, 0, 0));
+
+	for (unsigned long Index = 0; Index < Count; Index++)
+	{
+		Schedule::Activity * const NewActivity = new Schedule::Activity;
+		NewActivity->SetName("Activity");
+		NewActivity->SetDesiredLength(Schedule::Duration(0, 1 + Index % 30, 0));
+
+		unsigned long const LengthInterval = (Type == Mix::MIXED ? 8 : 2);
+		unsigned long const StartInterval = (Type == Mix::MIXED ? 16 : 4);
+
+		if (Type != Mix::FREE && Index % LengthInterval == 0)
+			NewActivity->SetLengthMode(Schedule::Activity::LengthMode::FIXED);
+
+		if (Type != Mix::FREE && Index % StartInterval == 0 && Index != 0)
+		{
+			NewActivity->SetStartMode(Schedule::Activity::StartMode::FIXED_ABSOLUTE);
+			NewActivity->SetDesiredStartTime(Schedule::Offset(0, Index * 15, 0));
+		}
+
+		Schedule.push_back(NewActivity);
+	}
+}
+
+
+std::vector<unsigned long> GetSizes(unsigned long Largest)
+{
+	std::vector<unsigned long> Sizes;
+
+	for (unsigned long Size = 10; Size <= std::min(Largest, MaximumActivities); Size *= 10)
+		Sizes.push_back(Size);
+
+	return Sizes;
+}
+
+
+void MeasureOffsets()
+{
+	Schedule::Offset const First(1, 23, 45);
+	Schedule::Offset const Second(0, 47, 30);
+
+	Measure("Offset/Add", 0, [&](unsigned long Iterations)
+	{
+		for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			Sink = (First + Second).GetSeconds();
+	});
+
+	Measure("Offset/Subtract", 0, [&](unsigned long Iterations)
+	{
+		for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			Sink = (First - Second).GetSeconds();
+	});
+
+	Measure("Offset/Multiply", 0, [&](unsigned long Iterations)
+	{
+		for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			Sink = (First * 1.5f).GetSeconds();
+	});
+
+	Measure("Offset/Compare", 0, [&](unsigned long Iterations)
+	{
+		for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			Sink = (First < Second) + (First == Second);
+	});
+
+	Schedule::OffsetTranslator Translator;
+
+	Measure("OffsetTranslator/Parse", 0, [&](unsigned long Iterations)
+	{
+		std::string const Text = "12:34:56";
+
+		for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			Sink = Translator.get_value(Text)->GetSeconds();
+	});
+
+	Measure("OffsetTranslator/Format", 0, [&](unsigned long Iterations)
+	{
+		for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			Sink = Translator.put_value(First)->size();
+	});
+}
+
+
+void MeasureSchedules()
+{
+	for (Mix Type : { Mix::FREE, Mix::MIXED, Mix::FIXED })
+	{
+		for (unsigned long Size : GetSizes(1000000))
+		{
+			Schedule::Schedule CurrentSchedule;
+			Populate(CurrentSchedule, Size, Type);
+
+			// Change a length in the middle; the whole schedule is laid out again
+			Schedule::Activity &Changed = **std::next(CurrentSchedule.begin(), Size / 2 + 1);
+
+			Measure("Schedule/Update/" + std::to_string(Size) + "/" + GetMixName(Type), Size, [&](unsigned long Iterations)
+			{
+				for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+				{
+					Changed.SetDesiredLength(Schedule::Duration(0, 1 + Iteration % 2, 0));
+					Sink = CurrentSchedule.front()->GetActualStartTime().GetSeconds();
+				}
+			});
+		}
+	}
+
+	// A late start for the first activity, with nothing after it pinned to the clock, moves the layout as a whole
+	for (unsigned long Size : GetSizes(1000000))
+	{
+		Schedule::Schedule CurrentSchedule;
+		Populate(CurrentSchedule, Size, Mix::FREE);
+
+		Schedule::Activity &First = *CurrentSchedule.front();
+		Schedule::Activity const &Last = *CurrentSchedule.back();
+
+		// Laid out first, since only a current layout can be moved
+		Sink = Last.GetActualStartTime().GetSeconds();
+
+		Measure("Schedule/Shift/" + std::to_string(Size), Size, [&](unsigned long Iterations)
+		{
+			for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				CurrentSchedule.BeginActivity(First, Schedule::Offset(0, 10 + Iteration % 2, 0));
+				Sink = Last.GetActualStartTime().GetSeconds();
+			}
+		});
+	}
+
+	// Adding and removing don't lay out, so these measure the list handling alone
+	for (unsigned long Size : GetSizes(1000000))
+	{
+		Schedule::Schedule CurrentSchedule;
+		Populate(CurrentSchedule, Size, Mix::MIXED);
+
+		Schedule::Activity * const Added = new Schedule::Activity;
+
+		Measure("Schedule/PushBackErase/" + std::to_string(Size), 0, [&](unsigned long Iterations)
+		{
+			for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				CurrentSchedule.push_back(Added);
+				CurrentSchedule.erase(std::prev(CurrentSchedule.end()));
+			}
+		});
+
+		Measure("Schedule/InsertErase/" + std::to_string(Size), 0, [&](unsigned long Iterations)
+		{
+			for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				Schedule::Schedule::iterator const Inserted = CurrentSchedule.insert(std::next(CurrentSchedule.begin()), Added);
+				CurrentSchedule.erase(Inserted);
+			}
+		});
+
+		delete Added;
+	}
+}
+
+
+void MeasureFiles()
+{
+	char const * const TemporaryDirectory = std::getenv("TMPDIR");
+	std::string const FileName = std::string(TemporaryDirectory != nullptr ? TemporaryDirectory : "/tmp") +
+								 "/schedule_bench_" + std::to_string(getpid()) + ".sch";
+
+	for (unsigned long Size : GetSizes(100000))
+	{
+		Schedule::Schedule CurrentSchedule;
+		Populate(CurrentSchedule, Size, Mix::MIXED);
+
+		Measure("ScheduleFileIO/Write/" + std::to_string(Size), Size, [&](unsigned long Iterations)
+		{
+			for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+				Sink = Schedule::ScheduleFileIO::Write(CurrentSchedule, FileName);
+		});
+
+		Measure("ScheduleFileIO/Read/" + std::to_string(Size), Size, [&](unsigned long Iterations)
+		{
+			for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+				Sink = Schedule::ScheduleFileIO::Read(FileName).size();
+		});
+	}
+
+	std::remove(FileName.c_str());
+}
+
+
+// Inserting and cancelling should cost the same however many timers are pending
+void MeasureTimers()
+{
+	for (unsigned long Size : GetSizes(1000000))
+	{
+		// The wheel unlinks what is still pending as it goes, so it must go before its entries
+		std::vector<Schedule::TimingWheel::Entry> Pending(Size);
+		Schedule::TimingWheel Wheel(0);
+
+		for (unsigned long Index = 0; Index < Size; Index++)
+			Wheel.Insert(Pending[Index], 1 + (Index * 7919) % 86400);
+
+		Schedule::TimingWheel::Entry Added;
+
+		Measure("TimingWheel/InsertCancel/" + std::to_string(Size), 0, [&](unsigned long Iterations)
+		{
+			for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				Wheel.Insert(Added, 1 + Iteration % 86400);
+				Wheel.Cancel(Added);
+			}
+		});
+	}
+}
+
+
+// What a status bar pays to learn what is under way, from a schedule published by a watch
+void MeasureShared()
+{
+	std::string const Name = "/schedule_bench_" + std::to_string(getpid());
+
+	for (unsigned long Size : GetSizes(100000))
+	{
+		Schedule::Schedule CurrentSchedule;
+		Populate(CurrentSchedule, Size, Mix::MIXED);
+
+		Schedule::ScheduleShared Shared(Name);
+		Shared.Publish(CurrentSchedule, Size / 2, std::vector<Schedule::Schedule::ActivityRange>(), true);
+
+		Schedule::Offset const Now = (*std::next(CurrentSchedule.begin(), Size / 2))->GetActualStartTime();
+
+		Measure("ScheduleShared/Read/" + std::to_string(Size), 0, [&](unsigned long Iterations)
+		{
+			for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				Schedule::ScheduleShared::Status Read;
+				Sink = Schedule::ScheduleShared::Read(Name, Now, Read);
+			}
+		});
+	}
+}
+
+
+void WriteResults()
+{
+	char Date[32];
+	std::time_t const Now = std::time(nullptr);
+	std::strftime(Date, sizeof(Date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&Now));
+
+#ifdef __OPTIMIZE__
+	char const * const BuildType = "release";
+#else
+	char const * const BuildType = "debug";
+#endif
+
+	std::cout << "{\n"
+				 "  \"context\": {\n"
+				 "    \"date\": \"" << Date << "\",\n"
+				 "    \"executable\": \"schedule_bench\",\n"
+				 "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+				 "    \"library_build_type\": \"" << BuildType << "\"\n"
+				 "  },\n"
+				 "  \"benchmarks\": [";
+
+	for (std::vector<Result>::size_type Index = 0; Index < Results.size(); Index++)
+	{
+		Result const &Current = Results[Index];
+
+		std::cout << (Index == 0 ? "\n" : ",\n") <<
+					 "    {\n"
+					 "      \"name\": \"" << Current.Name << "\",\n"
+					 "      \"run_name\": \"" << Current.Name << "\",\n"
+					 "      \"run_type\": \"iteration\",\n"
+					 "      \"iterations\": " << Current.Iterations << ",\n"
+					 "      \"real_time\": " << Current.Nanoseconds << ",\n"
+					 "      \"cpu_time\": " << Current.Nanoseconds << ",\n";
+
+		if (Current.Items != 0)
+			std::cout << "      \"items_per_second\": " << Current.Items * 1e9 / Current.Nanoseconds << ",\n";
+
+		std::cout << "      \"time_unit\": \"ns\"\n"
+					 "    }";
+	}
+
+	std::cout << "\n  ]\n}" << std::endl;
+}
+
+
+void DisplayHelp()
+{
+	std::cout << "Usage: schedule_bench [--filter=Text] [--min-time=Seconds] [--max-activities=Count]\n\n"
+				 "Times the schedule library and writes the results to standard output as JSON.  Progress\n"
+				 "goes to standard error.\n\n"
+				 "  --filter=Text           Only run benchmarks whose names contain Text\n"
+				 "  --min-time=Seconds      Time each benchmark for at least this long (default 0.1)\n"
+				 "  --max-activities=Count  Skip schedules larger than Count (default 1000000)\n";
+}
+
+
+bool GetValue(std::string const &Argument, std::string const &Option, std::string &Value)
+{
+	if (Argument.compare(0, Option.size(), Option) != 0)
+		return false;
+
+	Value = Argument.substr(Option.size());
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	for (int Index = 1; Index < argc; Index++)
+	{
+		std::string const Argument = argv[Index];
+		std::string Value;
+
+		if (Argument == "-h" || Argument == "--help")
+		{
+			DisplayHelp();
+			return 0;
+		}
+		else if (GetValue(Argument, "--filter=", Value))
+			Filter = Value;
+		else if (GetValue(Argument, "--min-time=", Value))
+		{
+			MinimumTime = std::atof(Value.c_str());
+
+			if (MinimumTime <= 0.0)
+			{
+				std::cerr << "Invalid minimum time." << std::endl;
+				return 1;
+			}
+		}
+		else if (GetValue(Argument, "--max-activities=", Value))
+		{
+			MaximumActivities = std::strtoul(Value.c_str(), nullptr, 10);
+
+			if (MaximumActivities == 0)
+			{
+				std::cerr << "Invalid activity count." << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown option: " << Argument << std::endl;
+			return 1;
+		}
+	}
+
+	MeasureOffsets();
+	MeasureSchedules();
+	MeasureFiles();
+	MeasureTimers();
+	MeasureShared();
+
+	WriteResults();
+
+	return 0;
+}
@@ -0,0 +1,371 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+// Lays out random schedules with each layout engine and with the reference, the serial layout, and reports the first
+// place they disagree.  Each case is a generated schedule followed by a run of random edits, and the layouts are
+// compared after every one of them.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Activity.hpp"
+#include "Schedule.hpp"
+#include "ScheduleFileIO.hpp"
+#include "ScheduleGenerator.hpp"
+#include "ScheduleSnapshot.hpp"
+
+// A way of laying out schedules to check against the reference.  Prepare sets a schedule up to be laid out that way.
+// Engines that shift also move the first activity's start after each edit, often on schedules that move as a whole.
+struct Engine
+{
+	std::string									Name;
+	std::function<void (Schedule::Schedule &)>	Prepare;
+	bool										Shifts;
+};
+
+
+// Set by the observed engine's observer when the ranges it was told of missed a change
+std::string ObservedDifference;
+
+
+// Keeps a copy of a schedule's layout up to date from only the ranges it is told of, and checks it against the whole
+// schedule after each layout
+void Observe(Schedule::Schedule &Observed)
+{
+	struct Row
+	{
+		Schedule::Activity const	*Laid;
+		Schedule::Offset			StartTime;
+		Schedule::Duration			Length;
+
+		bool operator!=(Row const &Other) const
+		{
+			return this->Laid != Other.Laid || this->StartTime != Other.StartTime || this->Length != Other.Length;
+		}
+	};
+
+	auto const GetRows = [](Schedule::Schedule const &Laid)
+	{
+		std::vector<Row> Rows;
+		for (auto Current : Laid)
+		{
+			Row const Added = { Current, Current->GetActualStartTime(), Current->GetActualLength() };
+			Rows.push_back(Added);
+		}
+
+		return Rows;
+	};
+
+	std::shared_ptr<std::vector<Row>> const Mirror = std::make_shared<std::vector<Row>>(GetRows(Observed));
+
+	Observed.AddObserver([Mirror, GetRows](Schedule::Schedule const &Changed,
+										   std::vector<Schedule::Schedule::ActivityRange> const &Ranges)
+	{
+		std::vector<Row> const Rows = GetRows(Changed);
+
+		Mirror->resize(Rows.size());
+		for (auto &Range : Ranges)
+			std::copy(Rows.begin() + Range.First, Rows.begin() + Range.First + Range.Count, Mirror->begin() + Range.First);
+
+		for (std::vector<Row>::size_type Index = 0; Index < Rows.size(); Index++)
+		{
+			if ((*Mirror)[Index] != Rows[Index] && ObservedDifference.empty())
+			{
+				ObservedDifference = "activity " + std::to_string(Index + 1) + " changed outside the ranges observers "
+									 "were told of";
+			}
+		}
+
+		*Mirror = Rows;
+	});
+}
+
+
+std::vector<Engine> const Engines =
+{
+	// The parallel layout, used even for the smallest schedules, on thread counts that split them unevenly
+	{ "parallel-2", [](Schedule::Schedule &Schedule) { Schedule.SetParallelLayoutThreshold(0); Schedule.SetLayoutThreads(2); } },
+	{ "parallel-5", [](Schedule::Schedule &Schedule) { Schedule.SetParallelLayoutThreshold(0); Schedule.SetLayoutThreads(5); } },
+	// The ranges of changed activities told to observers, checked against the whole layout
+	{ "observed", [](Schedule::Schedule &Schedule) { Schedule.SetParallelLayoutThreshold(0); Schedule.SetLayoutThreads(3); Observe(Schedule); } },
+	// Layouts moved as a whole, rather than laid out again, when the first activity starts somewhere else
+	{ "shifted", [](Schedule::Schedule &Schedule) { Observe(Schedule); }, true },
+};
+
+
+// Moves the first activity's start, or its beginning if it has one, by up to half an hour either way
+std::string MoveStart(Schedule::Schedule &Moved, std::uint64_t Seed)
+{
+	if (Moved.empty())
+		return "moved nothing";
+
+	Schedule::Activity &First = *Moved.front();
+	Schedule::Duration const Shift(0, static_cast<long>(Seed % 61) - 30, 0);
+
+	if (First.GetBeginning() != nullptr)
+		Moved.BeginActivity(First, *First.GetBeginning() + Shift);
+	else
+		First.SetDesiredStartTime(First.GetDesiredStartTime() + Shift);
+
+	std::ostringstream Description;
+	Description << "moved the start of 1 by " << Shift;
+
+	return Description.str();
+}
+
+
+std::string ToString(Schedule::Offset const &Time)
+{
+	std::ostringstream Stream;
+	Stream << Time;
+
+	return Stream.str();
+}
+
+
+// Returns a description of the first difference between the layouts, or nothing if there is none.  The reference is
+// laid out afresh from its snapshot, so that it is never a layout the reference moved rather than laid out.
+std::string Compare(Schedule::Schedule &Moved, Schedule::Schedule const &Candidate)
+{
+	Schedule::Schedule const Reference(Moved.GetSnapshot());
+
+	if (Reference.size() != Candidate.size())
+		return "the schedules have different sizes";
+
+	std::ostringstream Difference;
+
+	Schedule::Schedule::const_iterator CandidateIterator = Candidate.begin();
+	unsigned long Number = 1;
+
+	for (auto ReferenceActivity : Reference)
+	{
+		Schedule::Activity const &CandidateActivity = **CandidateIterator++;
+
+		if (ReferenceActivity->GetActualStartTime() != CandidateActivity.GetActualStartTime() ||
+			ReferenceActivity->GetActualLength() != CandidateActivity.GetActualLength())
+		{
+			Difference << "activity " << Number << " starts at " << ToString(CandidateActivity.GetActualStartTime()) <<
+						  " for " << ToString(CandidateActivity.GetActualLength()) << ", where the reference starts at " <<
+						  ToString(ReferenceActivity->GetActualStartTime()) << " for " <<
+						  ToString(ReferenceActivity->GetActualLength());
+
+			return Difference.str();
+		}
+
+		Number++;
+	}
+
+	if (!ObservedDifference.empty())
+	{
+		Difference << ObservedDifference;
+		ObservedDifference.clear();
+
+		return Difference.str();
+	}
+
+	return std::string();
+}
+
+
+void DisplayHelp()
+{
+	std::cout << "Usage: schedule_difftest [Options...]\n\n"
+				 "Checks the layout engines against the reference layout on random schedules.  At the\n"
+				 "first difference, describes it, writes the schedule before the last edit to the output\n"
+				 "file, and exits with 1.\n\n"
+				 "  --cases=Count           The number of schedules to try (default 100000)\n"
+				 "  --edits=Count           Random edits made to each, checking after each (default 4)\n"
+				 "  --max-activities=Count  The largest schedule generated (default 40)\n"
+				 "  --seed=Seed             The random seed (default 1)\n"
+				 "  --engine=Name           Only check Name; one of:";
+
+	for (auto &Current : Engines)
+		std::cout << " " << Current.Name;
+
+	std::cout << "\n  --output=File           Where to write a diverging schedule (default divergence.sch)\n";
+}
+
+
+bool GetValue(std::string const &Argument, std::string const &Option, std::string &Value)
+{
+	if (Argument.compare(0, Option.size(), Option) != 0)
+		return false;
+
+	Value = Argument.substr(Option.size());
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned long Cases = 100000;
+	unsigned long Edits = 4;
+	unsigned long MaximumActivities = 40;
+	std::uint64_t Seed = 1;
+	std::string EngineName;
+	std::string OutputFileName = "divergence.sch";
+
+	for (int Index = 1; Index < argc; Index++)
+	{
+		std::string const Argument = argv[Index];
+		std::string Value;
+
+		if (Argument == "-h" || Argument == "--help")
+		{
+			DisplayHelp();
+			return 0;
+		}
+		else if (GetValue(Argument, "--cases=", Value))
+			Cases = std::strtoul(Value.c_str(), nullptr, 10);
+		else if (GetValue(Argument, "--edits=", Value))
+			Edits = std::strtoul(Value.c_str(), nullptr, 10);
+		else if (GetValue(Argument, "--max-activities=", Value))
+			MaximumActivities = std::max(std::strtoul(Value.c_str(), nullptr, 10), 1ul);
+		else if (GetValue(Argument, "--seed=", Value))
+			Seed = std::strtoull(Value.c_str(), nullptr, 10);
+		else if (GetValue(Argument, "--engine=", Value))
+			EngineName = Value;
+		else if (GetValue(Argument, "--output=", Value))
+			OutputFileName = Value;
+		else
+		{
+			std::cerr << "Unknown option: " << Argument << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<Engine> Checked;
+	for (auto &Current : Engines)
+	{
+		if (EngineName.empty() || Current.Name == EngineName)
+			Checked.push_back(Current);
+	}
+
+	if (Checked.empty())
+	{
+		std::cerr << "Unknown engine: " << EngineName << std::endl;
+		return 1;
+	}
+
+	// mt19937_64's output is fully specified, so a seed names the same cases everywhere
+	std::mt19937_64 Generator(Seed);
+	unsigned long Comparisons = 0;
+
+	for (unsigned long Case = 0; Case < Cases; Case++)
+	{
+		Schedule::ScheduleGenerator::Parameters Parameters;
+		Parameters.Activities = 1 + Generator() % MaximumActivities;
+		Parameters.FixedAbsolute = (Generator() % 51) / 100.0;
+		Parameters.FixedRelative = (Generator() % 31) / 100.0;
+		Parameters.FixedLength = (Generator() % 101) / 100.0;
+		Parameters.Begun = (Generator() % 101) / 100.0;
+		Parameters.ConflictingBeginnings = (Generator() % 101) / 100.0;
+		Parameters.Pauses = Generator() % 4;
+		Parameters.ActivePause = (Generator() % 10 == 0);
+		Parameters.Seed = Generator();
+
+		std::vector<std::uint64_t> EditSeeds(Edits);
+		for (auto &EditSeed : EditSeeds)
+			EditSeed = Generator();
+
+		for (auto &Current : Checked)
+		{
+			// Half of the shifting engine's schedules have nothing but the first activity pinned to the clock
+			Schedule::ScheduleGenerator::Parameters Generated = Parameters;
+
+			if (Current.Shifts && Parameters.Seed % 2 == 0)
+			{
+				Generated.FixedAbsolute = 0;
+				Generated.Begun = 0;
+				Generated.Pauses = 0;
+				Generated.ActivePause = false;
+			}
+
+			Schedule::Schedule Reference = Schedule::ScheduleGenerator::Generate(Generated);
+			Reference.SetLayoutThreads(1);
+
+			Schedule::Schedule Candidate = Schedule::ScheduleGenerator::Generate(Generated);
+			Current.Prepare(Candidate);
+
+			std::string LastEdit = "generating it";
+
+			for (unsigned long Edit = 0; Edit <= Edits; Edit++)
+			{
+				if (Edit != 0)
+				{
+					// Kept as it was before the edit, for reproducing a divergence
+					Schedule::Schedule Previous(Reference.GetSnapshot());
+
+					LastEdit = Schedule::ScheduleGenerator::Edit(Reference, EditSeeds[Edit - 1]);
+					Schedule::ScheduleGenerator::Edit(Candidate, EditSeeds[Edit - 1]);
+
+					std::string Difference = Compare(Reference, Candidate);
+					Comparisons++;
+
+					// Moved only once laid out, since the move is only cheap then
+					if (Difference.empty() && Current.Shifts)
+					{
+						LastEdit += ", then " + MoveStart(Reference, EditSeeds[Edit - 1] >> 32);
+						MoveStart(Candidate, EditSeeds[Edit - 1] >> 32);
+
+						Difference = Compare(Reference, Candidate);
+						Comparisons++;
+					}
+
+					if (Difference.empty())
+						continue;
+
+					Schedule::ScheduleFileIO::Write(Previous, OutputFileName);
+
+					std::cout << "Case " << (Case + 1) << ", engine " << Current.Name << ": after " << LastEdit <<
+								 ", " << Difference << ".  The schedule before the edit is in " << OutputFileName <<
+								 "." << std::endl;
+					return 1;
+				}
+
+				std::string const Difference = Compare(Reference, Candidate);
+				Comparisons++;
+
+				if (!Difference.empty())
+				{
+					Schedule::ScheduleFileIO::Write(Reference, OutputFileName);
+
+					std::cout << "Case " << (Case + 1) << ", engine " << Current.Name << ": after " << LastEdit <<
+								 ", " << Difference << ".  The schedule is in " << OutputFileName << "." << std::endl;
+					return 1;
+				}
+			}
+		}
+
+		if ((Case + 1) % 100000 == 0)
+			std::cerr << (Case + 1) << " cases" << std::endl;
+	}
+
+	std::cout << Cases << " cases, " << Comparisons << " layouts compared, no differences." << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+// Writes a random schedule file, for benchmarks and for reproducing problems found by schedule_difftest
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "OffsetTranslator.hpp"
+#include "Schedule.hpp"
+#include "ScheduleFileIO.hpp"
+#include "ScheduleGenerator.hpp"
+
+void DisplayHelp()
+{
+	std::cout << "Usage: schedule_generate File [Options...]\n\n"
+				 "Writes a random schedule to File.  The same options always write the same schedule.\n\n"
+				 "  -n Count                  The number of activities (default 20)\n"
+				 "  --start=Time              The first activity's start (default 08:00:00)\n"
+				 "  --fixed-absolute=Fraction The fraction of starts fixed to a time of day (default 0.1)\n"
+				 "  --fixed-relative=Fraction The fraction of starts fixed relative to the schedule's (default 0.05)\n"
+				 "  --fixed-length=Fraction   The fraction of lengths fixed (default 0.25)\n"
+				 "  --begun=Fraction          The fraction of activities begun, from the first (default 0.2)\n"
+				 "  --conflicting=Fraction    The fraction of beginnings out of order or bounds (default 0.1)\n"
+				 "  --pauses=Count            The number of pauses taken (default 1)\n"
+				 "  --active-pause            Leave the schedule paused\n"
+				 "  --seed=Seed               The random seed (default 1)\n";
+}
+
+
+bool GetValue(std::string const &Argument, std::string const &Option, std::string &Value)
+{
+	if (Argument.compare(0, Option.size(), Option) != 0)
+		return false;
+
+	Value = Argument.substr(Option.size());
+	return true;
+}
+
+
+bool GetFraction(std::string const &Value, double &Fraction)
+{
+	char *End;
+	Fraction = std::strtod(Value.c_str(), &End);
+
+	if (*End != '\0' || Fraction < 0.0 || Fraction > 1.0)
+	{
+		std::cerr << "Invalid fraction: " << Value << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")
+	{
+		DisplayHelp();
+		return argc < 2 ? 1 : 0;
+	}
+
+	std::string const FileName = argv[1];
+	Schedule::ScheduleGenerator::Parameters Parameters;
+
+	for (int Index = 2; Index < argc; Index++)
+	{
+		std::string const Argument = argv[Index];
+		std::string Value;
+
+		if (Argument == "-n" && Index + 1 < argc)
+			Parameters.Activities = std::strtoul(argv[++Index], nullptr, 10);
+		else if (GetValue(Argument, "--start=", Value))
+			Parameters.StartTime = *Schedule::OffsetTranslator().get_value(Value);
+		else if (GetValue(Argument, "--fixed-absolute=", Value))
+		{
+			if (!GetFraction(Value, Parameters.FixedAbsolute))
+				return 1;
+		}
+		else if (GetValue(Argument, "--fixed-relative=", Value))
+		{
+			if (!GetFraction(Value, Parameters.FixedRelative))
+				return 1;
+		}
+		else if (GetValue(Argument, "--fixed-length=", Value))
+		{
+			if (!GetFraction(Value, Parameters.FixedLength))
+				return 1;
+		}
+		else if (GetValue(Argument, "--begun=", Value))
+		{
+			if (!GetFraction(Value, Parameters.Begun))
+				return 1;
+		}
+		else if (GetValue(Argument, "--conflicting=", Value))
+		{
+			if (!GetFraction(Value, Parameters.ConflictingBeginnings))
+				return 1;
+		}
+		else if (GetValue(Argument, "--pauses=", Value))
+			Parameters.Pauses = std::strtoul(Value.c_str(), nullptr, 10);
+		else if (Argument == "--active-pause")
+			Parameters.ActivePause = true;
+		else if (GetValue(Argument, "--seed=", Value))
+			Parameters.Seed = std::strtoull(Value.c_str(), nullptr, 10);
+		else
+		{
+			std::cerr << "Unknown option: " << Argument << std::endl;
+			return 1;
+		}
+	}
+
+	if (Parameters.FixedAbsolute + Parameters.FixedRelative > 1.0)
+	{
+		std::cerr << "More than all of the starts are fixed." << std::endl;
+		return 1;
+	}
+
+	return Schedule::ScheduleFileIO::Write(Schedule::ScheduleGenerator::Generate(Parameters), FileName) ? 0 : 2;
+}
@@ -0,0 +1,447 @@
+/*
+* This file is part of schedule.
+*
+* schedule is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* schedule is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with schedule. If not, see <http://www.gnu.org/licenses/>.
+*
+* Copyright 2015 Chris Foster
+*/
+
+// Times whole invocations of schedule, one command at a time, against generated schedules of increasing size.  Each
+// invocation is started from the same file and reports its own phases (see SCHEDULE_TIMINGS in main.cpp); startup is
+// the time from spawning it until main was entered, and total is the time until it exited.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Schedule.hpp"
+#include "ScheduleFileIO.hpp"
+#include "ScheduleGenerator.hpp"
+
+extern char **environ;
+
+// A command as it follows the file on the command line.  The setup commands are run, untimed, before each timed run.
+struct Command
+{
+	std::string								Name;
+	std::vector<std::vector<std::string>>	Setup;
+	std::vector<std::string>				Arguments;
+};
+
+
+char const * const PhaseNames[] = { "startup", "parse", "layout", "mutate", "serialize", "render", "total" };
+int const PhaseCount = 7;
+
+
+std::vector<Command> GetCommands(unsigned long Size)
+{
+	std::vector<std::string> const Change = { "set", "2", "-l", "45:00" };
+
+	return
+	{
+		{ "list",	{ },						{ "list" } },
+		{ "add",	{ },						{ "add", "-n", "Added", "-l", "30:00" } },
+		{ "set",	{ },						Change },
+		{ "move",	{ },						{ "move", std::to_string(Size), "1" } },
+		{ "remove",	{ },						{ "remove", "2" } },
+		{ "begin",	{ },						{ "begin" } },
+		{ "reset",	{ },						{ "reset" } },
+		{ "pause",	{ },						{ "pause", "08:30:00" } },
+		{ "undo",	{ Change },					{ "undo" } },
+		{ "redo",	{ Change, { "undo" } },		{ "redo" } },
+		{ "script",	{ },						{ "script", "-e", "set 2 -l 45:00\nmove 3 1\nbegin 1 08:05:00" } },
+	};
+}
+
+
+// Empties Directory, so each run starts without the history or journal of the last
+void ClearDirectory(std::string const &Directory)
+{
+	if (DIR * const Listing = opendir(Directory.c_str()))
+	{
+		while (dirent const * const Entry = readdir(Listing))
+		{
+			if (std::strcmp(Entry->d_name, ".") != 0 && std::strcmp(Entry->d_name, "..") != 0)
+				unlink((Directory + "/" + Entry->d_name).c_str());
+		}
+
+		closedir(Listing);
+	}
+}
+
+
+// Runs Executable with Arguments, with its output discarded and its standard error returned in Errors.  Returns its
+// exit code, or -1 if it couldn't be run.
+int Run(std::string const &Executable, std::vector<std::string> const &Arguments, std::vector<std::string> const &Environment,
+		std::string &Errors)
+{
+	int Pipe[2];
+	if (pipe(Pipe) != 0)
+		return -1;
+
+	posix_spawn_file_actions_t Actions;
+	posix_spawn_file_actions_init(&Actions);
+	posix_spawn_file_actions_addopen(&Actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_adddup2(&Actions, Pipe[1], STDERR_FILENO);
+	posix_spawn_file_actions_addclose(&Actions, Pipe[0]);
+	posix_spawn_file_actions_addclose(&Actions, Pipe[1]);
+
+	std::vector<char *> Argv = { const_cast<char *>(Executable.c_str()) };
+	for (auto &Argument : Arguments)
+		Argv.push_back(const_cast<char *>(Argument.c_str()));
+	Argv.push_back(nullptr);
+
+	std::vector<char *> Envp;
+	for (auto &Variable : Environment)
+		Envp.push_back(const_cast<char *>(Variable.c_str()));
+	Envp.push_back(nullptr);
+
+	pid_t Child;
+	int const Error = posix_spawn(&Child, Executable.c_str(), &Actions, nullptr, Argv.data(), Envp.data());
+
+	posix_spawn_file_actions_destroy(&Actions);
+	close(Pipe[1]);
+
+	Errors.clear();
+
+	if (Error != 0)
+	{
+		close(Pipe[0]);
+		Errors = std::string("Could not run ") + Executable + ": " + std::strerror(Error) + "\n";
+		return -1;
+	}
+
+	char Buffer[4096];
+	for (ssize_t Read; (Read = read(Pipe[0], Buffer, sizeof(Buffer))) != 0;)
+	{
+		if (Read > 0)
+			Errors.append(Buffer, Read);
+		else if (errno != EINTR)
+			break;
+	}
+
+	close(Pipe[0]);
+
+	int Status;
+	while (waitpid(Child, &Status, 0) < 0)
+	{
+		if (errno != EINTR)
+			return -1;
+	}
+
+	return (WIFEXITED(Status) ? WEXITSTATUS(Status) : -1);
+}
+
+
+// Takes the phase times from the line schedule reports them on, leaving the rest of Errors alone.  Returns false if
+// there is no such line.
+bool GetPhaseTimes(std::string const &Errors, long long &Entered, long long (&Times)[PhaseCount])
+{
+	std::string::size_type const Start = Errors.find("schedule timings: ");
+	if (Start == std::string::npos)
+		return false;
+
+	std::istringstream Line(Errors.substr(Start + 18, Errors.find('\n', Start) - Start - 18));
+
+	for (std::string Field; Line >> Field;)
+	{
+		std::string::size_type const Equals = Field.find('=');
+		if (Equals == std::string::npos)
+			continue;
+
+		std::string const Name = Field.substr(0, Equals);
+		long long const Value = std::atoll(Field.c_str() + Equals + 1);
+
+		if (Name == "entered")
+			Entered = Value;
+
+		for (int Index = 1; Index < PhaseCount - 1; Index++)
+		{
+			if (Name == PhaseNames[Index])
+				Times[Index] = Value;
+		}
+	}
+
+	return true;
+}
+
+
+// Nearest-rank percentile of sorted Samples
+long long GetPercentile(std::vector<long long> const &Samples, double Percentile)
+{
+	std::vector<long long>::size_type Rank = static_cast<std::vector<long long>::size_type>(Percentile * Samples.size() + 0.999999);
+
+	return Samples[std::min(std::max<std::vector<long long>::size_type>(Rank, 1), Samples.size()) - 1];
+}
+
+
+void DisplayHelp()
+{
+	std::cout << "Usage: schedule_latency [Options...]\n\n"
+				 "Times each schedule command, run as its own process, against generated schedules of\n"
+				 "increasing size, and reports the 50th and 99th percentile time of each phase in\n"
+				 "microseconds.\n\n"
+				 "  --schedule=File      The schedule executable (default: schedule beside this one)\n"
+				 "  --sizes=Counts       Comma-separated activity counts (default 10,100,1000,10000)\n"
+				 "  --repetitions=Count  Runs of each command at each size (default 20)\n"
+				 "  --filter=Text        Only run commands whose name contains Text\n"
+				 "  --format=Format      table (default) or jsonl\n";
+}
+
+
+bool GetValue(std::string const &Argument, std::string const &Option, std::string &Value)
+{
+	if (Argument.compare(0, Option.size(), Option) != 0)
+		return false;
+
+	Value = Argument.substr(Option.size());
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	std::string Executable;
+	{
+		std::string const Self = argv[0];
+		std::string::size_type const Slash = Self.rfind('/');
+
+		Executable = (Slash == std::string::npos ? std::string("./") : Self.substr(0, Slash + 1)) + "schedule";
+	}
+
+	std::vector<unsigned long> Sizes = { 10, 100, 1000, 10000 };
+	unsigned long Repetitions = 20;
+	std::string Filter;
+	bool JsonLines = false;
+
+	for (int Index = 1; Index < argc; Index++)
+	{
+		std::string const Argument = argv[Index];
+		std::string Value;
+
+		if (Argument == "-h" || Argument == "--help")
+		{
+			DisplayHelp();
+			return 0;
+		}
+		else if (GetValue(Argument, "--schedule=", Value))
+			Executable = Value;
+		else if (GetValue(Argument, "--sizes=", Value))
+		{
+			Sizes.clear();
+
+			std::istringstream Stream(Value);
+			for (std::string Item; std::getline(Stream, Item, ',');)
+			{
+				unsigned long const Size = std::strtoul(Item.c_str(), nullptr, 10);
+
+				if (Size < 3)
+				{
+					std::cerr << "Sizes must be at least 3." << std::endl;
+					return 1;
+				}
+
+				Sizes.push_back(Size);
+			}
+		}
+		else if (GetValue(Argument, "--repetitions=", Value))
+			Repetitions = std::max(std::strtoul(Value.c_str(), nullptr, 10), 1ul);
+		else if (GetValue(Argument, "--filter=", Value))
+			Filter = Value;
+		else if (GetValue(Argument, "--format=", Value) && (Value == "table" || Value == "jsonl"))
+			JsonLines = (Value == "jsonl");
+		else
+		{
+			std::cerr << "Unknown option: " << Argument << std::endl;
+			return 1;
+		}
+	}
+
+	char const * const TemporaryDirectory = std::getenv("TMPDIR");
+	std::string Directory = std::string(TemporaryDirectory != nullptr ? TemporaryDirectory : "/tmp") +
+							"/schedule_latency_XXXXXX";
+
+	if (mkdtemp(&Directory[0]) == nullptr)
+	{
+		std::cerr << "Could not create a directory in " << Directory << "." << std::endl;
+		return 2;
+	}
+
+	std::string const FileName = Directory + "/latency.sch";
+
+	// Commands are never forwarded to a running daemon
+	std::vector<std::string> Environment = { "SCHEDULE_SOCKET=" + Directory + "/none.sock" };
+	for (char **Variable = environ; *Variable != nullptr; Variable++)
+	{
+		if (std::strncmp(*Variable, "SCHEDULE_SOCKET=", 16) != 0 && std::strncmp(*Variable, "SCHEDULE_TIMINGS=", 17) != 0)
+			Environment.push_back(*Variable);
+	}
+
+	std::vector<std::string> TimedEnvironment = Environment;
+	TimedEnvironment.push_back("SCHEDULE_TIMINGS=1");
+
+	if (!JsonLines)
+	{
+		std::cout << "Times are p50/p99 in microseconds, over " << Repetitions << " runs.\n\n" << std::left;
+		std::cout.width(10);
+		std::cout << "Activities";
+		std::cout.width(8);
+		std::cout << " Command";
+
+		for (auto Name : PhaseNames)
+		{
+			std::cout << " ";
+			std::cout.width(15);
+			std::cout << Name;
+		}
+
+		std::cout << std::endl;
+	}
+
+	int ExitCode = 0;
+
+	for (unsigned long Size : Sizes)
+	{
+		Schedule::ScheduleGenerator::Parameters Parameters;
+		Parameters.Activities = Size;
+		Parameters.Pauses = 0;
+
+		std::string Original;
+		{
+			ClearDirectory(Directory);
+
+			if (!Schedule::ScheduleFileIO::Write(Schedule::ScheduleGenerator::Generate(Parameters), FileName))
+			{
+				ExitCode = 2;
+				break;
+			}
+
+			std::ifstream File(FileName, std::ios::binary);
+			Original.assign(std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>());
+		}
+
+		for (auto &Current : GetCommands(Size))
+		{
+			if (Current.Name.find(Filter) == std::string::npos)
+				continue;
+
+			std::vector<long long> Samples[PhaseCount];
+
+			for (unsigned long Repetition = 0; Repetition < Repetitions && ExitCode == 0; Repetition++)
+			{
+				ClearDirectory(Directory);
+				std::ofstream(FileName, std::ios::binary) << Original;
+
+				std::string Errors;
+
+				for (auto &Setup : Current.Setup)
+				{
+					std::vector<std::string> Arguments = { FileName, "-q" };
+					Arguments.insert(Arguments.end(), Setup.begin(), Setup.end());
+
+					if (Run(Executable, Arguments, Environment, Errors) != 0)
+					{
+						std::cerr << "Setting up " << Current.Name << " failed:\n" << Errors;
+						ExitCode = 2;
+						break;
+					}
+				}
+
+				if (ExitCode != 0)
+					break;
+
+				std::vector<std::string> Arguments = { FileName };
+				Arguments.insert(Arguments.end(), Current.Arguments.begin(), Current.Arguments.end());
+
+				std::chrono::steady_clock::time_point const Start = std::chrono::steady_clock::now();
+				int const Result = Run(Executable, Arguments, TimedEnvironment, Errors);
+				std::chrono::steady_clock::time_point const End = std::chrono::steady_clock::now();
+
+				long long Entered = 0;
+				long long Times[PhaseCount] = { };
+
+				if (Result != 0 || !GetPhaseTimes(Errors, Entered, Times))
+				{
+					std::cerr << Current.Name << " failed with " << Result << ":\n" << Errors;
+					ExitCode = 2;
+					break;
+				}
+
+				Times[0] = Entered - std::chrono::duration_cast<std::chrono::nanoseconds>(Start.time_since_epoch()).count();
+				Times[PhaseCount - 1] = std::chrono::duration_cast<std::chrono::nanoseconds>(End - Start).count();
+
+				for (int Phase = 0; Phase < PhaseCount; Phase++)
+					Samples[Phase].push_back(Times[Phase] / 1000);
+			}
+
+			if (ExitCode != 0)
+				break;
+
+			for (auto &PhaseSamples : Samples)
+				std::sort(PhaseSamples.begin(), PhaseSamples.end());
+
+			if (JsonLines)
+			{
+				std::cout << "{\"activities\":" << Size << ",\"command\":\"" << Current.Name << "\"";
+
+				for (int Phase = 0; Phase < PhaseCount; Phase++)
+				{
+					std::cout << ",\"" << PhaseNames[Phase] << "_p50_us\":" << GetPercentile(Samples[Phase], 0.5) <<
+								 ",\"" << PhaseNames[Phase] << "_p99_us\":" << GetPercentile(Samples[Phase], 0.99);
+				}
+
+				std::cout << "}" << std::endl;
+			}
+			else
+			{
+				std::cout.width(10);
+				std::cout << Size << " ";
+				std::cout.width(7);
+				std::cout << Current.Name;
+
+				for (int Phase = 0; Phase < PhaseCount; Phase++)
+				{
+					std::cout << " ";
+					std::cout.width(15);
+					std::cout << (std::to_string(GetPercentile(Samples[Phase], 0.5)) + "/" +
+								  std::to_string(GetPercentile(Samples[Phase], 0.99)));
+				}
+
+				std::cout << std::endl;
+			}
+		}
+
+		if (ExitCode != 0)
+			break;
+	}
+
+	ClearDirectory(Directory);
+	rmdir(Directory.c_str());
+
+	return ExitCode;
+}
@@ -17,17 +17,38 @@
 * Copyright 2015 Chris Foster
 */
 
-#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
 #include "Activity.hpp"
 #include "Offset.hpp"
 #include "Schedule.hpp"
+#include "ScheduleBatch.hpp"
+#include "ScheduleDaemon.hpp"
+#include "ScheduleEvents.hpp"
 #include "ScheduleFileIO.hpp"
+#include "ScheduleJournal.hpp"
+#include "ScheduleShared.hpp"
+#include "ScheduleTrace.hpp"
+#include "ScheduleWatch.hpp"
 
 struct OffsetTranslator
 {
@@ -82,365 +103,1498 @@ struct OffsetTranslator
 };
 
 
-std::string FixedWidthString(std::string const &Input, unsigned int Width, std::ios_base &(& Align)(std::ios_base &) = std::left,
-							 char Pad = ' ', std::string const &Continuation = "...")
+// Output is collected in a buffer and written out in chunks of about this size
+std::string::size_type const OutputChunkSize = 64 * 1024;
+
+
+void WriteOutput(std::string &Buffer)
 {
-	if (Width < Continuation.length())
-		Width = Continuation.length();
+	std::cout.write(Buffer.data(), Buffer.size());
+	Buffer.clear();
+}
 
-	std::ostringstream Stream;
 
-	Stream << Align << std::setw(Width) << std::setfill(Pad) << Input;
+// When SCHEDULE_TIMINGS is set, the time spent in each phase of a command is reported on standard error as it exits.
+// schedule_latency collects these.
+enum class Phase
+{
+	PARSE,
+	LAYOUT,
+	MUTATE,
+	SERIALIZE,
+	RENDER
+};
 
-	std::string Result = Stream.str();
+char const * const PhaseNames[] = { "parse", "layout", "mutate", "serialize", "render" };
 
-	if (Result.length() > Width)
-	{
-		Result.erase(Width - Continuation.length(), Result.length() - Width + Continuation.length());
-		Result += Continuation;
-	}
+bool TimingPhases = false;
+std::chrono::steady_clock::time_point Entered;
+unsigned long long PhaseTimes[5];	// In nanoseconds
 
-	return Result;
+
+// Where the span of a phase adds its time.  Phases are traced as "phase" spans; the command's span, "Command", takes
+// in the layout, serialization, and rendering it does.
+Schedule::ScheduleTrace::Tally GetPhaseTally(Phase Timed)
+{
+	return (TimingPhases ? Schedule::ScheduleTrace::Tally(PhaseTimes[static_cast<int>(Timed)]) :
+						   Schedule::ScheduleTrace::Tally());
 }
 
 
-unsigned int VerifyNameWidth(unsigned int NameWidth)
+// Lays the schedule out now, if it is out of date, so the time is counted as layout rather than as whatever reads the
+// activities first
+void LayOut(Schedule::Schedule const &CurrentSchedule)
 {
-	return (NameWidth > 30 ? 30 : (NameWidth < 13 ? 13 : NameWidth));
+	Schedule::ScheduleTrace::Span const Timer("Layout", "phase", GetPhaseTally(Phase::LAYOUT));
+
+	if (!CurrentSchedule.empty())
+		CurrentSchedule.front()->GetActualStartTime();
 }
 
 
-void DisplayHeader(unsigned int NameWidth)
+// Mutation is timed around the whole command, so the phases timed within it are taken back out.  Entered is on the
+// steady clock, which is shared between processes, so the caller can tell how long the process took to start.
+void ReportPhaseTimes()
 {
-	NameWidth = VerifyNameWidth(NameWidth);
+	if (!TimingPhases)
+		return;
+
+	PhaseTimes[static_cast<int>(Phase::MUTATE)] -= PhaseTimes[static_cast<int>(Phase::LAYOUT)] +
+												   PhaseTimes[static_cast<int>(Phase::SERIALIZE)] +
+												   PhaseTimes[static_cast<int>(Phase::RENDER)];
+
+	std::cerr << "schedule timings: entered=" <<
+				 std::chrono::duration_cast<std::chrono::nanoseconds>(Entered.time_since_epoch()).count();
+
+	for (int Index = 0; Index < 5; Index++)
+		std::cerr << " " << PhaseNames[Index] << "=" << PhaseTimes[Index];
 
-	std::cout << FixedWidthString("Index", 5) << " | " <<
-				 FixedWidthString("Fixed", 5) << " | " <<
-				 FixedWidthString("Start", 8) << " | " <<
-				 FixedWidthString("Activity Name", NameWidth) << " | " <<
-				 FixedWidthString("Length", 8) << " | " <<
-				 FixedWidthString("Desired Start", 13) << " | " <<
-				 FixedWidthString("Desired Length", 14) << std::endl;
+	std::cerr << std::endl;
 }
 
 
-void DisplayActivity(Schedule::Activity &CurrentActivity, unsigned int Index, unsigned int NameWidth)
+// Writes Value to Out, which must have room for any long.  Returns the number of characters written.
+unsigned int FormatInteger(long Value, char *Out)
 {
-	NameWidth = VerifyNameWidth(NameWidth);
+	char Digits[24];
+	unsigned int Size = 0;
+
+	unsigned long Magnitude = (Value < 0 ? -static_cast<unsigned long>(Value) : Value);
 
+	do
 	{
-		std::ostringstream Stream;
+		Digits[Size++] = '0' + Magnitude % 10;
+		Magnitude /= 10;
+	} while (Magnitude != 0);
 
-		Stream << Index;
+	unsigned int Length = 0;
 
-		std::cout << FixedWidthString(Stream.str(), 5, std::internal) << "   ";
-	}
+	if (Value < 0)
+		Out[Length++] = '-';
 
-	if (CurrentActivity.GetName() != "Pause")
+	while (Size > 0)
+		Out[Length++] = Digits[--Size];
+
+	return Length;
+}
+
+
+// Formats Offset the same way as OffsetTranslator::ToString, without allocating.  Out must hold at least 80
+// characters.  Returns the number of characters written.
+unsigned int FormatOffset(Schedule::Offset const &Offset, char *Out)
+{
+	unsigned int Length = 0;
+
+	auto AppendDenomination = [&](long Value)
 	{
-		{
-			std::string FixedString = std::string(CurrentActivity.GetStartMode() == Schedule::Activity::StartMode::FREE ? "-- " :
-												 (CurrentActivity.GetStartMode() == Schedule::Activity::StartMode::FIXED_ABSOLUTE ? "FA " : "FR ")) +
-												 (CurrentActivity.GetLengthMode() == Schedule::Activity::LengthMode::FREE ? "--" : "FA");
+		if (std::abs(Value) < 10)
+			Out[Length++] = '0';
 
-			if (CurrentActivity.GetBeginning() != nullptr)
-				FixedString.replace(0, 1, "B");
+		Length += FormatInteger(Value, Out + Length);
+	};
 
-			std::cout << FixedWidthString(FixedString, 5) << "   ";
-		}
+	if (long const Value = Offset.GetHours())
+	{
+		AppendDenomination(Value);
+		Out[Length++] = ':';
+	}
 
-		std::cout << FixedWidthString(OffsetTranslator::ToString(CurrentActivity.GetActualStartTime()), 8, std::right) << "   " <<
-					 FixedWidthString(CurrentActivity.GetName(), NameWidth) << "   " <<
-					 FixedWidthString(OffsetTranslator::ToString(CurrentActivity.GetActualLength()), 8, std::right) << "   " <<
-					 FixedWidthString(std::string(CurrentActivity.GetStartMode() == Schedule::Activity::StartMode::FIXED_RELATIVE ? "R " : "") +OffsetTranslator::ToString(CurrentActivity.GetDesiredStartTime()), 13, std::right) << "   " <<
-					 FixedWidthString(OffsetTranslator::ToString(CurrentActivity.GetDesiredLength()), 14, std::right) << std::endl;
+	if (long const Value = Offset.GetMinutes())
+	{
+		AppendDenomination(Value);
+		Out[Length++] = ':';
 	}
 	else
 	{
-		std::cout << " Pause ";
+		Out[Length++] = '0';
+		Out[Length++] = '0';
+		Out[Length++] = ':';
+	}
 
-		if (CurrentActivity.GetLengthMode() != Schedule::Activity::LengthMode::FIXED)
-			std::cout << "initiated at " << OffsetTranslator::ToString(CurrentActivity.GetActualStartTime()) << std::endl;
-		else
-			std::cout << "from " << OffsetTranslator::ToString(CurrentActivity.GetActualStartTime()) << " to " <<
-									OffsetTranslator::ToString(CurrentActivity.GetActualStartTime() + CurrentActivity.GetActualLength()) << " (Duration: " <<
-									OffsetTranslator::ToString(CurrentActivity.GetActualLength()) << ")" << std::endl;
+	if (long const Value = Offset.GetSeconds())
+		AppendDenomination(Value);
+	else
+	{
+		Out[Length++] = '0';
+		Out[Length++] = '0';
 	}
+
+	return Length;
 }
 
 
-void DisplaySchedule(Schedule::Schedule const &CurrentSchedule)
+void AppendOffset(std::string &Buffer, Schedule::Offset const &Offset)
 {
-	std::cout << "Length: " << OffsetTranslator::ToString(CurrentSchedule.GetLength()) << " | Activities: " << CurrentSchedule.size() << std::endl;
+	char Formatted[80];
+	Buffer.append(Formatted, FormatOffset(Offset, Formatted));
+}
 
-	if (CurrentSchedule.size() == 0)
-		return;
 
-	unsigned int LongestName = 0;
-	for (Schedule::Schedule::const_iterator	ActivityIterator = CurrentSchedule.begin();
-											ActivityIterator != CurrentSchedule.end();
-											++ActivityIterator)
-	{
-		if ((*ActivityIterator)->GetName().length() > LongestName)
-			LongestName = (*ActivityIterator)->GetName().length();
-	}
+enum class Alignment { LEFT,
+					   RIGHT };
 
-	LongestName = VerifyNameWidth(LongestName);
 
-	DisplayHeader(LongestName);
+// Appends Input padded or truncated to exactly Width characters.  Truncated input ends with "...".
+void AppendCell(std::string &Buffer, char const *Input, std::string::size_type Length, unsigned int Width,
+				Alignment Align = Alignment::LEFT)
+{
+	static char const Continuation[] = "...";
+	std::string::size_type const ContinuationLength = sizeof(Continuation) - 1;
 
-	unsigned int Index = 1;
+	if (Width < ContinuationLength)
+		Width = ContinuationLength;
 
-	for (Schedule::Schedule::const_iterator	ActivityIterator = CurrentSchedule.begin();
-											ActivityIterator != CurrentSchedule.end();
-											++ActivityIterator, Index++)
+	if (Length > Width)
+	{
+		Buffer.append(Input, Width - ContinuationLength);
+		Buffer.append(Continuation, ContinuationLength);
+	}
+	else if (Align == Alignment::LEFT)
+	{
+		Buffer.append(Input, Length);
+		Buffer.append(Width - Length, ' ');
+	}
+	else
 	{
-		DisplayActivity(**ActivityIterator, Index, LongestName);
+		Buffer.append(Width - Length, ' ');
+		Buffer.append(Input, Length);
 	}
 }
 
 
-std::vector<std::string> Arguments;
-
-
-template <typename T>
-bool Get(std::vector<std::string>::const_iterator const &Argument, T &Out)
+void AppendCell(std::string &Buffer, std::string const &Input, unsigned int Width, Alignment Align = Alignment::LEFT)
 {
-	if (Argument == Arguments.end())
-		return false;
-
-	std::string const	ArgumentString = *Argument;
-	std::istringstream	Stream(ArgumentString);
-
-	Stream >> Out;
-
-	return !Stream.fail();
+	AppendCell(Buffer, Input.data(), Input.size(), Width, Align);
 }
 
 
-bool Get(std::vector<std::string>::const_iterator const &Argument, std::string &Out)
+void AppendCell(std::string &Buffer, char const *Input, unsigned int Width, Alignment Align = Alignment::LEFT)
 {
-	if (Argument == Arguments.end())
-		return false;
-
-	Out = *Argument;
-	return true;
+	AppendCell(Buffer, Input, std::strlen(Input), Width, Align);
 }
 
 
-template <typename T>
-bool Compare(std::vector<std::string>::const_iterator &Argument, T const &Value)
+void AppendOffsetCell(std::string &Buffer, Schedule::Offset const &Offset, unsigned int Width, char const *Prefix = "")
 {
-	if (Argument == Arguments.end())
-		return false;
+	char Formatted[80];
 
-	T Out;
-	if (!Get(Argument, Out))
-		return false;
+	std::string::size_type Length = std::strlen(Prefix);
+	std::memcpy(Formatted, Prefix, Length);
+	Length += FormatOffset(Offset, Formatted + Length);
 
-	return Value == Out;
+	AppendCell(Buffer, Formatted, Length, Width, Alignment::RIGHT);
 }
 
 
-bool Compare(std::vector<std::string>::const_iterator &Argument, char const *Value)
+unsigned int VerifyNameWidth(unsigned int NameWidth)
 {
-	if (Argument == Arguments.end())
-		return false;
+	return (NameWidth > 30 ? 30 : (NameWidth < 13 ? 13 : NameWidth));
+}
 
-	std::string Out;
-	if (!Get(Argument, Out))
-		return false;
 
-	return std::string(Value) == Out;
+void AppendHeader(std::string &Buffer, unsigned int NameWidth)
+{
+	NameWidth = VerifyNameWidth(NameWidth);
+
+	AppendCell(Buffer, "Index", 5);
+	Buffer += " | ";
+	AppendCell(Buffer, "Fixed", 5);
+	Buffer += " | ";
+	AppendCell(Buffer, "Start", 8);
+	Buffer += " | ";
+	AppendCell(Buffer, "Activity Name", NameWidth);
+	Buffer += " | ";
+	AppendCell(Buffer, "Length", 8);
+	Buffer += " | ";
+	AppendCell(Buffer, "Desired Start", 13);
+	Buffer += " | ";
+	AppendCell(Buffer, "Desired Length", 14);
+	Buffer += "\n";
 }
 
 
-void DisplayHelp()
+// Current marks the activity under way, for watch
+void AppendActivity(std::string &Buffer, Schedule::Activity const &CurrentActivity, unsigned int Index, unsigned int NameWidth,
+					bool Current = false)
 {
-	std::vector<std::string>::const_iterator Argument = Arguments.begin();
+	NameWidth = VerifyNameWidth(NameWidth);
 
-	// Skip over the file, quiet, and help arguments
 	{
-		std::string Next;
-		if (Get(Argument, Next) &&
-			Next != "list" &&
-			Next != "add" &&
-			Next != "set" &&
-			Next != "move" &&
-			Next != "remove" &&
-			Next != "begin" &&
-			Next != "reset" &&
-			Next != "pause" &&
-			Next != "-q")
+		char Formatted[24];
+		AppendCell(Buffer, Formatted, FormatInteger(Index, Formatted), 5, Alignment::RIGHT);
+		Buffer += (Current ? " > " : "   ");
+	}
+
+	{
+		char FixedString[] = "-- --";
+
+		if (CurrentActivity.GetStartMode() != Schedule::Activity::StartMode::FREE)
 		{
-			++Argument;
+			FixedString[0] = 'F';
+			FixedString[1] = (CurrentActivity.GetStartMode() == Schedule::Activity::StartMode::FIXED_ABSOLUTE ? 'A' : 'R');
 		}
 
-		if (Compare(Argument, "-q"))
-			++Argument;
+		if (CurrentActivity.GetLengthMode() != Schedule::Activity::LengthMode::FREE)
+		{
+			FixedString[3] = 'F';
+			FixedString[4] = 'A';
+		}
 
-		if (Compare(Argument, "-h") || Compare(Argument, "--help"))
-			++Argument;
+		if (CurrentActivity.GetBeginning() != nullptr)
+			FixedString[0] = 'B';
+
+		AppendCell(Buffer, FixedString, 5);
+		Buffer += "   ";
 	}
 
-	std::string Command;
-	if (Get(Argument, Command))
-		++Argument;
+	AppendOffsetCell(Buffer, CurrentActivity.GetActualStartTime(), 8);
+	Buffer += "   ";
+	AppendCell(Buffer, CurrentActivity.GetName(), NameWidth);
+	Buffer += "   ";
+	AppendOffsetCell(Buffer, CurrentActivity.GetActualLength(), 8);
+	Buffer += "   ";
+	AppendOffsetCell(Buffer, CurrentActivity.GetDesiredStartTime(), 13,
+					 (CurrentActivity.GetStartMode() == Schedule::Activity::StartMode::FIXED_RELATIVE ? "R " : ""));
+	Buffer += "   ";
+	AppendOffsetCell(Buffer, CurrentActivity.GetDesiredLength(), 14);
+	Buffer += "\n";
+}
 
-	std::vector<std::pair<std::string, std::string>> Usages = {
-		{"list",	"list [Activity]\n\n"
-		 "List the schedule.  Optionally, list only Activity."},
-		{"add",		"add [-b Before] [-n Name] [-fs (f | a | r)] [-s Start] [-fl (f | a)] [-l Length]\n\n"
-		 "Add a new activity to the schedule.\n"
-		 " -b    Insert the new activity before Before.\n\n"
-		 " -n    Set the new activity's name to Name.\n\n"
-		 " -fs   Specify the new activity's start mode:\n"
-		 "         f - Free (default)\n"
-		 "         a - Fixed-Absolute\n"
-		 "         r - Fixed-Relative\n\n"
-		 " -s    Set the new activity's desired start time to Start.\n"
-		 "       Times are specified in the format hh:mm:ss\n\n"
-		 " -fl   Specify the new activity's length mode:\n"
-		 "         f - Free (default)\n"
-		 "         a - Fixed\n\n"
-		 " -l    Set the new activity's desired length to Length.\n"
-		 "       Times are specified in the format hh:mm:ss"},
-		{"set",		"set -l Length\n\n"
-		 "Set the schedule's length:\n"
-		 " -l    Set the schedule's length to Length.\n"
-		 "       Times are specified in the format hh:mm:ss\n\n"
-		 " schedule set Activity [-n Name] [-fs (f | a | r)] [-s Start] [-fl (f | a)] [-l Length])\n\n"
-		 "Set Activity's details:\n"
-		 " -n    Set the activity's name to Name.\n\n"
-		 " -fs   Specify the activity's start mode:\n"
-		 "         f - Free\n"
-		 "         a - Fixed-Absolute\n"
-		 "         r - Fixed-Relative\n\n"
-		 " -s    Set the activity's desired start time to Start.\n"
-		 "       Times are specified in the format hh:mm:ss\n\n"
-		 " -fl   Specify the activity's length mode:\n"
-		 "         f - Free\n"
-		 "         a - Fixed\n\n"
-		 " -l    Set the activity's desired length to Length.\n"
-		 "       Times are specified in the format hh:mm:ss"},
-		{"move",	"move Activity Before\n\n"
-		 "Move Activity before Before.  If Activity is equal to Before, Activity is moved\n"
-		 "to the end of the schedule."},
-		{"remove",	"remove Activity\n\n"
-		 "Delete Activity from the schedule."},
-		{"begin",	"begin [Activity [BeginTime]]\n\n"
-		 "Begin an activity.  If no activity is specified, the next unbegun activity is\n"
-		 "begun, at the current time of day.  The beginning time can be specified only if\n"
-		 "the activity to begin is also specified.  This also ends an active pause in the\n"
-		 "schedule, if there is one."},
-		{"reset",	"reset [Activity]\n\n"
-		 "Reset all beginnings in the schedule, and delete all pauses.  Activities that were\n"
-		 "split by pauses are joined again.  If Activity is specified, reset only Activity."},
-		{"pause",	"pause [PauseTime]\n\n"
-		 "Insert a pause at the current time of day or at the specified pause time.  Activities\n"
-		 "intersected by the pause are split such that the parts equal the unpaused whole."}
-	};
 
-	if (Command == "" ||
-	   (Command != "list" &&
-		Command != "add" &&
-		Command != "set" &&
-		Command != "move" &&
-		Command != "remove" &&
-		Command != "begin" &&
-		Command != "reset" &&
-		Command != "pause"))
+// Length is null for the active pause
+void AppendPause(std::string &Buffer, Schedule::Offset const &Start, Schedule::Duration const *Length)
+{
+	Buffer.append(8, ' ');
+	Buffer += " Pause ";
+
+	if (Length == nullptr)
 	{
-		std::cout << "Usage:\n"
-					 " schedule [File] [-q] [Command] [Options...]\n\n"
-					 "A small daily scheduling program that scales activities according to the amount of\n"
-					 "time available in the schedule.\n"
-					 " File       The schedule file to use.  If omitted, default.sch is used.\n\n"
-					 " -q         Quiet mode.\n\n"
-					 " Command    The command to execute.  Commands are:\n"
-					 "              list (default, if omitted)\n"
-					 "              add\n"
-					 "              set\n"
-					 "              move\n"
-					 "              remove\n"
-					 "              begin\n"
-					 "              reset\n"
-					 "              pause\n\n"
-					 "Use \"schedule --help Command\" for more info on Command." << std::endl;
+		Buffer += "initiated at ";
+		AppendOffset(Buffer, Start);
 	}
 	else
 	{
-		for (auto &Usage : Usages)
-		{
-			if (Command == Usage.first)
-			{
-				std::cout << "Usage:\n"
-							 " schedule " << Usage.second << std::endl;
-
-				break;
-			}
-		}
+		Buffer += "from ";
+		AppendOffset(Buffer, Start);
+		Buffer += " to ";
+		AppendOffset(Buffer, Start + *Length);
+		Buffer += " (Duration: ";
+		AppendOffset(Buffer, *Length);
+		Buffer += ")";
 	}
+
+	Buffer += "\n";
 }
 
 
-int main(int argc, char **argv)
-{
-	Arguments.insert(Arguments.end(), argv + 1, argv + argc);
-	std::vector<std::string>::const_iterator Argument = Arguments.begin();
+enum class OutputFormat { TABLE,
+						  JSON_LINES,
+						  TSV };
 
-	std::string ScheduleFileName = "default.sch";
-	{
-		std::string Next;
-		if (Get(Argument, Next) &&
-			Next != "list" &&
-			Next != "add" &&
-			Next != "set" &&
-			Next != "move" &&
-			Next != "remove" &&
-			Next != "begin" &&
-			Next != "reset" &&
-			Next != "pause" &&
-			Next != "-q" &&
-			Next != "-h" &&
-			Next != "--help")
-		{
-			ScheduleFileName = Next;
+OutputFormat Format = OutputFormat::TABLE;
 
-			++Argument;
-		}
-	}
+// Set by --stats
+bool ShowStats = false;
 
-	bool Quiet = false;
-	if (Compare(Argument, "-q"))
-	{
-		Quiet = true;
-		++Argument;
-	}
+// Set by --memory
+bool ShowMemory = false;
 
-	if (Compare(Argument, "-h") || Compare(Argument, "--help"))
-	{
-		DisplayHelp();
-		return 0;
-	}
+// Set by --trace
+std::string TraceFileName;
+
+
+char const *GetStartModeName(Schedule::Activity::StartMode Mode)
+{
+	return (Mode == Schedule::Activity::StartMode::FREE ? "free" :
+		   (Mode == Schedule::Activity::StartMode::FIXED_ABSOLUTE ? "fixed-absolute" : "fixed-relative"));
+}
 
 
-	Schedule::Schedule CurrentSchedule = Schedule::ScheduleFileIO::Read(ScheduleFileName);
+char const *GetLengthModeName(Schedule::Activity::LengthMode Mode)
+{
+	return (Mode == Schedule::Activity::LengthMode::FREE ? "free" : "fixed");
+}
 
 
-	std::string Command;
-	if (Get(Argument, Command))
-		++Argument;
+void AppendInteger(std::string &Buffer, long Value)
+{
+	char Formatted[24];
+	Buffer.append(Formatted, FormatInteger(Value, Formatted));
+}
 
 
-	if ((Command == "list" || Command == "") && !Quiet)
+// Appends String as a quoted JSON string
+void AppendJsonString(std::string &Buffer, std::string const &String)
+{
+	Buffer += '"';
+
+	for (char Character : String)
 	{
-		std::string Next;
-		if (Get(Argument, Next))
+		if (Character == '"' || Character == '\\')
 		{
-			unsigned int ActivityNumber;
-			if (!Get(Argument, ActivityNumber))
-			{
+			Buffer += '\\';
+			Buffer += Character;
+		}
+		else if (static_cast<unsigned char>(Character) < 0x20)
+		{
+			static char const Hex[] = "0123456789abcdef";
+
+			Buffer += "\\u00";
+			Buffer += Hex[Character >> 4];
+			Buffer += Hex[Character & 0xf];
+		}
+		else
+			Buffer += Character;
+	}
+
+	Buffer += '"';
+}
+
+
+// Times are written as whole seconds
+void AppendJsonRecord(std::string &Buffer, Schedule::Activity const &CurrentActivity, unsigned int Index)
+{
+	Buffer += "{\"index\":";
+	AppendInteger(Buffer, Index);
+	Buffer += ",\"name\":";
+	AppendJsonString(Buffer, CurrentActivity.GetName());
+
+	Buffer += ",\"start\":";
+	AppendInteger(Buffer, CurrentActivity.GetActualStartTime().GetTotalSeconds());
+	Buffer += ",\"length\":";
+	AppendInteger(Buffer, CurrentActivity.GetActualLength().GetTotalSeconds());
+	Buffer += ",\"desired_start\":";
+	AppendInteger(Buffer, CurrentActivity.GetDesiredStartTime().GetTotalSeconds());
+	Buffer += ",\"desired_length\":";
+	AppendInteger(Buffer, CurrentActivity.GetDesiredLength().GetTotalSeconds());
+	Buffer += ",\"start_mode\":\"";
+	Buffer += GetStartModeName(CurrentActivity.GetStartMode());
+	Buffer += "\",\"length_mode\":\"";
+	Buffer += GetLengthModeName(CurrentActivity.GetLengthMode());
+	Buffer += "\",\"beginning\":";
+
+	if (Schedule::Offset const * const Beginning = CurrentActivity.GetBeginning())
+		AppendInteger(Buffer, Beginning->GetTotalSeconds());
+	else
+		Buffer += "null";
+
+	Buffer += "}\n";
+}
+
+
+char const TsvHeader[] = "index\tname\tstart\tlength\tdesired_start\tdesired_length\tstart_mode\tlength_mode\tbeginning\n";
+
+
+// Appends String with its tabs, newlines, and backslashes escaped
+void AppendTsvString(std::string &Buffer, std::string const &String)
+{
+	for (char Character : String)
+	{
+		if (Character == '\t')
+			Buffer += "\\t";
+		else if (Character == '\n')
+			Buffer += "\\n";
+		else if (Character == '\\')
+			Buffer += "\\\\";
+		else
+			Buffer += Character;
+	}
+}
+
+
+// Times are written as whole seconds.  Activities that have not begun have an empty beginning.
+void AppendTsvRecord(std::string &Buffer, Schedule::Activity const &CurrentActivity, unsigned int Index)
+{
+	AppendInteger(Buffer, Index);
+	Buffer += '\t';
+	AppendTsvString(Buffer, CurrentActivity.GetName());
+	Buffer += '\t';
+	AppendInteger(Buffer, CurrentActivity.GetActualStartTime().GetTotalSeconds());
+	Buffer += '\t';
+	AppendInteger(Buffer, CurrentActivity.GetActualLength().GetTotalSeconds());
+	Buffer += '\t';
+	AppendInteger(Buffer, CurrentActivity.GetDesiredStartTime().GetTotalSeconds());
+	Buffer += '\t';
+	AppendInteger(Buffer, CurrentActivity.GetDesiredLength().GetTotalSeconds());
+	Buffer += '\t';
+	Buffer += GetStartModeName(CurrentActivity.GetStartMode());
+	Buffer += '\t';
+	Buffer += GetLengthModeName(CurrentActivity.GetLengthMode());
+	Buffer += '\t';
+
+	if (Schedule::Offset const * const Beginning = CurrentActivity.GetBeginning())
+		AppendInteger(Buffer, Beginning->GetTotalSeconds());
+
+	Buffer += '\n';
+}
+
+
+// A pause's start and length, which is null for the active pause
+typedef std::pair<Schedule::Offset, Schedule::Duration const *> DisplayedPause;
+
+
+// The schedule's pauses in order, the active one included.  Each pause is shown before the first activity starting at
+// or after it.
+std::vector<DisplayedPause> GetDisplayedPauses(Schedule::Schedule const &CurrentSchedule)
+{
+	std::vector<DisplayedPause> Pauses;
+	for (auto &Pause : CurrentSchedule.GetPauses())
+		Pauses.emplace_back(Pause.first, &Pause.second);
+
+	if (Schedule::Offset const *ActivePause = CurrentSchedule.GetActivePause())
+	{
+		Pauses.emplace(std::lower_bound(Pauses.begin(), Pauses.end(), std::make_pair(*ActivePause, nullptr),
+										[](DisplayedPause const &a, DisplayedPause const &b) { return a.first < b.first; }),
+					   *ActivePause, nullptr);
+	}
+
+	return Pauses;
+}
+
+
+// Streams the activities in the machine-readable formats.  Nothing is measured or padded.
+void DisplayRecords(Schedule::Schedule const &CurrentSchedule, unsigned int First, unsigned int Count)
+{
+	LayOut(CurrentSchedule);
+	Schedule::ScheduleTrace::Span const Timer("Render", "phase", GetPhaseTally(Phase::RENDER));
+
+	std::string Buffer;
+	Buffer.reserve(OutputChunkSize + 1024);
+
+	if (Format == OutputFormat::TSV)
+		Buffer += TsvHeader;
+
+	Schedule::Schedule::const_iterator ActivityIterator = CurrentSchedule.begin();
+	unsigned int Index = 1;
+
+	for (; ActivityIterator != CurrentSchedule.end() && Index < First; ++ActivityIterator, Index++) { }
+
+	for (; ActivityIterator != CurrentSchedule.end() && Index - First < Count; ++ActivityIterator, Index++)
+	{
+		if (Format == OutputFormat::JSON_LINES)
+			AppendJsonRecord(Buffer, **ActivityIterator, Index);
+		else
+			AppendTsvRecord(Buffer, **ActivityIterator, Index);
+
+		if (Buffer.size() >= OutputChunkSize)
+			WriteOutput(Buffer);
+	}
+
+	WriteOutput(Buffer);
+	std::cout.flush();
+}
+
+
+// Displays Count activities starting with the one numbered First.  Column widths are computed from the whole
+// schedule, so that pages of the same schedule line up.
+void DisplaySchedule(Schedule::Schedule const &CurrentSchedule, unsigned int First = 1,
+					 unsigned int Count = std::numeric_limits<unsigned int>::max())
+{
+	if (Format != OutputFormat::TABLE)
+	{
+		DisplayRecords(CurrentSchedule, First, Count);
+		return;
+	}
+
+	LayOut(CurrentSchedule);
+	Schedule::ScheduleTrace::Span const Timer("Render", "phase", GetPhaseTally(Phase::RENDER));
+
+	std::string Buffer;
+	Buffer.reserve(OutputChunkSize + 1024);
+
+	Buffer += "Length: ";
+	AppendOffset(Buffer, CurrentSchedule.GetLength());
+	Buffer += " | Activities: ";
+	{
+		char Formatted[24];
+		Buffer.append(Formatted, FormatInteger(CurrentSchedule.size(), Formatted));
+	}
+	Buffer += "\n";
+
+	if (CurrentSchedule.size() != 0)
+	{
+		unsigned int LongestName = 0;
+		for (Schedule::Schedule::const_iterator	ActivityIterator = CurrentSchedule.begin();
+												ActivityIterator != CurrentSchedule.end();
+												++ActivityIterator)
+		{
+			if ((*ActivityIterator)->GetName().length() > LongestName)
+				LongestName = (*ActivityIterator)->GetName().length();
+		}
+
+		unsigned int const NameWidth = VerifyNameWidth(LongestName);
+
+		AppendHeader(Buffer, NameWidth);
+
+		std::vector<DisplayedPause> const Pauses = GetDisplayedPauses(CurrentSchedule);
+
+		auto PauseIterator = Pauses.cbegin();
+
+		Schedule::Schedule::const_iterator ActivityIterator = CurrentSchedule.begin();
+		unsigned int Index = 1;
+
+		for (; ActivityIterator != CurrentSchedule.end() && Index < First; ++ActivityIterator, Index++)
+		{
+			while (PauseIterator != Pauses.end() && PauseIterator->first <= (*ActivityIterator)->GetActualStartTime())
+				++PauseIterator;
+		}
+
+		for (; ActivityIterator != CurrentSchedule.end() && Index - First < Count; ++ActivityIterator, Index++)
+		{
+			while (PauseIterator != Pauses.end() && PauseIterator->first <= (*ActivityIterator)->GetActualStartTime())
+			{
+				AppendPause(Buffer, PauseIterator->first, PauseIterator->second);
+				++PauseIterator;
+			}
+
+			AppendActivity(Buffer, **ActivityIterator, Index, NameWidth);
+
+			if (Buffer.size() >= OutputChunkSize)
+				WriteOutput(Buffer);
+		}
+
+		if (ActivityIterator == CurrentSchedule.end())
+		{
+			for (; PauseIterator != Pauses.end(); ++PauseIterator)
+				AppendPause(Buffer, PauseIterator->first, PauseIterator->second);
+		}
+	}
+
+	WriteOutput(Buffer);
+	std::cout.flush();
+}
+
+
+// Appends the counts in Stats, in the output format
+void AppendStats(std::string &Buffer, Schedule::ScheduleStats const &Stats)
+{
+	if (Format == OutputFormat::JSON_LINES)
+		Buffer += '{';
+	else if (Format == OutputFormat::TSV)
+		Buffer += "counter\tcount\n";
+
+	for (int Counted = 0; Counted < Schedule::ScheduleStats::COUNTERS; Counted++)
+	{
+		char const * const Name = Schedule::ScheduleStats::GetName(static_cast<Schedule::ScheduleStats::Counter>(Counted));
+
+		if (Format == OutputFormat::JSON_LINES)
+		{
+			if (Counted != 0)
+				Buffer += ',';
+
+			Buffer += '"';
+			Buffer += Name;
+			Buffer += "\":";
+			AppendInteger(Buffer, Stats.Counts[Counted]);
+		}
+		else if (Format == OutputFormat::TSV)
+		{
+			Buffer += Name;
+			Buffer += '\t';
+			AppendInteger(Buffer, Stats.Counts[Counted]);
+			Buffer += '\n';
+		}
+		else
+		{
+			char Formatted[24];
+
+			AppendCell(Buffer, Name, 20);
+			AppendCell(Buffer, Formatted, FormatInteger(Stats.Counts[Counted], Formatted), 16, Alignment::RIGHT);
+			Buffer += '\n';
+		}
+	}
+
+	if (Format == OutputFormat::JSON_LINES)
+		Buffer += "}\n";
+}
+
+
+// The counts from Before until now
+Schedule::ScheduleStats GetStatsSince(Schedule::ScheduleStats const &Before)
+{
+	Schedule::ScheduleStats Result = Schedule::Schedule::GetStats();
+
+	for (int Counted = 0; Counted < Schedule::ScheduleStats::COUNTERS; Counted++)
+		Result.Counts[Counted] -= Before.Counts[Counted];
+
+	return Result;
+}
+
+
+// Shows the work done since Before on standard error, for --stats
+void ReportStats(Schedule::ScheduleStats const &Before)
+{
+	if (!ShowStats)
+		return;
+
+	if (!Schedule::ScheduleStats::Enabled)
+	{
+		std::cerr << "Statistics were not compiled in.  Build with SCHEDULE_STATS to keep them." << std::endl;
+		return;
+	}
+
+	std::string Buffer;
+	AppendStats(Buffer, GetStatsSince(Before));
+
+	std::cerr << Buffer;
+	std::cerr.flush();
+}
+
+
+// Shows the memory held by the schedule and its journal on standard error, for --memory
+void ReportMemory(Schedule::Schedule const &CurrentSchedule, Schedule::ScheduleJournal const &Journal)
+{
+	if (!ShowMemory)
+		return;
+
+	Schedule::ScheduleMemory Usage = CurrentSchedule.GetMemoryUsage();
+	Journal.AddMemoryUsage(Usage);
+
+	std::pair<char const *, std::size_t> const Counts[] = {
+		{ "activities",		Usage.Activities },
+		{ "names",			Usage.Names },
+		{ "beginnings",		Usage.Beginnings },
+		{ "nodes",			Usage.Nodes },
+		{ "caches",			Usage.Caches },
+		{ "state",			Usage.State },
+		{ "journal",		Usage.Journal },
+		{ "total",			Usage.GetTotal() },
+		{ "allocations",	Usage.Allocations }
+	};
+
+	std::string Buffer;
+
+	if (Format == OutputFormat::JSON_LINES)
+		Buffer += '{';
+	else if (Format == OutputFormat::TSV)
+		Buffer += "held_by\tbytes\n";
+
+	for (auto &Count : Counts)
+	{
+		if (Format == OutputFormat::JSON_LINES)
+		{
+			if (&Count != Counts)
+				Buffer += ',';
+
+			Buffer += '"';
+			Buffer += Count.first;
+			Buffer += (&Count == &Counts[8] ? "\":" : "_bytes\":");
+			AppendInteger(Buffer, Count.second);
+		}
+		else if (Format == OutputFormat::TSV)
+		{
+			Buffer += Count.first;
+			Buffer += '\t';
+			AppendInteger(Buffer, Count.second);
+			Buffer += '\n';
+		}
+		else
+		{
+			char Formatted[24];
+
+			AppendCell(Buffer, Count.first, 20);
+			AppendCell(Buffer, Formatted, FormatInteger(Count.second, Formatted), 16, Alignment::RIGHT);
+			Buffer += '\n';
+		}
+	}
+
+	if (Format == OutputFormat::JSON_LINES)
+		Buffer += "}\n";
+
+	std::cerr << Buffer;
+	std::cerr.flush();
+}
+
+
+unsigned int GetIndex(Schedule::Schedule const &CurrentSchedule, Schedule::Schedule::const_iterator Position)
+{
+	return std::distance(CurrentSchedule.begin(), Position) + 1;
+}
+
+
+// Whichever activity becomes first gets a fixed-absolute start.  Journal that ahead of the change that causes it, so
+// that undoing the change puts the start mode back after the activity has left the front.
+void JournalPromotion(Schedule::ScheduleJournal &Journal, unsigned int Index, Schedule::Activity const &Promoted)
+{
+	if (Promoted.GetStartMode() == Schedule::Activity::StartMode::FIXED_ABSOLUTE)
+		return;
+
+	Schedule::Activity Fixed(Promoted);
+	Fixed.SetStartMode(Schedule::Activity::StartMode::FIXED_ABSOLUTE);
+
+	Journal.Modify(Index, Promoted, Fixed);
+}
+
+
+bool SaveSchedule(Schedule::Schedule const &CurrentSchedule, std::string const &FileName, Schedule::ScheduleJournal &Journal, bool Journaled)
+{
+	LayOut(CurrentSchedule);
+	Schedule::ScheduleTrace::Span const Timer("Serialize", "phase", GetPhaseTally(Phase::SERIALIZE));
+
+	if (!(Journaled ? Journal.Commit(CurrentSchedule) : Schedule::ScheduleFileIO::Write(CurrentSchedule, FileName)))
+		return false;
+
+	return Journal.CommitHistory(CurrentSchedule);
+}
+
+
+// Runs Hook with the shell, in the background, for an activity starting or ending under watch.  The activity and the
+// transition are passed in the environment.  The hook's output is discarded, so that it can't disturb the display.
+void RunHook(std::string const &Hook, std::string const &FileName, Schedule::Activity const &Changed,
+			 Schedule::ScheduleEvents::Transition Kind, Schedule::Offset const &At)
+{
+	pid_t const Child = fork();
+
+	if (Child < 0)
+		return;
+
+	if (Child == 0)
+	{
+		setenv("SCHEDULE_FILE", FileName.c_str(), 1);
+		setenv("SCHEDULE_ACTIVITY", Changed.GetName().c_str(), 1);
+		setenv("SCHEDULE_EVENT", Schedule::ScheduleEvents::GetName(Kind), 1);
+		setenv("SCHEDULE_TIME", OffsetTranslator::ToString(At).c_str(), 1);
+
+		int const Null = open("/dev/null", O_RDWR);
+		if (Null >= 0)
+		{
+			dup2(Null, STDIN_FILENO);
+			dup2(Null, STDOUT_FILENO);
+			dup2(Null, STDERR_FILENO);
+		}
+
+		execl("/bin/sh", "sh", "-c", Hook.c_str(), static_cast<char *>(nullptr));
+		_exit(127);
+	}
+}
+
+
+// Shows the activity under way and the one to come, for now.  Activities are numbered from 1, as in list.
+void DisplayStatus(Schedule::ScheduleShared::Status const &Shown)
+{
+	std::string Buffer;
+
+	std::pair<char const *, Schedule::ScheduleShared::Row const *> const Rows[] = {
+		{ "current", &Shown.Current },
+		{ "next", &Shown.Next }
+	};
+
+	if (Format == OutputFormat::JSON_LINES)
+	{
+		Buffer += '{';
+
+		for (auto &Row : Rows)
+		{
+			Buffer += '"';
+			Buffer += Row.first;
+			Buffer += "\":";
+
+			if (Row.second->Index < Shown.Size)
+			{
+				Buffer += "{\"index\":";
+				AppendInteger(Buffer, Row.second->Index + 1);
+				Buffer += ",\"name\":";
+				AppendJsonString(Buffer, Row.second->Name);
+				Buffer += ",\"start\":";
+				AppendInteger(Buffer, Row.second->StartTime.GetTotalSeconds());
+				Buffer += ",\"end\":";
+				AppendInteger(Buffer, Row.second->EndTime.GetTotalSeconds());
+				Buffer += "},";
+			}
+			else
+				Buffer += "null,";
+		}
+
+		Buffer += "\"boundary\":";
+
+		if (Shown.HasBoundary)
+			AppendInteger(Buffer, Shown.Boundary.GetTotalSeconds());
+		else
+			Buffer += "null";
+
+		Buffer += ",\"published\":";
+
+		if (Shown.Published != 0)
+			AppendInteger(Buffer, Shown.Published);
+		else
+			Buffer += "null";
+
+		Buffer += "}\n";
+	}
+	else if (Format == OutputFormat::TSV)
+	{
+		Buffer += "activity\tindex\tname\tstart\tend\n";
+
+		for (auto &Row : Rows)
+		{
+			if (Row.second->Index >= Shown.Size)
+				continue;
+
+			Buffer += Row.first;
+			Buffer += '\t';
+			AppendInteger(Buffer, Row.second->Index + 1);
+			Buffer += '\t';
+			AppendTsvString(Buffer, Row.second->Name);
+			Buffer += '\t';
+			AppendInteger(Buffer, Row.second->StartTime.GetTotalSeconds());
+			Buffer += '\t';
+			AppendInteger(Buffer, Row.second->EndTime.GetTotalSeconds());
+			Buffer += '\n';
+		}
+	}
+	else
+	{
+		for (auto &Row : Rows)
+		{
+			Buffer += (Row.second == &Shown.Current ? "Now:  " : "Next: ");
+
+			if (Row.second->Index < Shown.Size)
+			{
+				Buffer += Row.second->Name;
+				Buffer += " (";
+				AppendOffset(Buffer, Row.second->StartTime);
+				Buffer += " - ";
+				AppendOffset(Buffer, Row.second->EndTime);
+				Buffer += ")\n";
+			}
+			else
+				Buffer += "nothing\n";
+		}
+	}
+
+	WriteOutput(Buffer);
+	std::cout.flush();
+}
+
+
+// Draws the schedule for watch.  On a terminal, the schedule fills the alternate screen, and only the rows that
+// change are rewritten, in place.  Rows past the bottom of the screen aren't drawn.  Otherwise, the table is listed
+// again after each change, and the machine-readable formats give only the changed activities.
+class WatchDisplay
+{
+public:
+	WatchDisplay() :
+		Terminal(isatty(STDOUT_FILENO) != 0),
+		Entered(false),
+		NameWidth(0),
+		Height(0)
+	{
+
+	}
+
+	~WatchDisplay()
+	{
+		if (this->Entered)
+		{
+			std::cout << "\x1b[?25h\x1b[?1049l";
+			std::cout.flush();
+		}
+	}
+
+	void Draw(Schedule::Schedule const &Watched, Schedule::Schedule::size_type Current,
+			  std::vector<Schedule::Schedule::ActivityRange> const &Changed, bool Everything)
+	{
+		if (!this->Terminal)
+		{
+			if (Format == OutputFormat::TABLE)
+				DisplaySchedule(Watched);
+			else if (Everything)
+				DisplayRecords(Watched, 1, std::numeric_limits<unsigned int>::max());
+			else
+			{
+				for (auto &Range : Changed)
+					DisplayRecords(Watched, Range.First + 1, Range.Count);
+			}
+
+			return;
+		}
+
+		if (Everything)
+		{
+			this->DrawEverything(Watched, Current);
+			return;
+		}
+
+		std::string Buffer;
+
+		Schedule::Schedule::const_iterator ActivityIterator = Watched.begin();
+		Schedule::Schedule::size_type Index = 0;
+
+		for (auto &Range : Changed)
+		{
+			std::advance(ActivityIterator, Range.First - Index);
+			Index = Range.First;
+
+			for (; Index < Range.First + Range.Count; ++ActivityIterator, Index++)
+			{
+				Schedule::Activity const &Drawn = **ActivityIterator;
+
+				// A longer name widens the column, which moves every row
+				if (Drawn.GetName().size() > this->NameWidth && this->NameWidth < VerifyNameWidth(Drawn.GetName().size()))
+				{
+					this->DrawEverything(Watched, Current);
+					return;
+				}
+
+				if (this->Height != 0 && this->Lines[Index] > this->Height)
+					continue;
+
+				Buffer += "\x1b[";
+				AppendInteger(Buffer, this->Lines[Index]);
+				Buffer += ";1H";
+				AppendActivity(Buffer, Drawn, Index + 1, this->NameWidth, Index == Current);
+				Buffer.back() = '\x1b';
+				Buffer += "[K";
+			}
+		}
+
+		WriteOutput(Buffer);
+		std::cout.flush();
+	}
+
+private:
+	void DrawEverything(Schedule::Schedule const &Watched, Schedule::Schedule::size_type Current)
+	{
+		{
+			winsize Size;
+			this->Height = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &Size) == 0 ? Size.ws_row : 0);
+		}
+
+		// The alternate screen, with the cursor hidden, from the top left
+		std::string Buffer(this->Entered ? "\x1b[H\x1b[2J" : "\x1b[?1049h\x1b[?25l\x1b[H\x1b[2J");
+		this->Entered = true;
+
+		unsigned int Line = 1;
+		auto const EndLine = [&]()
+		{
+			if (this->Height == 0 || Line < this->Height)
+				Buffer += '\n';
+
+			Line++;
+		};
+
+		Buffer += "Length: ";
+		AppendOffset(Buffer, Watched.GetLength());
+		Buffer += " | Activities: ";
+		AppendInteger(Buffer, Watched.size());
+		EndLine();
+
+		unsigned int LongestName = 0;
+		for (auto Drawn : Watched)
+			LongestName = std::max<unsigned int>(LongestName, Drawn->GetName().size());
+
+		this->NameWidth = VerifyNameWidth(LongestName);
+		this->Lines.resize(Watched.size());
+
+		if (!Watched.empty())
+		{
+			AppendHeader(Buffer, this->NameWidth);
+			Buffer.pop_back();
+			EndLine();
+		}
+
+		std::vector<DisplayedPause> const Pauses = GetDisplayedPauses(Watched);
+		auto PauseIterator = Pauses.cbegin();
+
+		Schedule::Schedule::size_type Index = 0;
+
+		for (auto Drawn : Watched)
+		{
+			for (; PauseIterator != Pauses.end() && PauseIterator->first <= Drawn->GetActualStartTime(); ++PauseIterator)
+			{
+				if (this->Height == 0 || Line <= this->Height)
+				{
+					AppendPause(Buffer, PauseIterator->first, PauseIterator->second);
+					Buffer.pop_back();
+				}
+
+				EndLine();
+			}
+
+			this->Lines[Index] = Line;
+
+			if (this->Height == 0 || Line <= this->Height)
+			{
+				AppendActivity(Buffer, *Drawn, Index + 1, this->NameWidth, Index == Current);
+				Buffer.pop_back();
+			}
+
+			EndLine();
+			Index++;
+		}
+
+		for (; PauseIterator != Pauses.end() && (this->Height == 0 || Line <= this->Height); ++PauseIterator)
+		{
+			AppendPause(Buffer, PauseIterator->first, PauseIterator->second);
+			Buffer.pop_back();
+			EndLine();
+		}
+
+		WriteOutput(Buffer);
+		std::cout.flush();
+	}
+
+	bool						Terminal;
+	bool						Entered;
+	unsigned int				NameWidth;
+	unsigned int				Height;		// Lines on the terminal, or 0 if unknown
+	std::vector<unsigned int>	Lines;		// Where each activity was drawn, counting lines from 1
+};
+
+
+std::vector<std::string> Arguments;
+
+
+template <typename T>
+bool Get(std::vector<std::string>::const_iterator const &Argument, T &Out)
+{
+	if (Argument == Arguments.end())
+		return false;
+
+	std::string const	ArgumentString = *Argument;
+	std::istringstream	Stream(ArgumentString);
+
+	Stream >> Out;
+
+	return !Stream.fail();
+}
+
+
+bool Get(std::vector<std::string>::const_iterator const &Argument, std::string &Out)
+{
+	if (Argument == Arguments.end())
+		return false;
+
+	Out = *Argument;
+	return true;
+}
+
+
+template <typename T>
+bool Compare(std::vector<std::string>::const_iterator &Argument, T const &Value)
+{
+	if (Argument == Arguments.end())
+		return false;
+
+	T Out;
+	if (!Get(Argument, Out))
+		return false;
+
+	return Value == Out;
+}
+
+
+bool Compare(std::vector<std::string>::const_iterator &Argument, char const *Value)
+{
+	if (Argument == Arguments.end())
+		return false;
+
+	std::string Out;
+	if (!Get(Argument, Out))
+		return false;
+
+	return std::string(Value) == Out;
+}
+
+
+void DisplayHelp()
+{
+	std::vector<std::string>::const_iterator Argument = Arguments.begin();
+
+	std::string Command;
+
+	// Skip over the file, option, and help arguments
+	{
+		std::string Next;
+		if (Get(Argument, Next) &&
+			Next != "list" &&
+			Next != "add" &&
+			Next != "set" &&
+			Next != "move" &&
+			Next != "remove" &&
+			Next != "begin" &&
+			Next != "reset" &&
+			Next != "pause" &&
+			Next != "undo" &&
+			Next != "redo" &&
+			Next != "script" &&
+			Next != "daemon" &&
+			Next != "batch" &&
+			Next != "stats" &&
+			Next != "watch" &&
+			Next != "now" &&
+			Next != "-q" &&
+			Next != "-j" &&
+			Next.compare(0, 9, "--format=") != 0 &&
+			Next != "--stats" &&
+			Next != "--memory" &&
+			Next.compare(0, 8, "--trace=") != 0)
+		{
+			++Argument;
+		}
+
+		if (Compare(Argument, "-q"))
+			++Argument;
+
+		if (Compare(Argument, "-j"))
+			++Argument;
+
+		if (Get(Argument, Command) && Command.compare(0, 9, "--format=") == 0)
+			++Argument;
+
+		if (Compare(Argument, "--stats"))
+			++Argument;
+
+		if (Compare(Argument, "--memory"))
+			++Argument;
+
+		if (Get(Argument, Command) && Command.compare(0, 8, "--trace=") == 0)
+			++Argument;
+
+		if (Compare(Argument, "-h") || Compare(Argument, "--help"))
+			++Argument;
+	}
+
+	if (Get(Argument, Command))
+		++Argument;
+	else
+		Command.clear();
+
+	std::vector<std::pair<std::string, std::string>> Usages = {
+		{"list",	"list [Activity | [--from First] [--count Count]]\n\n"
+		 "List the schedule.  Optionally, list only Activity, or only Count activities\n"
+		 "starting with First."},
+		{"add",		"add [-b Before] [-n Name] [-fs (f | a | r)] [-s Start] [-fl (f | a)] [-l Length]\n\n"
+		 "Add a new activity to the schedule.\n"
+		 " -b    Insert the new activity before Before.\n\n"
+		 " -n    Set the new activity's name to Name.\n\n"
+		 " -fs   Specify the new activity's start mode:\n"
+		 "         f - Free (default)\n"
+		 "         a - Fixed-Absolute\n"
+		 "         r - Fixed-Relative\n\n"
+		 " -s    Set the new activity's desired start time to Start.\n"
+		 "       Times are specified in the format hh:mm:ss\n\n"
+		 " -fl   Specify the new activity's length mode:\n"
+		 "         f - Free (default)\n"
+		 "         a - Fixed\n\n"
+		 " -l    Set the new activity's desired length to Length.\n"
+		 "       Times are specified in the format hh:mm:ss"},
+		{"set",		"set -l Length\n\n"
+		 "Set the schedule's length:\n"
+		 " -l    Set the schedule's length to Length.\n"
+		 "       Times are specified in the format hh:mm:ss\n\n"
+		 " schedule set Activity [-n Name] [-fs (f | a | r)] [-s Start] [-fl (f | a)] [-l Length])\n\n"
+		 "Set Activity's details:\n"
+		 " -n    Set the activity's name to Name.\n\n"
+		 " -fs   Specify the activity's start mode:\n"
+		 "         f - Free\n"
+		 "         a - Fixed-Absolute\n"
+		 "         r - Fixed-Relative\n\n"
+		 " -s    Set the activity's desired start time to Start.\n"
+		 "       Times are specified in the format hh:mm:ss\n\n"
+		 " -fl   Specify the activity's length mode:\n"
+		 "         f - Free\n"
+		 "         a - Fixed\n\n"
+		 " -l    Set the activity's desired length to Length.\n"
+		 "       Times are specified in the format hh:mm:ss"},
+		{"move",	"move Activity Before\n\n"
+		 "Move Activity before Before.  If Activity is equal to Before, Activity is moved\n"
+		 "to the end of the schedule."},
+		{"remove",	"remove Activity\n\n"
+		 "Delete Activity from the schedule."},
+		{"begin",	"begin [Activity [BeginTime]]\n\n"
+		 "Begin an activity.  If no activity is specified, the next unbegun activity is\n"
+		 "begun, at the current time of day.  The beginning time can be specified only if\n"
+		 "the activity to begin is also specified.  This also ends an active pause in the\n"
+		 "schedule, if there is one."},
+		{"reset",	"reset [Activity]\n\n"
+		 "Reset all beginnings in the schedule, and delete all pauses.  If Activity is\n"
+		 "specified, reset only Activity."},
+		{"pause",	"pause [PauseTime]\n\n"
+		 "Pause the schedule at the current time of day or at the specified pause time.  The\n"
+		 "pause lasts until the next begin, and activities after it are pushed back by its\n"
+		 "length.  Activities intersected by the pause are shown with their paused time included."},
+		{"undo",	"undo [Count]\n\n"
+		 "Undo the last change to the schedule, or the last Count changes.  Changes are\n"
+		 "remembered in a file next to File, up to the last 100."},
+		{"redo",	"redo [Count]\n\n"
+		 "Redo the last undone change, or the last Count undone changes.  Making a new change\n"
+		 "forgets the changes that were undone."},
+		{"script",	"script [ScriptFile | -e Commands]\n\n"
+		 "Run a sequence of commands, one per line, from ScriptFile, from Commands, or from\n"
+		 "standard input if ScriptFile is - or omitted.  Each line is a command as it would\n"
+		 "follow File on the command line, for example:\n"
+		 "  add -n \"Morning email\" -l 00:30:00\n"
+		 "Text after # is ignored.  The schedule is read once and written once, and the final\n"
+		 "schedule is listed unless quiet mode is on.  Only list commands display anything\n"
+		 "before then.  If a command fails, the commands before it are kept."},
+		{"daemon",	"daemon\n\n"
+		 "Keep schedules in memory and serve commands for them over a local socket.  While\n"
+		 "a daemon is running, other invocations of schedule are forwarded to it, and changes\n"
+		 "are written back to the schedule files shortly after they are made.  The socket is\n"
+		 "$SCHEDULE_SOCKET if set, or schedule.sock in $XDG_RUNTIME_DIR."},
+		{"batch",	"batch [-w] [-t Threads] Path...\n\n"
+		 "Read and lay out many schedules at once, reporting how long each took and any errors.\n"
+		 "Each Path is a directory, whose .sch files are processed, or a manifest listing one\n"
+		 "schedule file per line.  File is ignored.\n"
+		 " -w    Rewrite each schedule after laying it out.\n\n"
+		 " -t    Use Threads threads.  By default, one is used per core."},
+		{"stats",	"stats\n\n"
+		 "Show counts of the work done laying out, reading, and writing schedules, and the\n"
+		 "time it took.  Run directly, File is read and laid out first.  Forwarded to a daemon,\n"
+		 "the counts cover everything the daemon has done since it started.  The counts are\n"
+		 "only kept when schedule is built with SCHEDULE_STATS."},
+		{"watch",	"watch [--on-start Command] [--on-end Command] [--publish]\n\n"
+		 "Show the schedule and keep it up to date until interrupted.  Changes made to File\n"
+		 "by other invocations of schedule are shown as they are saved, redrawing only the\n"
+		 "activities they affect, and the activity under way is marked with >.  Nothing is\n"
+		 "done in between.  When standard output isn't a terminal, the schedule is listed\n"
+		 "again after each change, or, with --format=jsonl or tsv, just the changed activities.\n"
+		 " --on-start  Run Command with the shell as each activity starts.\n\n"
+		 " --on-end    Run Command with the shell as each activity ends.  Ends come before\n"
+		 "             starts at the same time.\n\n"
+		 " --publish   Keep the laid out schedule in shared memory, for the now command to read.\n"
+		 "             The memory is named $SCHEDULE_SHARED if set, or else after the user.\n\n"
+		 "Commands run in the background, with their output discarded, and are given\n"
+		 "$SCHEDULE_FILE, $SCHEDULE_ACTIVITY (its name), $SCHEDULE_EVENT (start or end), and\n"
+		 "$SCHEDULE_TIME (hh:mm:ss).  In quiet mode, the schedule isn't shown."},
+		{"now",		"now\n\n"
+		 "Show the activity under way and the one to come.  If a watch is publishing a\n"
+		 "schedule, they are read from its shared memory, without reading File or laying it\n"
+		 "out; otherwise File is read.  With --format=jsonl or tsv, times are in seconds."}
+	};
+
+	if (Command == "" ||
+	   (Command != "list" &&
+		Command != "add" &&
+		Command != "set" &&
+		Command != "move" &&
+		Command != "remove" &&
+		Command != "begin" &&
+		Command != "reset" &&
+		Command != "pause" &&
+		Command != "undo" &&
+		Command != "redo" &&
+		Command != "script" &&
+		Command != "daemon" &&
+		Command != "batch" &&
+		Command != "stats" &&
+		Command != "watch" &&
+		Command != "now"))
+	{
+		std::cout << "Usage:\n"
+					 " schedule [File] [-q] [-j] [--format=Format] [--stats] [--memory] [--trace=TraceFile]\n"
+					 "          [Command] [Options...]\n\n"
+					 "A small daily scheduling program that scales activities according to the amount of\n"
+					 "time available in the schedule.\n"
+					 " File       The schedule file to use.  If omitted, default.sch is used.\n\n"
+					 " -q         Quiet mode.\n\n"
+					 " -j         Journal mode.  Changes are appended to a log next to File instead of\n"
+					 "            rewriting it, and folded back into File once the log grows large.\n\n"
+					 " --format   How schedules are displayed:\n"
+					 "              table - Aligned columns (default)\n"
+					 "              jsonl - One JSON object per activity per line\n"
+					 "              tsv   - Tab-separated values, with a header line\n"
+					 "            jsonl and tsv give times in seconds.\n\n"
+					 " --stats    After the command, show the work it did on standard error, as the\n"
+					 "            stats command does.\n\n"
+					 " --memory   After the command, show the memory held by the schedule, its cached\n"
+					 "            layouts, and its journal and undo history on standard error.\n\n"
+					 " --trace    Record where the command spent its time in TraceFile, as Chrome trace\n"
+					 "            events, which chrome://tracing and Perfetto can open.  Setting\n"
+					 "            $SCHEDULE_TRACE to a file name does the same for every command.\n\n"
+					 " Command    The command to execute.  Commands are:\n"
+					 "              list (default, if omitted)\n"
+					 "              add\n"
+					 "              set\n"
+					 "              move\n"
+					 "              remove\n"
+					 "              begin\n"
+					 "              reset\n"
+					 "              pause\n"
+					 "              undo\n"
+					 "              redo\n"
+					 "              script\n"
+					 "              daemon\n"
+					 "              batch\n"
+					 "              stats\n"
+					 "              watch\n"
+					 "              now\n\n"
+					 "Use \"schedule --help Command\" for more info on Command." << std::endl;
+	}
+	else
+	{
+		for (auto &Usage : Usages)
+		{
+			if (Command == Usage.first)
+			{
+				std::cout << "Usage:\n"
+							 " schedule " << Usage.second << std::endl;
+
+				break;
+			}
+		}
+	}
+}
+
+
+// Splits a script line into arguments.  Arguments are separated by whitespace, and can be quoted with " or '.
+// Anything after an unquoted # is ignored.  Returns false if a quote is left open.
+bool SplitScriptLine(std::string const &Line, std::vector<std::string> &Out)
+{
+	Out.clear();
+
+	std::string	Current;
+	bool		InArgument = false;
+	char		Quote = '\0';
+
+	for (std::string::size_type Position = 0; Position < Line.size(); Position++)
+	{
+		char const Character = Line[Position];
+
+		if (Quote != '\0')
+		{
+			if (Character == Quote)
+				Quote = '\0';
+			else if (Character == '\\' && Quote == '"' && Position + 1 < Line.size())
+				Current += Line[++Position];
+			else
+				Current += Character;
+
+			continue;
+		}
+
+		if (Character == '#')
+			break;
+
+		if (std::isspace(static_cast<unsigned char>(Character)))
+		{
+			if (InArgument)
+				Out.push_back(Current);
+
+			Current.clear();
+			InArgument = false;
+			continue;
+		}
+
+		InArgument = true;
+
+		if (Character == '"' || Character == '\'')
+			Quote = Character;
+		else if (Character == '\\' && Position + 1 < Line.size())
+			Current += Line[++Position];
+		else
+			Current += Character;
+	}
+
+	if (Quote != '\0')
+		return false;
+
+	if (InArgument)
+		Out.push_back(Current);
+
+	return true;
+}
+
+
+// Reads the script named by the arguments following the script command: -e Commands, a file, or - or nothing for
+// standard input
+bool ReadScript(std::vector<std::string>::const_iterator Argument, std::string &Script)
+{
+	if (Compare(Argument, "-e"))
+		return Get(Argument + 1, Script);
+
+	std::string ScriptFileName = "-";
+	Get(Argument, ScriptFileName);
+
+	std::ostringstream Stream;
+
+	if (ScriptFileName == "-")
+		Stream << std::cin.rdbuf();
+	else
+	{
+		std::ifstream File(ScriptFileName);
+
+		if (!File)
+		{
+			std::cerr << ScriptFileName << ": cannot open file" << std::endl;
+			return false;
+		}
+
+		Stream << File.rdbuf();
+	}
+
+	Script = Stream.str();
+	return true;
+}
+
+
+int RunScript(Schedule::Schedule &CurrentSchedule, Schedule::ScheduleJournal &Journal, std::string const &Script,
+			  bool Quiet, std::function<bool ()> const &Save);
+
+
+int ExecuteCommand(Schedule::Schedule &CurrentSchedule, Schedule::ScheduleJournal &Journal,
+				   std::vector<std::string>::const_iterator Argument, bool Quiet, std::function<bool ()> const &Save)
+{
+	std::string Command;
+	if (Get(Argument, Command))
+		++Argument;
+
+
+	if ((Command == "list" || Command == "") && !Quiet)
+	{
+		std::string Next;
+		if (Get(Argument, Next) && (Next == "--from" || Next == "--count"))
+		{
+			unsigned int First = 1;
+			unsigned int Count = std::numeric_limits<unsigned int>::max();
+
+			while (Get(Argument, Next))
+			{
+				unsigned int * const Value = (Next == "--from" ? &First : (Next == "--count" ? &Count : nullptr));
+
+				if (Value == nullptr || !Get(Argument + 1, *Value))
+				{
+					DisplayHelp();
+					return 1;
+				}
+
+				Argument += 2;
+			}
+
+			if (First == 0)
+			{
+				std::cerr << "Activity number out of range." << std::endl;
+				return 2;
+			}
+
+			DisplaySchedule(CurrentSchedule, First, Count);
+		}
+		else if (Get(Argument, Next))
+		{
+			unsigned int ActivityNumber;
+			if (!Get(Argument, ActivityNumber))
+			{
 				DisplayHelp();
 				return 1;
 			}
@@ -459,8 +1613,16 @@ int main(int argc, char **argv)
 					{
 						unsigned int const NameWidth = Activity->GetName().size();
 
-						DisplayHeader(NameWidth);
-						DisplayActivity(*Activity, Index, NameWidth);
+						if (Format != OutputFormat::TABLE)
+							DisplayRecords(CurrentSchedule, Index, 1);
+						else
+						{
+							std::string Buffer;
+							AppendHeader(Buffer, NameWidth);
+							AppendActivity(Buffer, *Activity, Index, NameWidth);
+							WriteOutput(Buffer);
+						}
+
 						break;
 					}
 
@@ -492,8 +1654,11 @@ int main(int argc, char **argv)
 					return 1;
 				}
 
+				Schedule::Duration const PreviousLength = CurrentSchedule.GetLength();
+
 				CurrentSchedule.SetLength(OffsetTranslator::ToOffset(Next));
-				Schedule::ScheduleFileIO::Write(CurrentSchedule, ScheduleFileName);
+				Journal.SetLength(PreviousLength, CurrentSchedule.GetLength());
+				Save();
 
 				if (!Quiet)
 					DisplaySchedule(CurrentSchedule);
@@ -579,6 +1744,8 @@ int main(int argc, char **argv)
 			}
 		}
 
+		Schedule::Activity const PreviousActivity(*CurrentActivity);
+
 
 		// Go through the arguments and make the requested changes
 		{
@@ -655,15 +1822,20 @@ int main(int argc, char **argv)
 			if (Command == "add")
 			{
 				if (BeforeActivity == CurrentSchedule.end())
+				{
 					CurrentSchedule.push_back(CurrentActivity);
+					Journal.Insert(CurrentSchedule.size(), *CurrentActivity);
+				}
 				else
-					CurrentSchedule.insert(BeforeActivity, CurrentActivity);
+					Journal.Insert(GetIndex(CurrentSchedule, CurrentSchedule.insert(BeforeActivity, CurrentActivity)), *CurrentActivity);
 			}
+			else
+				Journal.Modify(SelectedIndex, PreviousActivity, *CurrentActivity);
 		}
 
 
 		// Write the schedule
-		Schedule::ScheduleFileIO::Write(CurrentSchedule, ScheduleFileName);
+		Save();
 
 		if (!Quiet)
 			DisplaySchedule(CurrentSchedule);
@@ -706,6 +1878,11 @@ int main(int argc, char **argv)
 				break;
 		}
 
+		if (MoveNumber == 1 && CurrentSchedule.size() > 1)
+			JournalPromotion(Journal, 2, **std::next(CurrentSchedule.begin()));
+		else if (BeforeNumber == 1 && MoveNumber != 1)
+			JournalPromotion(Journal, MoveNumber, **MoveActivityIterator);
+
 		Schedule::Activity * const MoveActivity = *MoveActivityIterator;
 		CurrentSchedule.erase(MoveActivityIterator);
 
@@ -714,7 +1891,9 @@ int main(int argc, char **argv)
 		else
 			CurrentSchedule.insert(BeforeActivityIterator, MoveActivity);
 
-		Schedule::ScheduleFileIO::Write(CurrentSchedule, ScheduleFileName);
+		Journal.Move(MoveNumber, BeforeNumber, CurrentSchedule.size());
+
+		Save();
 
 		if (!Quiet)
 			DisplaySchedule(CurrentSchedule);
@@ -743,310 +1922,821 @@ int main(int argc, char **argv)
 		{
 			if (Index == RemoveNumber)
 			{
+				if (RemoveNumber == 1 && CurrentSchedule.size() > 1)
+					JournalPromotion(Journal, 2, **std::next(ActivityIterator));
+
 				Schedule::Activity * const RemoveActivity = *ActivityIterator;
+				Journal.Erase(RemoveNumber, *RemoveActivity);
+
 				CurrentSchedule.erase(ActivityIterator);
 				delete RemoveActivity;
-
 				break;
 			}
 		}
 
-		Schedule::ScheduleFileIO::Write(CurrentSchedule, ScheduleFileName);
+		Save();
+
+		if (!Quiet)
+			DisplaySchedule(CurrentSchedule);
+	}
+
+
+	else if (Command == "begin")
+	{
+		// Find the number of the activity to begin, specified or otherwise
+		unsigned int BeginNumber = 0;
+		if (!Get(Argument, BeginNumber))
+		{
+			unsigned int Index = CurrentSchedule.size();
+			for (Schedule::Schedule::const_reverse_iterator ActivityIterator = CurrentSchedule.rbegin();
+															ActivityIterator != CurrentSchedule.rend();
+															++ActivityIterator, Index--)
+			{
+				Schedule::Activity const * const CurrentActivity = *ActivityIterator;
+				if (CurrentActivity->GetBeginning() == nullptr)
+					BeginNumber = Index;
+				else
+					break;
+			}
+		}
+		else
+			++Argument;
+
+		if (BeginNumber == 0 || BeginNumber > CurrentSchedule.size())
+		{
+			std::cerr << "Activity number out of range." << std::endl;
+			return 2;
+		}
+
+
+		// Find the activity to begin
+		Schedule::Activity *BeginActivity = *std::next(CurrentSchedule.begin(), BeginNumber - 1);
+
+
+		// Get the beginning time, specified or otherwise
+		Schedule::Offset BeginOffset;
+		{
+			std::string Next;
+			if (!Get(Argument, Next))
+				BeginOffset = Schedule::Offset::GetLocalTimeOfDay();
+			else
+				BeginOffset = OffsetTranslator::ToOffset(Next);
+		}
+
+
+		// Close the active pause if there is one
+		if (Schedule::Offset const *ActivePause = CurrentSchedule.GetActivePause())
+		{
+			if (BeginOffset < *ActivePause)
+			{
+				std::cerr << "The beginning time is earlier than the active pause." << std::endl;
+				return 2;
+			}
+
+			Schedule::Offset const PauseStart = *ActivePause;
+
+			CurrentSchedule.Resume(BeginOffset);
+			Journal.Resume(PauseStart, BeginOffset);
+		}
+
+
+		// Begin the activity and write it to the schedule
+		{
+			bool const Begun = (BeginActivity->GetBeginning() != nullptr);
+			Schedule::Offset const PreviousBeginning = (Begun ? *BeginActivity->GetBeginning() : Schedule::Offset());
+
+			CurrentSchedule.BeginActivity(*BeginActivity, BeginOffset);
+			Journal.Begin(BeginNumber, (Begun ? &PreviousBeginning : nullptr), BeginOffset);
+		}
+		Save();
+
+		if (!Quiet)
+			DisplaySchedule(CurrentSchedule);
+	}
+
+
+	else if (Command == "reset")
+	{
+		unsigned int ResetNumber = 0;
+		if (!Get(Argument, ResetNumber))
+		{
+			if (!CurrentSchedule.GetPauses().empty() || CurrentSchedule.GetActivePause() != nullptr)
+			{
+				Journal.ClearPauses(CurrentSchedule.GetPauses(), CurrentSchedule.GetActivePause());
+				CurrentSchedule.ClearPauses();
+			}
+
+			unsigned int Index = 1;
+			for (auto Activity : CurrentSchedule)
+			{
+				if (Activity->GetBeginning() != nullptr)
+				{
+					Journal.ClearBeginning(Index, *Activity->GetBeginning());
+					CurrentSchedule.ClearBeginning(*Activity);
+				}
+
+				Index++;
+			}
+
+			Save();
+		}
+		else
+		{
+			if (ResetNumber == 0 || ResetNumber > CurrentSchedule.size())
+			{
+				std::cerr << "Activity number out of range." << std::endl;
+				return 2;
+			}
+
+			unsigned int Index = 1;
+			for (auto Activity : CurrentSchedule)
+			{
+				if (Index == ResetNumber)
+				{
+					if (Activity->GetBeginning() != nullptr)
+						Journal.ClearBeginning(ResetNumber, *Activity->GetBeginning());
+
+					CurrentSchedule.ClearBeginning(*Activity);
+					break;
+				}
+
+				Index++;
+			}
+
+			Save();
+		}
+
+		if (!Quiet)
+			DisplaySchedule(CurrentSchedule);
+	}
+
+
+	else if (Command == "pause")
+	{
+		if (CurrentSchedule.size() == 0)
+		{
+			std::cerr << "The schedule is empty.  Cannot pause." << std::endl;
+			return 2;
+		}
+
+
+		// Get the pause time and check for sanity
+		Schedule::Offset PauseTime;
+		{
+			std::string Next;
+			if (!Get(Argument, Next))
+				PauseTime = Schedule::Offset::GetLocalTimeOfDay();
+			else
+				PauseTime = OffsetTranslator::ToOffset(Next);
+
+			if (PauseTime < CurrentSchedule.front()->GetActualStartTime() ||
+				PauseTime >= CurrentSchedule.back()->GetActualEndTime())
+			{
+				std::cerr << "The pause time is outside of the schedule.  Cannot pause." << std::endl;
+				return 2;
+			}
+
+			if (CurrentSchedule.GetActivePause() != nullptr)
+			{
+				std::cerr << "There is already an active pause in the schedule.  Cannot pause." << std::endl;
+				return 2;
+			}
+		}
+
+		if (!CurrentSchedule.Pause(PauseTime))
+		{
+			std::cerr << "The pause time is within another pause.  Cannot pause." << std::endl;
+			return 2;
+		}
+
+		Journal.Pause(PauseTime);
+		Save();
+
+		if (!Quiet)
+			DisplaySchedule(CurrentSchedule);
+	}
+	else if (Command == "undo" || Command == "redo")
+	{
+		unsigned int Count = 1;
+		if (Get(Argument, Count))
+			++Argument;
+		else if (Argument != Arguments.end())
+		{
+			DisplayHelp();
+			return 1;
+		}
+
+		if (!(Command == "undo" ? Journal.CanUndo() : Journal.CanRedo()))
+		{
+			std::cerr << "Nothing to " << Command << "." << std::endl;
+			return 2;
+		}
+
+		// A step that can't be applied has already been reported
+		unsigned int const Taken = (Command == "undo" ? Journal.Undo(CurrentSchedule, Count) :
+														Journal.Redo(CurrentSchedule, Count));
+
+		if (Taken == 0)
+			return 2;
+
+		Save();
+
+		if (!Quiet)
+			DisplaySchedule(CurrentSchedule);
+	}
+	else if (Command == "script")
+	{
+		std::string Script;
+		if (!ReadScript(Argument, Script))
+			return 2;
+
+		return RunScript(CurrentSchedule, Journal, Script, Quiet, Save);
+	}
+	else if (Command == "stats")
+	{
+		if (!Schedule::ScheduleStats::Enabled)
+		{
+			std::cerr << "Statistics were not compiled in.  Build with SCHEDULE_STATS to keep them." << std::endl;
+			return 2;
+		}
+
+		// Include the layout of the schedule read for this command
+		LayOut(CurrentSchedule);
+
+		std::string Buffer;
+		AppendStats(Buffer, Schedule::Schedule::GetStats());
+
+		WriteOutput(Buffer);
+		std::cout.flush();
+	}
+	else
+		DisplayHelp();
+
+	return 0;
+}
+
+
+// Runs each line of Script as a command against CurrentSchedule, then saves once.  Only explicit list commands display
+// anything until the script finishes.  If a command fails, the commands before it are kept.
+int RunScript(Schedule::Schedule &CurrentSchedule, Schedule::ScheduleJournal &Journal, std::string const &Script,
+			  bool Quiet, std::function<bool ()> const &Save)
+{
+	bool Modified = false;
+	std::function<bool ()> const Defer = [&]()
+	{
+		Modified = true;
+		return true;
+	};
+
+	int Result = 0;
+
+	std::istringstream Stream(Script);
+	std::string Line;
+
+	for (unsigned int LineNumber = 1; std::getline(Stream, Line); LineNumber++)
+	{
+		std::vector<std::string> Request;
+		if (!SplitScriptLine(Line, Request))
+		{
+			std::cerr << "Script line " << LineNumber << ": unterminated quote." << std::endl;
+			Result = 1;
+			break;
+		}
+
+		if (Request.empty())
+			continue;
+
+		std::string const &Command = Request.front();
+
+		if (Command != "list" &&
+			Command != "add" &&
+			Command != "set" &&
+			Command != "move" &&
+			Command != "remove" &&
+			Command != "begin" &&
+			Command != "reset" &&
+			Command != "pause" &&
+			Command != "undo" &&
+			Command != "redo")
+		{
+			std::cerr << "Script line " << LineNumber << ": " << Command << " is not a script command." << std::endl;
+			Result = 1;
+			break;
+		}
+
+		Arguments = Request;
+
+		Result = ExecuteCommand(CurrentSchedule, Journal, Arguments.begin(), Command != "list", Defer);
+
+		if (Result != 0)
+		{
+			std::cerr << "Script line " << LineNumber << ": stopped." << std::endl;
+			break;
+		}
+	}
+
+	if (Modified && !Save())
+		return 2;
+
+	if (!Quiet)
+		DisplaySchedule(CurrentSchedule);
+
+	return Result;
+}
+
+
+bool GetOptions(std::vector<std::string>::const_iterator &Argument, bool &Quiet, bool &Journaled)
+{
+	Quiet = false;
+	if (Compare(Argument, "-q"))
+	{
+		Quiet = true;
+		++Argument;
+	}
+
+	Journaled = false;
+	if (Compare(Argument, "-j"))
+	{
+		Journaled = true;
+		++Argument;
+	}
+
+	Format = OutputFormat::TABLE;
+	std::string Next;
+	if (Get(Argument, Next) && Next.compare(0, 9, "--format=") == 0)
+	{
+		std::string const Name = Next.substr(9);
+
+		if (Name == "jsonl")
+			Format = OutputFormat::JSON_LINES;
+		else if (Name == "tsv")
+			Format = OutputFormat::TSV;
+		else if (Name != "table")
+		{
+			std::cerr << "Unknown format: " << Name << std::endl;
+			return false;
+		}
+
+		++Argument;
+	}
 
-		if (!Quiet)
-			DisplaySchedule(CurrentSchedule);
+	ShowStats = false;
+	if (Compare(Argument, "--stats"))
+	{
+		ShowStats = true;
+		++Argument;
 	}
 
+	ShowMemory = false;
+	if (Compare(Argument, "--memory"))
+	{
+		ShowMemory = true;
+		++Argument;
+	}
 
-	else if (Command == "begin")
+	TraceFileName.clear();
+	if (Get(Argument, Next) && Next.compare(0, 8, "--trace=") == 0)
 	{
-		// Find the number of the activity to begin, specified or otherwise
-		unsigned int BeginNumber = 0;
-		if (!Get(Argument, BeginNumber))
-		{
-			unsigned int Index = CurrentSchedule.size();
-			for (Schedule::Schedule::const_reverse_iterator ActivityIterator = CurrentSchedule.rbegin();
-															ActivityIterator != CurrentSchedule.rend();
-															++ActivityIterator, Index--)
-			{
-				Schedule::Activity const * const CurrentActivity = *ActivityIterator;
-				if (CurrentActivity->GetBeginning() == nullptr && CurrentActivity->GetName() != "Pause")
-					BeginNumber = Index;
-				else
-					break;
-			}
-		}
-		else
-			++Argument;
+		TraceFileName = Next.substr(8);
 
-		if (BeginNumber == 0 || BeginNumber > CurrentSchedule.size())
+		if (TraceFileName.empty())
 		{
-			std::cerr << "Activity number out of range." << std::endl;
-			return 2;
+			std::cerr << "No trace file given." << std::endl;
+			return false;
 		}
 
+		++Argument;
+	}
 
-		// Find the activity to begin, and the active pause if there is one
-		Schedule::Activity					   *BeginActivity;
-		Schedule::Activity					   *ActivePause = nullptr;
-		Schedule::Schedule::reverse_iterator	ActivePauseIterator = CurrentSchedule.rend();
-		{
-			unsigned int Index = CurrentSchedule.size();
-			Schedule::Schedule::reverse_iterator ActivityIterator;
-			for (ActivityIterator = CurrentSchedule.rbegin();
-				 ActivityIterator != CurrentSchedule.rend();
-				 ++ActivityIterator, Index--)
-			{
-				if (Index == BeginNumber)
-				{
-					BeginActivity = *ActivityIterator;
+	return true;
+}
 
-					if (BeginActivity->GetName() == "Pause")
-					{
-						std::cerr << "Cannot begin a pause." << std::endl;
-						return 2;
-					}
 
-					break;
-				}
-			}
+// Runs a command forwarded to the daemon.  The daemon writes the whole schedule back itself, so journal records are
+// not kept, but the history is.
+int ServeCommand(Schedule::Schedule &CurrentSchedule, std::string const &FileName, std::vector<std::string> const &Request,
+				 std::function<bool ()> const &Save)
+{
+	Arguments = Request;
+	std::vector<std::string>::const_iterator Argument = Arguments.begin();
 
-			for (; ActivityIterator != CurrentSchedule.rend();
-				   ++ActivityIterator)
-			{
-				Schedule::Activity * const CurrentActivity = *ActivityIterator;
+	bool Quiet;
+	bool Journaled;
+	if (!GetOptions(Argument, Quiet, Journaled))
+		return 1;
 
-				if (CurrentActivity->GetName() == "Pause")
-				{
-					if (CurrentActivity->GetLengthMode() != Schedule::Activity::LengthMode::FIXED)
-					{
-						ActivePause = CurrentActivity;
-						ActivePauseIterator = ActivityIterator;
-					}
+	Schedule::ScheduleJournal Journal(FileName, CurrentSchedule);
+	Schedule::ScheduleStats const Before = Schedule::Schedule::GetStats();
 
-					// Only check the first pause we come to
-					break;
-				}
-			}
-		}
+	// The daemon writes the trace itself, so a relative trace file is found from the daemon's directory
+	if (!TraceFileName.empty())
+		Schedule::ScheduleTrace::Start(TraceFileName);
 
+	int const ExitCode = ExecuteCommand(CurrentSchedule, Journal, Argument, Quiet, [&]()
+	{
+		return Save() && Journal.CommitHistory(CurrentSchedule);
+	});
 
-		// Get the beginning time, specified or otherwise
-		Schedule::Offset BeginOffset;
-		{
-			std::string Next;
-			if (!Get(Argument, Next))
-				BeginOffset = Schedule::Offset::GetLocalTimeOfDay();
-			else
-				BeginOffset = OffsetTranslator::ToOffset(Next);
-		}
+	Schedule::ScheduleTrace::Stop();
+	ReportStats(Before);
+	ReportMemory(CurrentSchedule, Journal);
 
+	return ExitCode;
+}
 
-		// Close the active pause if there is one
-		if (ActivePause != nullptr)
-		{
-			Schedule::Duration const PauseLength = BeginOffset - ActivePause->GetActualStartTime();
 
-			if (PauseLength.IsNegative())
+// Appends Time in milliseconds, to the microsecond
+void AppendMilliseconds(std::string &Buffer, std::chrono::microseconds const &Time)
+{
+	AppendInteger(Buffer, Time.count() / 1000);
+	Buffer += '.';
+
+	char Fraction[] = "000";
+	for (long Value = Time.count() % 1000, Digit = 2; Digit >= 0; Value /= 10, Digit--)
+		Fraction[Digit] = '0' + Value % 10;
+
+	Buffer += Fraction;
+}
+
+
+// Reads, lays out, and optionally rewrites every schedule in the given directories and manifests
+int RunBatch(std::vector<std::string>::const_iterator &Argument)
+{
+	bool Rewrite = false;
+	unsigned int Threads = 0;
+
+	std::vector<std::string> FileNames;
+
+	for (std::string Next; Get(Argument, Next); ++Argument)
+	{
+		if (Next == "-w")
+			Rewrite = true;
+		else if (Next == "-t")
+		{
+			if (!Get(++Argument, Threads))
 			{
-				std::cerr << "The beginning time is earlier than the active pause." << std::endl;
+				std::cerr << "Invalid thread count." << std::endl;
 				return 2;
 			}
-
-			ActivePause->SetDesiredLength(PauseLength);
-			ActivePause->SetLengthMode(Schedule::Activity::LengthMode::FIXED);
 		}
+		else if (!Schedule::ScheduleBatch::GetFileNames(Next, FileNames))
+			return 2;
+	}
 
+	if (FileNames.empty())
+	{
+		std::cerr << "No schedules to process." << std::endl;
+		return 2;
+	}
 
-		// Begin the activity and write it to the schedule
-		CurrentSchedule.BeginActivity(*BeginActivity, BeginOffset);
-		Schedule::ScheduleFileIO::Write(CurrentSchedule, ScheduleFileName);
+	// The batch's fsyncs are shared, and finished below
+	if (Rewrite)
+		Schedule::ScheduleFileIO::SetSyncInterval(std::chrono::milliseconds(1000));
 
-		if (!Quiet)
-			DisplaySchedule(CurrentSchedule);
+	std::chrono::steady_clock::time_point const Start = std::chrono::steady_clock::now();
+
+	std::vector<Schedule::ScheduleBatch::Result> const Results = Schedule::ScheduleBatch::Run(FileNames, Rewrite, Threads);
+
+	bool Succeeded = (!Rewrite || Schedule::ScheduleFileIO::Sync());
+
+	std::chrono::microseconds const Elapsed =
+		std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start);
+
+	std::string Buffer;
+	Buffer.reserve(OutputChunkSize + 1024);
+
+	if (Format == OutputFormat::TABLE)
+	{
+		AppendCell(Buffer, "Status", 6);
+		Buffer += " | ";
+		AppendCell(Buffer, "Activities", 10);
+		Buffer += " | ";
+		AppendCell(Buffer, "Read (ms)", 11);
+		Buffer += " | ";
+		AppendCell(Buffer, "Layout (ms)", 11);
+		Buffer += " | ";
+		AppendCell(Buffer, "Write (ms)", 11);
+		Buffer += " | File\n";
 	}
+	else if (Format == OutputFormat::TSV)
+		Buffer += "file\tsucceeded\tactivities\tread_us\tlayout_us\twrite_us\n";
 
+	unsigned int Failed = 0;
 
-	else if (Command == "reset")
+	for (auto &Result : Results)
 	{
-		unsigned int ResetNumber = 0;
-		if (!Get(Argument, ResetNumber))
+		if (!Result.Succeeded)
 		{
-			Schedule::Schedule::iterator Previous = CurrentSchedule.end();
+			Failed++;
 
-			for (Schedule::Schedule::iterator ActivityIterator = CurrentSchedule.begin();
-											  ActivityIterator != CurrentSchedule.end();
-											  Previous = ActivityIterator++)
-			{
-				if ((*ActivityIterator)->GetName() == "Pause")
-				{
-					// Delete the pause
-					{
-						Schedule::Activity * const Pause = *ActivityIterator;
-						ActivityIterator = CurrentSchedule.erase(ActivityIterator);
-						delete Pause;
-					}
+			WriteOutput(Buffer);
+			std::cout.flush();
+			std::cerr << Result.Errors;
+		}
 
-					// Delete the second half of an activity that was split by the pause
-					if (Previous != CurrentSchedule.end() &&
-						ActivityIterator != CurrentSchedule.end() &&
-						(*Previous)->GetName() == (*ActivityIterator)->GetName())
-					{
-						Schedule::Activity * const Split = *ActivityIterator;
-						ActivityIterator = CurrentSchedule.erase(ActivityIterator);
-						delete Split;
-					}
-				}
-				else
-					CurrentSchedule.ClearBeginning(**ActivityIterator);
-			}
+		if (Format == OutputFormat::JSON_LINES)
+		{
+			Buffer += "{\"file\":";
+			AppendJsonString(Buffer, Result.FileName);
+			Buffer += ",\"succeeded\":";
+			Buffer += (Result.Succeeded ? "true" : "false");
+			Buffer += ",\"activities\":";
+			AppendInteger(Buffer, Result.Activities);
+			Buffer += ",\"read_us\":";
+			AppendInteger(Buffer, Result.ReadTime.count());
+			Buffer += ",\"layout_us\":";
+			AppendInteger(Buffer, Result.LayoutTime.count());
+			Buffer += ",\"write_us\":";
+			AppendInteger(Buffer, Result.WriteTime.count());
+			Buffer += ",\"errors\":";
+
+			if (Result.Succeeded)
+				Buffer += "null";
+			else
+				AppendJsonString(Buffer, Result.Errors);
 
-			Schedule::ScheduleFileIO::Write(CurrentSchedule, ScheduleFileName);
+			Buffer += "}\n";
+		}
+		else if (Format == OutputFormat::TSV)
+		{
+			Buffer += Result.FileName;
+			Buffer += (Result.Succeeded ? "\t1\t" : "\t0\t");
+			AppendInteger(Buffer, Result.Activities);
+			Buffer += '\t';
+			AppendInteger(Buffer, Result.ReadTime.count());
+			Buffer += '\t';
+			AppendInteger(Buffer, Result.LayoutTime.count());
+			Buffer += '\t';
+			AppendInteger(Buffer, Result.WriteTime.count());
+			Buffer += '\n';
 		}
 		else
 		{
-			if (ResetNumber == 0 || ResetNumber > CurrentSchedule.size())
+			AppendCell(Buffer, (Result.Succeeded ? "ok" : "FAILED"), 6);
+			Buffer += "   ";
+
 			{
-				std::cerr << "Activity number out of range." << std::endl;
-				return 2;
+				char Formatted[24];
+				AppendCell(Buffer, Formatted, FormatInteger(Result.Activities, Formatted), 10, Alignment::RIGHT);
 			}
 
-			unsigned int Index = 1;
-			for (auto Activity : CurrentSchedule)
+			for (auto Time : { Result.ReadTime, Result.LayoutTime, Result.WriteTime })
 			{
-				if (Index == ResetNumber)
-				{
-					CurrentSchedule.ClearBeginning(*Activity);
-					break;
-				}
+				std::string Milliseconds;
+				AppendMilliseconds(Milliseconds, Time);
 
-				Index++;
+				Buffer += "   ";
+				AppendCell(Buffer, Milliseconds, 11, Alignment::RIGHT);
 			}
 
-			Schedule::ScheduleFileIO::Write(CurrentSchedule, ScheduleFileName);
+			Buffer += "   ";
+			Buffer += Result.FileName;
+			Buffer += '\n';
 		}
 
-		if (!Quiet)
-			DisplaySchedule(CurrentSchedule);
+		if (Buffer.size() >= OutputChunkSize)
+			WriteOutput(Buffer);
 	}
 
+	if (Format == OutputFormat::TABLE)
+	{
+		Buffer += "Files: ";
+		AppendInteger(Buffer, Results.size());
+		Buffer += " | Failed: ";
+		AppendInteger(Buffer, Failed);
+		Buffer += " | Total: ";
+		AppendMilliseconds(Buffer, Elapsed);
+		Buffer += " ms\n";
+	}
 
-	else if (Command == "pause")
+	WriteOutput(Buffer);
+	std::cout.flush();
+
+	if (!Succeeded)
+		std::cerr << "Some rewritten schedules could not be synced to disk." << std::endl;
+
+	return (Failed == 0 && Succeeded ? 0 : 2);
+}
+
+
+// Starts tracing to the --trace file, or to $SCHEDULE_TRACE
+void StartTrace()
+{
+	if (!TraceFileName.empty())
+		Schedule::ScheduleTrace::Start(TraceFileName);
+	else if (char const * const FileName = std::getenv("SCHEDULE_TRACE"))
 	{
-		if (CurrentSchedule.size() == 0)
+		if (*FileName != '\0')
+			Schedule::ScheduleTrace::Start(FileName);
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	TimingPhases = (std::getenv("SCHEDULE_TIMINGS") != nullptr);
+	if (TimingPhases)
+		Entered = std::chrono::steady_clock::now();
+
+	Arguments.insert(Arguments.end(), argv + 1, argv + argc);
+	std::vector<std::string>::const_iterator Argument = Arguments.begin();
+
+	std::string ScheduleFileName = "default.sch";
+	{
+		std::string Next;
+		if (Get(Argument, Next) &&
+			Next != "list" &&
+			Next != "add" &&
+			Next != "set" &&
+			Next != "move" &&
+			Next != "remove" &&
+			Next != "begin" &&
+			Next != "reset" &&
+			Next != "pause" &&
+			Next != "undo" &&
+			Next != "redo" &&
+			Next != "script" &&
+			Next != "daemon" &&
+			Next != "batch" &&
+			Next != "stats" &&
+			Next != "watch" &&
+			Next != "now" &&
+			Next != "-q" &&
+			Next != "-j" &&
+			Next.compare(0, 9, "--format=") != 0 &&
+			Next != "--stats" &&
+			Next != "--memory" &&
+			Next.compare(0, 8, "--trace=") != 0 &&
+			Next != "-h" &&
+			Next != "--help")
 		{
-			std::cerr << "The schedule is empty.  Cannot pause." << std::endl;
-			return 2;
+			ScheduleFileName = Next;
+
+			++Argument;
 		}
+	}
 
+	std::vector<std::string>::const_iterator Options = Argument;
 
-		// Get the pause time and check for sanity
-		Schedule::Offset PauseTime;
-		{
-			std::string Next;
-			if (!Get(Argument, Next))
-				PauseTime = Schedule::Offset::GetLocalTimeOfDay();
-			else
-				PauseTime = OffsetTranslator::ToOffset(Next);
+	bool Quiet;
+	bool Journaled;
+	if (!GetOptions(Argument, Quiet, Journaled))
+		return 1;
 
-			if (PauseTime < CurrentSchedule.front()->GetActualStartTime() ||
-				PauseTime >= CurrentSchedule.back()->GetActualStartTime() + CurrentSchedule.back()->GetActualLength())
+	if (Compare(Argument, "-h") || Compare(Argument, "--help"))
+	{
+		DisplayHelp();
+		return 0;
+	}
+
+	if (Compare(Argument, "daemon"))
+	{
+		Schedule::ScheduleDaemon Daemon(Schedule::ScheduleDaemon::GetDefaultSocketPath(), ServeCommand);
+		return Daemon.Run();
+	}
+
+	if (Compare(Argument, "batch"))
+	{
+		StartTrace();
+
+		int const ExitCode = RunBatch(++Argument);
+
+		Schedule::ScheduleTrace::Stop();
+		return ExitCode;
+	}
+
+	// Watched schedules stay in this process, even while a daemon is running
+	if (Compare(Argument, "watch"))
+	{
+		std::string Hooks[2];
+		bool Publishing = false;
+
+		for (++Argument; Argument != Arguments.cend(); ++Argument)
+		{
+			if (*Argument == "--publish")
 			{
-				std::cerr << "The pause time is outside of the schedule.  Cannot pause." << std::endl;
-				return 2;
+				Publishing = true;
+				continue;
 			}
 
-			for (auto Activity : CurrentSchedule)
+			std::string * const Hook = (*Argument == "--on-start" ? &Hooks[0] : (*Argument == "--on-end" ? &Hooks[1] : nullptr));
+
+			if (Hook == nullptr || !Get(++Argument, *Hook))
 			{
-				if (Activity->GetName() == "Pause" &&
-					Activity->GetLengthMode() != Schedule::Activity::LengthMode::FIXED)
-				{
-					std::cerr << "There is already an active pause in the schedule.  Cannot pause." << std::endl;
-					return 2;
-				}
+				DisplayHelp();
+				return 1;
 			}
 		}
 
-
-		// Get the activity to split and the one after it
-		Schedule::Activity					   *BeforeActivity = nullptr;
-		Schedule::Schedule::reverse_iterator	BeforeActivityIterator = CurrentSchedule.rend();
-		Schedule::Schedule::iterator			NextActivityIterator = CurrentSchedule.end();
+		std::unique_ptr<Schedule::ScheduleShared> Shared;
+		if (Publishing)
 		{
-			for (Schedule::Schedule::reverse_iterator ActivityIterator = CurrentSchedule.rbegin();
-													  ActivityIterator != CurrentSchedule.rend();
-													  ++ActivityIterator)
-			{
-				if ((*ActivityIterator)->GetActualStartTime() <= PauseTime)
-				{
-					BeforeActivity = *ActivityIterator;
-					BeforeActivityIterator = ActivityIterator;
-					break;
-				}
-			}
+			Shared.reset(new Schedule::ScheduleShared(Schedule::ScheduleShared::GetDefaultName()));
 
-			NextActivityIterator = BeforeActivityIterator.base();
+			if (!Shared->IsOpen())
+				return 2;
 		}
 
+		WatchDisplay Display;
+		Schedule::ScheduleWatch Watch(ScheduleFileName, [&](Schedule::Schedule const &Watched,
+															 Schedule::Schedule::size_type Current,
+															 std::vector<Schedule::Schedule::ActivityRange> const &Changed,
+															 bool Everything)
+		{
+			if (Shared)
+				Shared->Publish(Watched, Current, Changed, Everything);
 
-		// Split the activity and insert the pause
+			if (!Quiet)
+				Display.Draw(Watched, Current, Changed, Everything);
+		},
+		[&](Schedule::Activity const &Changed, Schedule::ScheduleEvents::Transition Kind, Schedule::Offset const &At)
 		{
-			std::string const			BeforeName = BeforeActivity->GetName();
-			bool const					BeforeFixedLength = (BeforeActivity->GetLengthMode() == Schedule::Activity::LengthMode::FIXED);
-			Schedule::Duration const	BeforeLength = PauseTime - BeforeActivity->GetActualStartTime();
-			Schedule::Duration const	BeforeDesiredLength = BeforeActivity->GetDesiredLength();
-			Schedule::Duration const	AfterLength = BeforeActivity->GetActualStartTime() + BeforeActivity->GetActualLength() - PauseTime;
+			std::string const &Hook = Hooks[Kind == Schedule::ScheduleEvents::Transition::START ? 0 : 1];
 
-			if (BeforeLength.IsZero())
-			{
-				++BeforeActivityIterator;
-				CurrentSchedule.erase(BeforeActivityIterator.base());
-				delete BeforeActivity;
-			}
-			else if (BeforeActivity->GetStartMode() == Schedule::Activity::StartMode::FREE &&
-					 BeforeActivity->GetBeginning() == nullptr)
-			{
-					BeforeActivity->SetDesiredStartTime(BeforeActivity->GetActualStartTime());
-					BeforeActivity->SetStartMode(Schedule::Activity::StartMode::FIXED_ABSOLUTE);
-			}
+			if (!Hook.empty())
+				RunHook(Hook, ScheduleFileName, Changed, Kind, At);
+		});
 
-			{
-				Schedule::Activity * const PauseActivity = new Schedule::Activity;
-				PauseActivity->SetName("Pause");
-				PauseActivity->SetDesiredStartTime(PauseTime);
-				PauseActivity->SetStartMode(Schedule::Activity::StartMode::FIXED_ABSOLUTE);
-				PauseActivity->SetDesiredLength(Schedule::Duration());
+		// Hooks aren't waited for
+		if (!Hooks[0].empty() || !Hooks[1].empty())
+			std::signal(SIGCHLD, SIG_IGN);
 
-				CurrentSchedule.insert(NextActivityIterator, PauseActivity);
-			}
+		return Watch.Run();
+	}
 
-			if (!AfterLength.IsZero())
-			{
-				Schedule::Activity * const AfterActivity = new Schedule::Activity;
-				AfterActivity->SetName(BeforeName);
+	// Read from a watch's shared memory when there is one, without going through a daemon
+	if (Compare(Argument, "now"))
+	{
+		if (Argument + 1 != Arguments.cend())
+		{
+			DisplayHelp();
+			return 1;
+		}
 
-				if (!BeforeFixedLength)
-				{
-					float const RemainingTimeScale = (float)AfterLength.GetTotalSeconds() / (BeforeLength + AfterLength).GetTotalSeconds();
-					AfterActivity->SetDesiredLength(BeforeDesiredLength * RemainingTimeScale);
-				}
-				else
-				{
-					AfterActivity->SetDesiredLength(AfterLength);
-					AfterActivity->SetLengthMode(Schedule::Activity::LengthMode::FIXED);
-				}
+		Schedule::Offset const Now = Schedule::Offset::GetLocalTimeOfDay();
+		Schedule::ScheduleShared::Status Shown;
 
-				CurrentSchedule.insert(NextActivityIterator, AfterActivity);
-			}
+		if (!Schedule::ScheduleShared::Read(Schedule::ScheduleShared::GetDefaultName(), Now, Shown))
+			Schedule::ScheduleShared::GetStatus(Schedule::ScheduleFileIO::Read(ScheduleFileName), Now, Shown);
+
+		DisplayStatus(Shown);
+		return 0;
+	}
+
+	// Read the script up front, so that it reaches a daemon intact and standard input is only read once
+	if (Compare(Argument, "script"))
+	{
+		std::string Script;
+		if (!ReadScript(Argument + 1, Script))
+			return 2;
+
+		std::vector<std::string>::difference_type const OptionsOffset = Options - Arguments.cbegin();
+		std::vector<std::string>::difference_type const ArgumentOffset = Argument - Arguments.cbegin();
+
+		Arguments.erase(Argument + 1, Arguments.cend());
+		Arguments.push_back("-e");
+		Arguments.push_back(Script);
 
-			Schedule::ScheduleFileIO::Write(CurrentSchedule, ScheduleFileName);
+		Options = Arguments.cbegin() + OptionsOffset;
+		Argument = Arguments.cbegin() + ArgumentOffset;
+	}
+
+	// Hand the command to a running daemon, if there is one
+	{
+		int ExitCode;
+		if (Schedule::ScheduleDaemon::Forward(Schedule::ScheduleDaemon::GetDefaultSocketPath(), ScheduleFileName,
+											  std::vector<std::string>(Options, Arguments.cend()), ExitCode))
+		{
+			return ExitCode;
 		}
+	}
 
-		if (!Quiet)
-			DisplaySchedule(CurrentSchedule);
+
+	// Started only now, since forwarded commands are traced by the daemon
+	StartTrace();
+
+	Schedule::Schedule CurrentSchedule;
+	{
+		Schedule::ScheduleTrace::Span const Timer("Parse", "phase", GetPhaseTally(Phase::PARSE));
+		CurrentSchedule = Schedule::ScheduleFileIO::Read(ScheduleFileName);
 	}
-	else
-		DisplayHelp();
 
-	return 0;
+	Schedule::ScheduleJournal Journal(ScheduleFileName, CurrentSchedule);
+
+	int ExitCode;
+	{
+		Schedule::ScheduleTrace::Span const Timer("Command", "phase", GetPhaseTally(Phase::MUTATE));
+
+		ExitCode = ExecuteCommand(CurrentSchedule, Journal, Argument, Quiet, [&]()
+		{
+			return SaveSchedule(CurrentSchedule, ScheduleFileName, Journal, Journaled);
+		});
+	}
+
+	ReportPhaseTimes();
+	ReportStats(Schedule::ScheduleStats());
+	ReportMemory(CurrentSchedule, Journal);
+	Schedule::ScheduleTrace::Stop();
+
+	return ExitCode;
 }